@@ -1,8 +1,13 @@
 #include "batch.hpp"
 #include "chunk.hpp"
 #include "connectivity.hpp"
+#include "kronmult.hpp"
 #include "lib_dispatch.hpp"
 #include "tensors.hpp" // for views
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <optional>
 
 // object to store lists of operands for batched gemm/gemv.
 // utilized as the primary data structure for other functions
@@ -13,7 +18,7 @@ batch<P>::batch(int const num_entries, int const nrows, int const ncols,
     : num_entries_(num_entries), nrows_(nrows), ncols_(ncols), stride_(stride),
       do_trans_(do_trans), batch_{new P *[num_entries]()}
 {
-  assert(num_entries > 0);
+  assert(num_entries >= 0);
   assert(nrows > 0);
   assert(ncols > 0);
   assert(stride > 0);
@@ -23,13 +28,43 @@ batch<P>::batch(int const num_entries, int const nrows, int const ncols,
   }
 }
 
+// offset marking a run of an indexed compact batch that has not been
+// assigned
+static uint32_t constexpr unassigned_offset =
+    std::numeric_limits<uint32_t>::max();
+
+template<typename P>
+batch<P>::batch(int const num_entries, int const nrows, int const ncols,
+                int const stride, bool const do_trans,
+                batch_layout<P> const &layout)
+    : num_entries_(num_entries), nrows_(nrows), ncols_(ncols), stride_(stride),
+      do_trans_(do_trans), batch_{nullptr}, layout_(layout),
+      offsets_(layout.indexed ? num_entries / layout.run : 0,
+               unassigned_offset)
+{
+  assert(num_entries >= 0);
+  assert(nrows > 0);
+  assert(ncols > 0);
+  assert(stride > 0);
+  assert(!layout.bases.empty());
+  assert(layout.run > 0);
+  assert(num_entries % layout.run == 0);
+  assert(layout.outer >= 0);
+  assert(layout.inner >= 0);
+}
+
 template<typename P>
 batch<P>::batch(batch<P> const &other)
     : num_entries_(other.num_entries()), nrows_(other.nrows()),
       ncols_(other.ncols()), stride_(other.get_stride()),
-      do_trans_(other.get_trans()), batch_{new P *[other.num_entries()]()}
+      do_trans_(other.get_trans()), batch_{nullptr}, layout_(other.layout_),
+      offsets_(other.offsets_)
 {
-  std::memcpy(batch_, other.batch_, other.num_entries() * sizeof(P *));
+  if (!other.is_compact())
+  {
+    batch_ = new P *[other.num_entries()]();
+    std::memcpy(batch_, other.batch_, other.num_entries() * sizeof(P *));
+  }
 }
 
 template<typename P>
@@ -44,7 +79,21 @@ batch<P> &batch<P>::operator=(batch<P> const &other)
   assert(ncols() == other.ncols());
   assert(get_stride() == other.get_stride());
   assert(get_trans() == other.get_trans());
-  std::memcpy(batch_, other.batch_, other.num_entries() * sizeof(P *));
+  if (other.is_compact())
+  {
+    delete[] batch_;
+    batch_ = nullptr;
+  }
+  else
+  {
+    if (!batch_)
+    {
+      batch_ = new P *[other.num_entries()]();
+    }
+    std::memcpy(batch_, other.batch_, other.num_entries() * sizeof(P *));
+  }
+  layout_  = other.layout_;
+  offsets_ = other.offsets_;
   return *this;
 }
 
@@ -52,7 +101,8 @@ template<typename P>
 batch<P>::batch(batch<P> &&other)
     : num_entries_(other.num_entries()), nrows_(other.nrows()),
       ncols_(other.ncols()), stride_(other.get_stride()),
-      do_trans_(other.get_trans()), batch_{other.batch_}
+      do_trans_(other.get_trans()), batch_{other.batch_},
+      layout_(std::move(other.layout_)), offsets_(std::move(other.offsets_))
 {
   other.batch_ = nullptr;
 }
@@ -70,8 +120,11 @@ batch<P> &batch<P>::operator=(batch<P> &&other)
   assert(get_stride() == other.get_stride());
 
   assert(get_trans() == other.get_trans());
+  delete[] batch_;
   batch_       = other.batch_;
   other.batch_ = nullptr;
+  layout_      = std::move(other.layout_);
+  offsets_     = std::move(other.offsets_);
   return *this;
 }
 
@@ -105,9 +158,11 @@ bool batch<P>::operator==(batch<P> other) const
     return false;
   }
 
+  // compares where entries point, so compact and pointer list batches
+  // describing the same operands are equal
   for (int i = 0; i < num_entries(); ++i)
   {
-    if (batch_[i] != other.batch_[i])
+    if ((*this)(i) != other(i))
     {
       return false;
     }
@@ -121,7 +176,23 @@ P *batch<P>::operator()(int const position) const
 {
   assert(position >= 0);
   assert(position < num_entries());
-  return batch_[position];
+  if (!is_compact())
+  {
+    return batch_[position];
+  }
+
+  int const run      = position / layout_.run;
+  P *const base      = layout_.bases[run % layout_.bases.size()];
+  int64_t const step = (position % layout_.run) * layout_.inner;
+  if (!layout_.indexed)
+  {
+    return base + run * layout_.outer + step;
+  }
+  if (offsets_[run] == unassigned_offset)
+  {
+    return nullptr;
+  }
+  return base + offsets_[run] + step;
 }
 
 // assign the provided view's data pointer
@@ -144,14 +215,46 @@ void batch<P>::assign_entry(fk::matrix<P, mem_type::view> const a,
     assert(a.stride() == get_stride());
   }
 
+  assign_raw(a.data(), position);
+}
+
+// assign an entry by its location alone, for operands that can't be
+// expressed as a view - e.g., those whose leading dimension is larger than
+// their number of rows within a vector
+template<typename P>
+void batch<P>::assign_raw(P *const a, int const position)
+{
+  assert(a);
+
   // ensure position is valid
   assert(position >= 0);
   assert(position < num_entries());
 
-  // ensure nothing already assigned
-  assert(!batch_[position]);
+  if (!is_compact())
+  {
+    // ensure nothing already assigned
+    assert(!batch_[position]);
 
-  batch_[position] = a.data();
+    batch_[position] = a;
+    return;
+  }
+
+  // compact batches only record where the entry falls in the layout
+  int const run = position / layout_.run;
+  if (!layout_.indexed)
+  {
+    assert(a == (*this)(position));
+    return;
+  }
+  P *const base = layout_.bases[run % layout_.bases.size()];
+  int64_t const offset = a - base - (position % layout_.run) * layout_.inner;
+  assert(offset >= 0);
+  assert(offset < unassigned_offset);
+  // entries of a run share an offset; they may each be assigned, but a run
+  // can't be moved once assigned
+  assert(offsets_[run] == unassigned_offset ||
+         (layout_.run > 1 && offsets_[run] == offset));
+  offsets_[run] = static_cast<uint32_t>(offset);
 }
 
 // clear one assignment
@@ -160,6 +263,7 @@ void batch<P>::assign_entry(fk::matrix<P, mem_type::view> const a,
 template<typename P>
 bool batch<P>::clear_entry(int const position)
 {
+  assert(!is_compact());
   P *temp          = batch_[position];
   batch_[position] = nullptr;
   return temp;
@@ -173,6 +277,7 @@ bool batch<P>::clear_entry(int const position)
 template<typename P>
 P *const *batch<P>::get_list() const
 {
+  assert(!is_compact());
   return batch_;
 }
 
@@ -181,6 +286,12 @@ P *const *batch<P>::get_list() const
 template<typename P>
 bool batch<P>::is_filled() const
 {
+  if (is_compact())
+  {
+    return std::none_of(
+        offsets_.begin(), offsets_.end(),
+        [](uint32_t const offset) { return offset == unassigned_offset; });
+  }
   for (P *const ptr : (*this))
   {
     if (!ptr)
@@ -191,10 +302,81 @@ bool batch<P>::is_filled() const
   return true;
 }
 
+template<typename P>
+void batch<P>::expand(int const start, int const count,
+                      workspace_binding<P> const &binding, P **list) const
+{
+  assert(start >= 0);
+  assert(count >= 0);
+  assert(start + count <= num_entries());
+  if (!is_compact())
+  {
+    for (int i = 0; i < count; ++i)
+    {
+      list[i] = binding(batch_[start + i]);
+    }
+    return;
+  }
+
+  // the binding moves whole buffers, and each base's entries lie in the
+  // base's buffer, so only the bases need moving. runs cycle through the
+  // bases; fill the runs of each base in turn
+  int const num_bases = static_cast<int>(layout_.bases.size());
+  int const stop      = start + count;
+  int const first_run = start / layout_.run;
+  for (int j = 0; j < num_bases; ++j)
+  {
+    P *const base = binding(layout_.bases[j]);
+    int run       = first_run + (j - first_run % num_bases + num_bases) %
+                                num_bases;
+    for (; run * layout_.run < stop; run += num_bases)
+    {
+      bool const unassigned =
+          layout_.indexed && offsets_[run] == unassigned_offset;
+      P *const run_base = base + (layout_.indexed
+                                      ? static_cast<int64_t>(offsets_[run])
+                                      : run * layout_.outer);
+      int const run_start = std::max(start, run * layout_.run);
+      int const run_stop  = std::min(stop, (run + 1) * layout_.run);
+      for (int i = run_start; i < run_stop; ++i)
+      {
+        list[i - start] =
+            unassigned ? nullptr
+                       : run_base + (i % layout_.run) * layout_.inner;
+      }
+    }
+  }
+}
+
+template<typename P>
+bool batch<P>::is_strided(P *&first, int64_t &step) const
+{
+  if (!is_compact() || layout_.indexed)
+  {
+    return false;
+  }
+  int const num_runs = num_entries() / layout_.run;
+  if (num_runs > 1 && layout_.bases.size() > 1)
+  {
+    return false;
+  }
+  // within a run entries step by inner, and between runs by outer; these
+  // agree if the runs are back to back, or there is only one of either
+  if (layout_.run > 1 && num_runs > 1 &&
+      layout_.outer != layout_.run * layout_.inner)
+  {
+    return false;
+  }
+  first = layout_.bases[0];
+  step  = layout_.run > 1 ? layout_.inner : layout_.outer;
+  return true;
+}
+
 // clear assignments
 template<typename P>
 batch<P> &batch<P>::clear_all()
 {
+  assert(!is_compact());
   for (P *&ptr : (*this))
   {
     ptr = nullptr;
@@ -202,6 +384,20 @@ batch<P> &batch<P>::clear_all()
   return *this;
 }
 
+template<typename P>
+int64_t batch<P>::metadata_bytes() const
+{
+  if (!is_compact())
+  {
+    return static_cast<int64_t>(num_entries()) * sizeof(P *);
+  }
+  return static_cast<int64_t>(offsets_.size()) * sizeof(uint32_t) +
+         static_cast<int64_t>(layout_.bases.size()) * sizeof(P *);
+}
+
+// entries of compact batches expanded to pointers per batched gemm call
+static int constexpr compact_block_size = 4096;
+
 // execute a batched gemm given a, b, c batch lists
 // and other blas information
 // if we store info in the batch about where it is
@@ -209,7 +405,9 @@ batch<P> &batch<P>::clear_all()
 // for calling cpu/gpu blas etc.
 template<typename P>
 void batched_gemm(batch<P> const &a, batch<P> const &b, batch<P> const &c,
-                  P const alpha, P const beta)
+                  P const alpha, P const beta,
+                  workspace_binding<P> const &binding,
+                  std::vector<P *> *const lists)
 {
   // check cardinality of sets
   assert(a.num_entries() == b.num_entries());
@@ -249,12 +447,80 @@ void batched_gemm(batch<P> const &a, batch<P> const &b, batch<P> const &c,
   P alpha_               = alpha;
   P beta_                = beta;
 
-  for (int i = 0; i < num_entries; ++i)
+  if (!a.is_compact() && !b.is_compact() && !c.is_compact() &&
+      binding.is_identity())
   {
-    if (a(i) && b(i) && c(i))
-      lib_dispatch::gemm(&transpose_a, &transpose_b, &m, &n, &k, &alpha_, a(i),
-                         &lda, b(i), &ldb, &beta_, c(i), &ldc);
+    int num_batch = num_entries;
+    lib_dispatch::batched_gemm(&transpose_a, &transpose_b, &m, &n, &k, &alpha_,
+                               a.get_list(), &lda, b.get_list(), &ldb, &beta_,
+                               c.get_list(), &ldc, &num_batch);
+    return;
+  }
+
+  // strided operands need no pointer lists at all. the strides are between
+  // entries of one buffer, so are unchanged by the binding
+  P *a_first;
+  P *b_first;
+  P *c_first;
+  int64_t a_step;
+  int64_t b_step;
+  int64_t c_step;
+  auto const fits_int = [](int64_t const step) {
+    return step <= std::numeric_limits<int>::max();
+  };
+  if (a.is_strided(a_first, a_step) && b.is_strided(b_first, b_step) &&
+      c.is_strided(c_first, c_step) && fits_int(a_step) &&
+      fits_int(b_step) && fits_int(c_step))
+  {
+    int num_batch = num_entries;
+    int stride_a  = static_cast<int>(a_step);
+    int stride_b  = static_cast<int>(b_step);
+    int stride_c  = static_cast<int>(c_step);
+    lib_dispatch::batched_gemm_strided(
+        &transpose_a, &transpose_b, &m, &n, &k, &alpha_, binding(a_first),
+        &lda, &stride_a, binding(b_first), &ldb, &stride_b, &beta_,
+        binding(c_first), &ldc, &stride_c, &num_batch);
+    return;
   }
+
+  // expand compact (or moved) batches into pointer lists a block at a time
+  int const block_size = std::min(num_entries, compact_block_size);
+  std::vector<P *> own_lists;
+  std::vector<P *> &list = lists ? *lists : own_lists;
+  if (static_cast<int>(list.size()) < 3 * block_size)
+  {
+    list.resize(3 * block_size);
+  }
+  P **const a_list = list.data();
+  P **const b_list = a_list + block_size;
+  P **const c_list = b_list + block_size;
+  for (int start = 0; start < num_entries; start += block_size)
+  {
+    int num_batch = std::min(block_size, num_entries - start);
+    a.expand(start, num_batch, binding, a_list);
+    b.expand(start, num_batch, binding, b_list);
+    c.expand(start, num_batch, binding, c_list);
+    lib_dispatch::batched_gemm(&transpose_a, &transpose_b, &m, &n, &k, &alpha_,
+                               a_list, &lda, b_list, &ldb, &beta_, c_list,
+                               &ldc, &num_batch);
+  }
+}
+
+template<typename P>
+workspace_binding<P>::workspace_binding(rank_workspace<P> const &from,
+                                        rank_workspace<P> &to)
+{
+  auto const bind = [this](fk::vector<P> const &from, fk::vector<P> &to) {
+    assert(from.size() == to.size());
+    if (from.data() != to.data() && from.size() > 0)
+    {
+      buffers_.push_back({from.data(), from.size(), to.data()});
+    }
+  };
+  bind(from.batch_input, to.batch_input);
+  bind(from.batch_intermediate, to.batch_intermediate);
+  bind(from.reduction_space, to.reduction_space);
+  bind(from.batch_output, to.batch_output);
 }
 
 // execute a batched gemv given a, b, c batch lists
@@ -523,6 +789,54 @@ void kronmult_to_batch_sets(
   batches[pde.num_dims - 1][2].assign_entry(y_view, batch_offset);
 }
 
+template<typename P>
+block_structure<P>::block_structure(PDE<P> const &pde, P const drop_tol)
+    : drop_tol_(drop_tol), num_dims_(pde.num_dims),
+      degree_(pde.get_dimensions()[0].get_degree())
+{
+  assert(drop_tol >= 0);
+  for (int d = 0; d < num_dims_; ++d)
+  {
+    num_blocks_.push_back(pde.get_coefficients(0, d).nrows() / degree_);
+  }
+  for (int k = 0; k < pde.num_terms; ++k)
+  {
+    for (int d = 0; d < num_dims_; ++d)
+    {
+      fk::matrix<P> const &coefficients = pde.get_coefficients(k, d);
+      int const num_blocks              = num_blocks_[d];
+      assert(coefficients.nrows() == num_blocks * degree_);
+      assert(coefficients.ncols() == num_blocks * degree_);
+
+      std::vector<kronmult::block_kind> kinds(num_blocks * num_blocks);
+      for (int col = 0; col < num_blocks; ++col)
+      {
+        for (int row = 0; row < num_blocks; ++row)
+        {
+          int64_t const offset =
+              static_cast<int64_t>(col) * degree_ * coefficients.stride() +
+              row * degree_;
+          kinds[col * num_blocks + row] = kronmult::classify_block(
+              coefficients.data() + offset, coefficients.stride(), degree_,
+              drop_tol);
+        }
+      }
+      kinds_.push_back(std::move(kinds));
+    }
+  }
+}
+
+template<typename P>
+int64_t block_structure<P>::count(kronmult::block_kind const kind) const
+{
+  int64_t total = 0;
+  for (auto const &kinds : kinds_)
+  {
+    total += std::count(kinds.begin(), kinds.end(), kind);
+  }
+  return total;
+}
+
 // helper for calculating 1d indices for elements
 static fk::vector<int> linearize(fk::vector<int> const &coords)
 {
@@ -534,163 +848,1349 @@ static fk::vector<int> linearize(fk::vector<int> const &coords)
   return elem_indices;
 }
 
+template<typename P>
+bool block_structure<P>::is_connected(element_table const &elem_table,
+                                      int const row, int const col) const
+{
+  fk::vector<int> const row_indices = linearize(elem_table.get_coords(row));
+  fk::vector<int> const col_indices = linearize(elem_table.get_coords(col));
+  int const num_terms = static_cast<int>(kinds_.size()) / num_dims_;
+  for (int k = 0; k < num_terms; ++k)
+  {
+    bool has_zero = false;
+    for (int d = 0; d < num_dims_ && !has_zero; ++d)
+    {
+      has_zero = kind(k, d, row_indices(d) * degree_,
+                      col_indices(d) * degree_) == kronmult::block_kind::zero;
+    }
+    if (!has_zero)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+template<typename P>
+cost_model block_structure<P>::pair_costs(element_table const &elem_table,
+                                          list_set const &connectivity,
+                                          kronmult_engine const engine) const
+{
+  assert(static_cast<int>(connectivity.size()) == elem_table.size());
+  int const num_terms = static_cast<int>(kinds_.size()) / num_dims_;
+  cost_model costs;
+  costs.reserve(connectivity.size());
+  for (int row = 0; row < static_cast<int>(connectivity.size()); ++row)
+  {
+    fk::vector<int> const row_indices = linearize(elem_table.get_coords(row));
+    std::vector<double> row_costs;
+    row_costs.reserve(connectivity[row].size());
+    for (int const col : connectivity[row])
+    {
+      fk::vector<int> const col_indices =
+          linearize(elem_table.get_coords(col));
+      double cost = 0.0;
+      for (int k = 0; k < num_terms; ++k)
+      {
+        // one to sum the product, then its stages; none if it's dropped
+        double product = 1.0;
+        for (int d = 0; d < num_dims_ && product > 0.0; ++d)
+        {
+          kronmult::block_kind const block =
+              kind(k, d, row_indices(d) * degree_, col_indices(d) * degree_);
+          if (block == kronmult::block_kind::zero)
+          {
+            product = 0.0;
+          }
+          else
+          {
+            product += engine != kronmult_engine::fused ||
+                               block == kronmult::block_kind::dense
+                           ? degree_
+                           : 1;
+          }
+        }
+        cost += product;
+      }
+      row_costs.push_back(cost);
+    }
+    costs.push_back(std::move(row_costs));
+  }
+  return costs;
+}
+
+template<typename P>
+list_set block_structure<P>::prune(element_table const &elem_table,
+                                   list_set const &connectivity) const
+{
+  assert(static_cast<int>(connectivity.size()) == elem_table.size());
+  list_set pruned;
+  pruned.reserve(connectivity.size());
+  for (int row = 0; row < static_cast<int>(connectivity.size()); ++row)
+  {
+    std::vector<int> connected;
+    for (int const col : connectivity[row])
+    {
+      if (is_connected(elem_table, row, col))
+      {
+        connected.push_back(col);
+      }
+    }
+    pruned.push_back(fk::vector<int>(connected));
+  }
+  return pruned;
+}
+
+// static helper - run func(i) for each i in [0, num_items), divided among the
+// threads used by lib_dispatch's batched routines (see set_num_threads).
+// func must only write what belongs to its own i
+template<typename F>
+static void parallel_for(int const num_items, F &&func)
+{
+#ifdef ASGARD_USE_OPENMP
+  int const grain_size  = lib_dispatch::get_grain_size();
+  int const num_threads = lib_dispatch::get_num_threads();
+#pragma omp parallel for schedule(dynamic, grain_size) \
+    num_threads(num_threads) if (num_items > grain_size && num_threads > 1)
+  for (int i = 0; i < num_items; ++i)
+  {
+    func(i);
+  }
+#else
+  for (int i = 0; i < num_items; ++i)
+  {
+    func(i);
+  }
+#endif
+}
+
+// a chunk, with where its entries' inputs start and the operator block
+// positions of the elements they touch - gathered once per chunk, so the
+// walk over its products needs no element table lookups or allocation per
+// product
+struct chunk_index
+{
+  element_chunk const &chunk;
+  // where each entry's first column's input starts in the batch input,
+  // counted in elements
+  std::vector<int> x_starts;
+  // and in x, for reading it zero-copy
+  std::vector<int> x_elems;
+  // first row of the operator blocks for each entry's row element, and
+  // first column for each of the chunk's inputs - num_dims apiece
+  std::vector<int> row_blocks;
+  std::vector<int> col_blocks;
+};
+
+static chunk_index index_chunk(element_table const &elem_table,
+                               element_chunk const &chunk, int const num_dims,
+                               int const degree)
+{
+  // the chunk's inputs are gathered range by range (see copy_chunk_inputs)
+  std::vector<limits> const x_ranges = input_ranges(chunk);
+  std::vector<int> range_starts(1, 0);
+  std::vector<int> input_elems;
+  for (limits const &range : x_ranges)
+  {
+    range_starts.push_back(range_starts.back() + range.stop - range.start + 1);
+    for (int j = range.start; j <= range.stop; ++j)
+    {
+      input_elems.push_back(j);
+    }
+  }
+
+  chunk_index index{chunk, {}, {}, {}, {}};
+  std::vector<int> rows(chunk.size());
+  for (int e = 0; e < chunk.size(); ++e)
+  {
+    limits const connected = chunk.columns(e);
+    rows[e]                = chunk.row(e);
+    // an entry's columns are contiguous, so lie within one range
+    int const r = static_cast<int>(
+        std::upper_bound(x_ranges.begin(), x_ranges.end(), connected.start,
+                         [](int const col, limits const &range) {
+                           return col < range.start;
+                         }) -
+        x_ranges.begin() - 1);
+    assert(connected.stop <= x_ranges[r].stop);
+    index.x_starts.push_back(range_starts[r] + connected.start -
+                             x_ranges[r].start);
+    index.x_elems.push_back(connected.start);
+  }
+
+  // FIXME here we would have to use each dimension's degree when
+  // calculating the block positions if we want different degree in each dim
+  auto const block_positions = [&](std::vector<int> const &elems,
+                                   std::vector<int> &positions) {
+    positions.resize(elems.size() * num_dims);
+    parallel_for(static_cast<int>(elems.size()), [&](int const i) {
+      fk::vector<int> const coords = elem_table.get_coords(elems[i]);
+      assert(coords.size() == num_dims * 2);
+      for (int d = 0; d < num_dims; ++d)
+      {
+        positions[i * num_dims + d] =
+            get_1d_index(coords(d), coords(d + num_dims)) * degree;
+      }
+    });
+  };
+  block_positions(rows, index.row_blocks);
+  block_positions(input_elems, index.col_blocks);
+  return index;
+}
+
+// static helper - true if term k's product for the pair with these operator
+// block positions has a zero block
+template<typename P>
+static bool has_zero_block(block_structure<P> const &blocks, int const k,
+                           int const num_dims, int const *const op_row,
+                           int const *const op_col)
+{
+  for (int d = 0; d < num_dims; ++d)
+  {
+    if (blocks.kind(k, d, op_row[d], op_col[d]) == kronmult::block_kind::zero)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+// static helper - the index of each chunk entry's first output, followed by
+// the total number of outputs (see for_each_kron). the entries are counted
+// in parallel, then summed
+template<typename P>
+static std::vector<int>
+count_outputs(PDE<P> const &pde, rank_workspace<P> const &workspace,
+              chunk_index const &index, block_structure<P> const *const blocks)
+{
+  int const num_entries = index.chunk.size();
+  int const num_dims    = pde.num_dims;
+  bool const sums_terms = workspace.products_per_element() == 1;
+
+  std::vector<int> offsets(num_entries + 1, 0);
+  parallel_for(num_entries, [&](int const e) {
+    int const num_cols =
+        index.chunk.pair_offset(e + 1) - index.chunk.pair_offset(e);
+    if (!blocks)
+    {
+      offsets[e + 1] = num_cols * (sums_terms ? 1 : pde.num_terms);
+      return;
+    }
+    int const *const op_row = index.row_blocks.data() + e * num_dims;
+    int count               = 0;
+    for (int c = 0; c < num_cols; ++c)
+    {
+      int const *const op_col =
+          index.col_blocks.data() + (index.x_starts[e] + c) * num_dims;
+      int live = 0;
+      for (int k = 0; k < pde.num_terms; ++k)
+      {
+        live += !has_zero_block(*blocks, k, num_dims, op_row, op_col);
+      }
+      count += sums_terms ? std::min(live, 1) : live;
+    }
+    offsets[e + 1] = count;
+  });
+  std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+  return offsets;
+}
+
+// static helper - walk the kronecker products that make up a chunk's share
+// of A*x: one per (element, connected element, term). for each product,
+// visit is handed
+//
+//   visit(operators, kinds, x_index, term, output)
+//
+// the operator blocks (ordered as in kronmult_to_batch_sets) and their
+// kinds, num_dims apiece, the offset of its input in the workspace's input
+// (the batch input, or x when zero-copy), the product's term, and the index
+// of its output in the reduction space.
+//
+// if blocks is given, products with a zero operator block are dropped. where
+// the workspace sums the terms' products into one output per element pair,
+// a pair is only dropped if all of its products are. the remaining outputs
+// are packed in order, starting from offsets (see count_outputs).
+//
+// the chunk's entries are visited in parallel, each with its own scratch -
+// so visit must only write what belongs to its output
+template<typename P, typename F>
+static void
+for_each_kron(PDE<P> const &pde, rank_workspace<P> const &workspace,
+              chunk_index const &index, std::vector<int> const &offsets,
+              block_structure<P> const *const blocks, F &&visit)
+{
+  // assume uniform degree for now
+  int const degree      = pde.get_dimensions()[0].get_degree();
+  int const elem_size   = static_cast<int>(std::pow(degree, pde.num_dims));
+  int const num_dims    = pde.num_dims;
+  int const num_terms   = pde.num_terms;
+  int const num_entries = index.chunk.size();
+  assert(static_cast<int>(offsets.size()) == num_entries + 1);
+  assert(workspace.is_zero_copy() ||
+         workspace.batch_input.size() >=
+             static_cast<int64_t>(index.col_blocks.size() / num_dims) *
+                 elem_size);
+  std::vector<int> const &x_inputs =
+      workspace.is_zero_copy() ? index.x_elems : index.x_starts;
+
+  int const num_products = workspace.products_per_element();
+  bool const sums_terms  = num_products == 1;
+
+  // this can be smaller w/ atomic batched gemm e.g. ed's modified magma
+  assert(workspace.get_reduction() == reduction_engine::in_place ||
+         workspace.reduction_space.size() >=
+             static_cast<int64_t>(elem_size) * offsets.back());
+
+  // each term's coefficients, to find the operator blocks in
+  std::vector<P const *> coefficients(num_terms * num_dims);
+  std::vector<int> strides(num_terms * num_dims);
+  for (int k = 0; k < num_terms; ++k)
+  {
+    for (int d = 0; d < num_dims; ++d)
+    {
+      coefficients[k * num_dims + d] = pde.get_coefficients(k, d).data();
+      strides[k * num_dims + d]      = pde.get_coefficients(k, d).stride();
+    }
+  }
+
+  parallel_for(num_entries, [&](int const e) {
+    // one product's operators and kinds, and which terms have a zero block
+    std::vector<P const *> operators(num_dims);
+    std::vector<kronmult::block_kind> kinds(num_terms * num_dims,
+                                            kronmult::block_kind::dense);
+    std::vector<char> is_zero(num_terms, false);
+
+    int const *const op_row = index.row_blocks.data() + e * num_dims;
+    int output              = offsets[e];
+    int const num_cols =
+        index.chunk.pair_offset(e + 1) - index.chunk.pair_offset(e);
+    for (int c = 0; c < num_cols; ++c)
+    {
+      int const x_position    = index.x_starts[e] + c;
+      int const *const op_col = index.col_blocks.data() + x_position * num_dims;
+
+      bool all_zero = true;
+      for (int k = 0; k < num_terms && blocks; ++k)
+      {
+        is_zero[k] = false;
+        for (int d = 0; d < num_dims; ++d)
+        {
+          kronmult::block_kind const kind =
+              blocks->kind(k, d, op_row[d], op_col[d]);
+          kinds[k * num_dims + num_dims - d - 1] = kind;
+          is_zero[k] = is_zero[k] || kind == kronmult::block_kind::zero;
+        }
+        all_zero = all_zero && is_zero[k];
+      }
+      if (blocks && sums_terms && all_zero)
+      {
+        continue;
+      }
+
+      for (int k = 0; k < num_terms; ++k)
+      {
+        if (!sums_terms && is_zero[k])
+        {
+          continue;
+        }
+        for (int d = 0; d < num_dims; ++d)
+        {
+          int const block = k * num_dims + d;
+          operators[num_dims - d - 1] =
+              coefficients[block] +
+              static_cast<int64_t>(op_col[d]) * strides[block] + op_row[d];
+        }
+        visit(operators.data(), kinds.data() + k * num_dims,
+              (x_inputs[e] + c) * elem_size, k, output);
+        if (!sums_terms)
+        {
+          ++output;
+        }
+      }
+      if (sums_terms)
+      {
+        ++output;
+      }
+    }
+    assert(output == offsets[e + 1]);
+  });
+}
+
+// a distinct product computed at one stage of the batched kronmult: the
+// operator block applied, the input it is applied to - an offset into the
+// batch input for the first stage, otherwise the index of the previous
+// stage's product it consumes - and the term the operator belongs to
+template<typename P>
+struct partial_product
+{
+  P const *op;
+  int input;
+  int term;
+};
+
+// static helper - find the distinct products at each stage before the last,
+// numbered in the order the kronecker products first reach them, and each
+// kronecker product's last stage. op(i, stage) is product i's operator block
+// at a stage, and term(i) its term.
+//
+// each stage's (input, operator block) keys are sorted in one flat table,
+// with the product index breaking ties, so a run of equal keys starts with
+// the product that reaches it first. the run starts are numbered by a prefix
+// sum in product order, which gives the numbering of a serial walk, and the
+// keys, run starts and next inputs are filled in parallel
+template<typename P, typename Op, typename Term>
+static std::vector<std::vector<partial_product<P>>>
+find_partials(int const last, std::vector<int> const &first_inputs, Op &&op,
+              Term &&term, std::vector<partial_product<P>> &finals)
+{
+  struct key
+  {
+    int input;
+    P const *op;
+    int kron;
+  };
+  auto const same_product = [](key const &a, key const &b) {
+    return a.input == b.input && a.op == b.op;
+  };
+  auto const before = [](key const &a, key const &b) {
+    if (a.input != b.input)
+    {
+      return a.input < b.input;
+    }
+    if (a.op != b.op)
+    {
+      return std::less<P const *>()(a.op, b.op);
+    }
+    return a.kron < b.kron;
+  };
+
+  int const num_krons = static_cast<int>(first_inputs.size());
+  std::vector<int> inputs(first_inputs);
+  std::vector<int> next_inputs(num_krons);
+  std::vector<key> keys(num_krons);
+  std::vector<int> numbers(num_krons + 1);
+  std::vector<std::vector<partial_product<P>>> partials(last);
+  for (int stage = 0; stage < last; ++stage)
+  {
+    parallel_for(num_krons, [&](int const i) {
+      keys[i] = {inputs[i], op(i, stage), i};
+    });
+    std::sort(keys.begin(), keys.end(), before);
+
+    // numbers[i + 1] is 1 if product i starts a run, so that after the sum
+    // numbers[i] is the number of distinct products reached before i
+    numbers[0] = 0;
+    parallel_for(num_krons, [&](int const k) {
+      numbers[keys[k].kron + 1] =
+          k == 0 || !same_product(keys[k - 1], keys[k]) ? 1 : 0;
+    });
+    std::partial_sum(numbers.begin(), numbers.end(), numbers.begin());
+
+    partials[stage].resize(numbers.back());
+    parallel_for(num_krons, [&](int const k) {
+      key const &first =
+          *std::lower_bound(keys.begin(), keys.begin() + k, keys[k],
+                            [&](key const &a, key const &b) {
+                              return before(a, b) && !same_product(a, b);
+                            });
+      int const number = numbers[first.kron];
+      if (&first == &keys[k])
+      {
+        partials[stage][number] = {first.op, first.input, term(first.kron)};
+      }
+      next_inputs[keys[k].kron] = number;
+    });
+    std::swap(inputs, next_inputs);
+  }
+
+  finals.resize(num_krons);
+  parallel_for(num_krons, [&](int const i) {
+    finals[i] = {op(i, last), inputs[i], term(i)};
+  });
+  return partials;
+}
+
+// static helper - true if any offset into an allocation of this size can be
+// recorded by a compact batch
+static bool fits_offset(int64_t const size)
+{
+  return size < static_cast<int64_t>(unassigned_offset);
+}
+
+// static helper - make a compact batch if given a layout, otherwise a batch
+// of pointers
+template<typename P>
+static batch<P> make_batch(int const num_gemms, int const nrows,
+                           int const ncols, int const stride,
+                           bool const do_trans,
+                           std::optional<batch_layout<P>> const &layout)
+{
+  return layout ? batch<P>(num_gemms, nrows, ncols, stride, do_trans, *layout)
+                : batch<P>(num_gemms, nrows, ncols, stride, do_trans);
+}
+
 // function to allocate and build batch lists.
 // given a problem instance (pde/elem table) and
 // memory allocations (x, y, work), enqueue the
 // batch gemms/reduction gemv to perform A*x
+//
+// a stage's product depends only on its operator block and input, and many
+// kronecker products share a prefix of stages: the first stage output
+// A_k(r, c) * x_j is the same for every row element with the same 1d index r
+// in that dimension, and so on for later stages. entries are grouped by
+// (input, operator block) and each distinct product is computed once; only
+// the last stage, which writes each product's own output, has an entry per
+// kronecker product. the batches are compact (see batch_layout) - the
+// intermediate products are laid out in the order they are discovered.
+//
+// if blocks is given, products with a zero operator block are dropped (see
+// for_each_kron). identity and diagonal blocks are still applied as gemms.
 template<typename P>
 std::vector<batch_operands_set<P>>
 build_batches(PDE<P> const &pde, element_table const &elem_table,
-              rank_workspace<P> const &workspace, element_chunk const &chunk)
+              rank_workspace<P> const &workspace, element_chunk const &chunk,
+              block_structure<P> const *const blocks)
 {
   // assume uniform degree for now
   int const degree    = pde.get_dimensions()[0].get_degree();
-  int const elem_size = static_cast<int>(std::pow(degree, pde.num_dims));
-  int const x_size    = chunk.size();
-  assert(workspace.batch_input.size() >= x_size);
+  int const elem_size = element_segment_size(pde);
+  int const last      = pde.num_dims - 1;
 
-  int const elements_in_chunk = num_elements_in_chunk(chunk);
+  // intermediate workspaces for kron product. stage s writes its distinct
+  // products to region s % 2, each region the size of the reduction space
+  assert(workspace.get_engine() == kronmult_engine::batched);
+  assert(workspace.batch_intermediate.size() ==
+         workspace.reduction_space.size() * std::min(pde.num_dims - 1, 2));
+  int const region_size = workspace.reduction_space.size();
+  auto const region     = [&](int const stage) {
+    return workspace.batch_intermediate.data() +
+           static_cast<int64_t>(stage % 2) * region_size;
+  };
+
+  // gather every kronecker product's input, operator chain and term in
+  // parallel, then find the distinct products at each stage before the last
+  // in kron order
+  chunk_index const index =
+      index_chunk(elem_table, chunk, pde.num_dims, degree);
+  std::vector<int> const offsets = count_outputs(pde, workspace, index, blocks);
+  int const num_krons = offsets.back();
+  std::vector<int> inputs(num_krons);
+  std::vector<int> terms(num_krons);
+  std::vector<P const *> chains(static_cast<int64_t>(num_krons) * pde.num_dims);
+  for_each_kron(pde, workspace, index, offsets, blocks,
+                [&](P const *const *operators, kronmult::block_kind const *,
+                    int const x_index, int const term, int const output) {
+                  inputs[output] = x_index;
+                  terms[output]  = term;
+                  std::copy_n(operators, pde.num_dims,
+                              chains.begin() +
+                                  static_cast<int64_t>(output) * pde.num_dims);
+                });
+
+  std::vector<partial_product<P>> finals;
+  std::vector<std::vector<partial_product<P>>> const partials =
+      find_partials<P>(
+          last, inputs,
+          [&](int const i, int const stage) {
+            return chains[static_cast<int64_t>(i) * pde.num_dims + stage];
+          },
+          [&](int const i) { return terms[i]; }, finals);
 
-  // this can be smaller w/ atomic batched gemm e.g. ed's modified magma
-  assert(workspace.reduction_space.size() >=
-         (elem_size * elements_in_chunk * pde.num_terms));
+  std::vector<batch_operands_set<P>> batches;
+  for (int stage = 0; stage <= last; ++stage)
+  {
+    std::vector<partial_product<P>> const &entries =
+        stage == last ? finals : partials[stage];
+    int const num_entries = static_cast<int>(entries.size());
+
+    // the operator for stage s is from dimension num_dims - s - 1; see
+    // for_each_kron
+    int const dim            = pde.num_dims - stage - 1;
+    int const gemms_per_kron = compute_batch_size(degree, pde.num_dims, stage);
+    int const num_gemms      = gemms_per_kron * num_entries;
+    matrix_size_set const sizes =
+        compute_dimensions(degree, pde.num_dims, stage);
+    int const gemm_offset = sizes.rows_a * sizes.cols_a;
+    int const stride      = pde.get_coefficients(0, dim).stride();
+
+    // operator blocks: an offset per entry into its term's coefficients.
+    // the layout cycles through the terms' bases, which only matches the
+    // entries if no product was dropped
+    bool const term_major = std::all_of(
+        entries.begin(), entries.end(), [&](partial_product<P> const &entry) {
+          return entry.term == (&entry - entries.data()) % pde.num_terms;
+        });
+    std::optional<batch_layout<P>> op_layout;
+    if (term_major)
+    {
+      op_layout = batch_layout<P>{{}, gemms_per_kron, true, 0, 0};
+    }
+    for (int k = 0; k < pde.num_terms && op_layout; ++k)
+    {
+      fk::matrix<P> const &coefficients = pde.get_coefficients(k, dim);
+      op_layout->bases.push_back(coefficients.data());
+      if (!fits_offset(static_cast<int64_t>(coefficients.stride()) *
+                       coefficients.ncols()))
+      {
+        op_layout.reset();
+        break;
+      }
+    }
+
+    // inputs: an offset per entry into the batch input or the previous
+    // stage's products
+    std::optional<batch_layout<P>> in_layout;
+    if (stage == 0 && fits_offset(workspace.get_input().size()))
+    {
+      in_layout = batch_layout<P>{
+          {workspace.get_input().data()}, gemms_per_kron, true, 0, 0};
+    }
+    else if (stage > 0 && fits_offset(region_size))
+    {
+      in_layout = batch_layout<P>{
+          {region(stage - 1)}, gemms_per_kron, true, 0, gemm_offset};
+    }
+
+    // outputs: the reduction space in kron order for the last stage,
+    // otherwise this stage's products in the order they were found
+    P *const out_base =
+        stage == last ? workspace.reduction_space.data() : region(stage);
+    batch_layout<P> const out_layout{
+        {out_base}, gemms_per_kron, false, elem_size, gemm_offset};
+
+    std::vector<batch<P>> operands;
+    if (stage == 0)
+    {
+      operands.push_back(make_batch<P>(num_gemms, sizes.rows_a, sizes.cols_a,
+                                      stride, false, op_layout));
+      operands.push_back(make_batch<P>(num_gemms, sizes.rows_b, sizes.cols_b,
+                                      sizes.rows_b, false, in_layout));
+      operands.push_back(make_batch<P>(num_gemms, sizes.rows_a, sizes.cols_b,
+                                      sizes.rows_a, false, out_layout));
+    }
+    else
+    {
+      operands.push_back(make_batch<P>(num_gemms, sizes.rows_a, sizes.cols_a,
+                                      sizes.rows_a, false, in_layout));
+      operands.push_back(make_batch<P>(num_gemms, sizes.rows_b, sizes.cols_b,
+                                      stride, true, op_layout));
+      operands.push_back(make_batch<P>(num_gemms, sizes.rows_a, sizes.rows_b,
+                                      sizes.rows_a, false, out_layout));
+    }
+    int const op_operand = stage == 0 ? 0 : 1;
+    int const in_operand = stage == 0 ? 1 : 0;
+
+    // each entry fills its own positions, so the entries are filled in
+    // parallel
+    parallel_for(num_entries, [&](int const e) {
+      // recover the operator block's position in its coefficient matrix
+      fk::matrix<P> const &coefficients =
+          pde.get_coefficients(entries[e].term, dim);
+      int64_t const op_offset = entries[e].op - coefficients.data();
+      int const op_row        = static_cast<int>(op_offset % stride);
+      int const op_col        = static_cast<int>(op_offset / stride);
+      fk::matrix<P, mem_type::view> const op_view(
+          coefficients, op_row, op_row + degree - 1, op_col,
+          op_col + degree - 1);
+
+      for (int g = 0; g < gemms_per_kron; ++g)
+      {
+        int const position = e * gemms_per_kron + g;
+        operands[op_operand].assign_entry(op_view, position);
+
+        int const in_index = stage == 0
+                                 ? entries[e].input
+                                 : entries[e].input * elem_size +
+                                       g * gemm_offset;
+        fk::matrix<P, mem_type::view> const in_view =
+            stage == 0 ? fk::matrix<P, mem_type::view>(
+                             workspace.get_input(), sizes.rows_b,
+                             sizes.cols_b, in_index)
+                       : fk::matrix<P, mem_type::view>(
+                             workspace.batch_intermediate, sizes.rows_a,
+                             sizes.cols_a,
+                             (stage - 1) % 2 * region_size + in_index);
+        operands[in_operand].assign_entry(in_view, position);
+
+        int const out_index = e * elem_size + g * gemm_offset;
+        int const out_rows  = sizes.rows_a;
+        int const out_cols  = stage == 0 ? sizes.cols_b : sizes.rows_b;
+        fk::matrix<P, mem_type::view> const out_view =
+            stage == last ? fk::matrix<P, mem_type::view>(
+                                workspace.reduction_space, out_rows, out_cols,
+                                out_index)
+                          : fk::matrix<P, mem_type::view>(
+                                workspace.batch_intermediate, out_rows,
+                                out_cols, stage % 2 * region_size + out_index);
+        operands[2].assign_entry(out_view, position);
+      }
+    });
+    batches.push_back(std::move(operands));
+  }
+
+  return batches;
+}
+
+// --- stacked kronmult code --- //
+
+template<typename P>
+stacked_operators<P> stack_operators(PDE<P> const &pde)
+{
+  int const degree    = pde.get_dimensions()[0].get_degree();
+  int const num_terms = pde.num_terms;
+  int const last_dim  = pde.num_dims - 1;
+
+  stacked_operators<P> stacked;
+  stacked.generation  = pde.get_coefficients_generation();
+  int const first_dof = pde.get_coefficients(0, 0).nrows();
+  int const last_dof  = pde.get_coefficients(0, last_dim).nrows();
+  stacked.first.clear_and_resize(first_dof * num_terms, first_dof);
+  stacked.last.clear_and_resize(last_dof, last_dof * num_terms);
+
+  for (int t = 0; t < num_terms; ++t)
+  {
+    fk::matrix<P> const &first = pde.get_coefficients(t, 0);
+    for (int col = 0; col < first.ncols(); ++col)
+    {
+      for (int row = 0; row < first.nrows(); ++row)
+      {
+        int const block = row / degree;
+        int const i     = row % degree;
+        stacked.first((block * degree + i) * num_terms + t, col) =
+            first(row, col);
+      }
+    }
+
+    fk::matrix<P> const &last = pde.get_coefficients(t, last_dim);
+    for (int col = 0; col < last.ncols(); ++col)
+    {
+      int const block = col / degree;
+      int const j     = col % degree;
+      for (int row = 0; row < last.nrows(); ++row)
+      {
+        stacked.last(row, (block * num_terms + t) * degree + j) =
+            last(row, col);
+      }
+    }
+  }
+  return stacked;
+}
+
+// stacked counterpart to build_batches. every term is applied in one pass
+// over the element pairs. with T terms, and each element's tensor stored
+// with the last dimension's index fastest:
+//
+//   stage 0 applies dimension 0 - the slowest index - for all terms with one
+//   gemm per distinct (x block, operator block), X * first^T, where X is the
+//   x block viewed as (degree^(num_dims-1) x degree) and first is the
+//   (T*degree x degree) stacked block. the term lands beside the dimension 0
+//   index, so each (term, dimension 0 index) slice is contiguous.
+//
+//   stages 1 through num_dims - 2 apply their dimension per term, on those
+//   slices. stage num_dims - 2 writes with leading dimension T*degree,
+//   moving the term beside the fastest index.
+//
+//   the last stage applies dimension num_dims - 1 and sums over the terms at
+//   once: last * X, where last is the (degree x T*degree) stacked block and
+//   X the previous products viewed as (T*degree x degree^(num_dims-1)).
+//
+// so the first and last rounds are T times fewer (and T times larger) gemms,
+// and the reduction space needs one output per element pair instead of T.
+// intermediate products are shared across element pairs, and element pairs
+// dropped if given blocks, as in build_batches.
+template<typename P>
+std::vector<batch_operands_set<P>>
+build_stacked_batches(PDE<P> const &pde, element_table const &elem_table,
+                      rank_workspace<P> const &workspace,
+                      stacked_operators<P> const &stacked,
+                      element_chunk const &chunk,
+                      block_structure<P> const *const blocks)
+{
+  // assume uniform degree for now
+  int const degree    = pde.get_dimensions()[0].get_degree();
+  int const elem_size = element_segment_size(pde);
+  int const num_terms = pde.num_terms;
+  int const last      = pde.num_dims - 1;
+  assert(workspace.get_engine() == kronmult_engine::stacked);
+  assert(stacked.generation == pde.get_coefficients_generation());
+  assert(last > 0);
+
+  // every term's intermediate product for one distinct product
+  int const product_size = elem_size * num_terms;
+  // an element's tensor with one dimension fixed
+  int const slice_size = elem_size / degree;
 
-  // intermediate workspaces for kron product.
   int const num_workspaces = std::min(pde.num_dims - 1, 2);
-  assert(workspace.batch_intermediate.size() ==
-         workspace.reduction_space.size() * num_workspaces);
-
-  int const max_connected       = max_connected_in_chunk(chunk);
-  int const max_items_to_reduce = pde.num_terms * max_connected;
-  assert(workspace.get_unit_vector().size() >= max_items_to_reduce);
-
-  std::vector<batch_operands_set<P>> batches =
-      allocate_batches<P>(pde, elements_in_chunk);
-
-  // loop over elements
-  // FIXME eventually want to do this in parallel
-  for (const auto &[i, connected] : chunk)
-  {
-    // first, get linearized indices for this element
-    //
-    // calculate from the level/cell indices for each
-    // dimension
-    fk::vector<int> const coords = elem_table.get_coords(i);
-    assert(coords.size() == pde.num_dims * 2);
-    fk::vector<int> elem_indices = linearize(coords);
-
-    // calculate the row portion of the
-    // operator position used for this
-    // element's gemm calls
-    fk::vector<int> operator_row = [&] {
-      fk::vector<int> op_row(pde.num_dims);
-      for (int d = 0; d < pde.num_dims; ++d)
+  assert(workspace.batch_intermediate.size() % num_workspaces == 0);
+  int const region_size = workspace.batch_intermediate.size() / num_workspaces;
+  auto const region_offset = [region_size](int const stage) {
+    return static_cast<int64_t>(stage % 2) * region_size;
+  };
+  auto const region = [&](int const stage) {
+    return workspace.batch_intermediate.data() + region_offset(stage);
+  };
+
+  // gather each element pair's input and term 0 operator chain in parallel,
+  // then find the distinct products at each stage before the last in pair
+  // order. term 0's operator blocks stand in for the blocks at the same
+  // position in every term
+  chunk_index const index =
+      index_chunk(elem_table, chunk, pde.num_dims, degree);
+  std::vector<int> const offsets = count_outputs(pde, workspace, index, blocks);
+  int const num_pairs = offsets.back();
+  std::vector<int> inputs(num_pairs);
+  std::vector<P const *> chains(static_cast<int64_t>(num_pairs) * pde.num_dims);
+  for_each_kron(pde, workspace, index, offsets, blocks,
+                [&](P const *const *operators, kronmult::block_kind const *,
+                    int const x_index, int const term, int const output) {
+                  if (term != 0)
+                  {
+                    return;
+                  }
+                  inputs[output] = x_index;
+                  std::copy_n(operators, pde.num_dims,
+                              chains.begin() +
+                                  static_cast<int64_t>(output) * pde.num_dims);
+                });
+
+  // stage s applies dimension s; see for_each_kron
+  std::vector<partial_product<P>> finals;
+  std::vector<std::vector<partial_product<P>>> const partials =
+      find_partials<P>(
+          last, inputs,
+          [&](int const i, int const stage) {
+            return chains[static_cast<int64_t>(i) * pde.num_dims + last -
+                          stage];
+          },
+          [](int const) { return 0; }, finals);
+
+  // recover an operator block's position in term 0's coefficient matrix
+  auto const block_position = [&pde](P const *const op, int const dim) {
+    fk::matrix<P> const &coefficients = pde.get_coefficients(0, dim);
+    int64_t const offset              = op - coefficients.data();
+    return std::pair<int, int>(offset % coefficients.stride(),
+                               offset / coefficients.stride());
+  };
+
+  std::vector<batch_operands_set<P>> batches;
+
+  // first stage, all terms at once
+  {
+    std::vector<partial_product<P>> const &entries = partials[0];
+    int const num_gemms = static_cast<int>(entries.size());
+    int const stride    = stacked.first.stride();
+
+    std::optional<batch_layout<P>> in_layout;
+    if (fits_offset(workspace.get_input().size()))
+    {
+      in_layout =
+          batch_layout<P>{{workspace.get_input().data()}, 1, true, 0, 0};
+    }
+    std::optional<batch_layout<P>> op_layout;
+    if (fits_offset(stacked.first.size()))
+    {
+      op_layout = batch_layout<P>{{stacked.first.data()}, 1, true, 0, 0};
+    }
+    batch_layout<P> const out_layout{{region(0)}, 1, false, product_size, 0};
+
+    std::vector<batch<P>> operands;
+    operands.push_back(make_batch<P>(num_gemms, slice_size, degree, slice_size,
+                                     false, in_layout));
+    operands.push_back(make_batch<P>(num_gemms, degree * num_terms, degree,
+                                     stride, true, op_layout));
+    operands.push_back(make_batch<P>(num_gemms, slice_size, degree * num_terms,
+                                     slice_size, false, out_layout));
+
+    parallel_for(num_gemms, [&](int const e) {
+      auto const [row, col] = block_position(entries[e].op, 0);
+      operands[0].assign_entry(
+          fk::matrix<P, mem_type::view>(workspace.get_input(), slice_size,
+                                        degree, entries[e].input),
+          e);
+      operands[1].assign_entry(
+          fk::matrix<P, mem_type::view>(
+              stacked.first, row * num_terms,
+              (row + degree) * num_terms - 1, col, col + degree - 1),
+          e);
+      operands[2].assign_entry(
+          fk::matrix<P, mem_type::view>(workspace.batch_intermediate,
+                                        slice_size, degree * num_terms,
+                                        region_offset(0) + e * product_size),
+          e);
+    });
+    batches.push_back(std::move(operands));
+  }
+
+  // middle stages, per term. within a distinct product, the entries are
+  // ordered by dimension 0 index, term, then the gemm's position in the slice
+  for (int stage = 1; stage < last; ++stage)
+  {
+    std::vector<partial_product<P>> const &entries = partials[stage];
+    int const num_entries = static_cast<int>(entries.size());
+    int const dim         = stage;
+    int const rows        = static_cast<int>(std::pow(degree, last - stage));
+    int const run         = static_cast<int>(std::pow(degree, stage - 1));
+    int const num_gemms   = num_entries * degree * num_terms * run;
+    int const gemm_offset = rows * degree;
+    int const stride      = pde.get_coefficients(0, dim).stride();
+    // the last middle stage moves the term beside the fastest index
+    bool const regroup = stage == last - 1;
+    int const out_stride = regroup ? degree * num_terms : rows;
+    int const out_offset = regroup ? num_terms * degree * degree : gemm_offset;
+
+    std::optional<batch_layout<P>> op_layout =
+        batch_layout<P>{{}, run, true, 0, 0};
+    for (int k = 0; k < num_terms; ++k)
+    {
+      fk::matrix<P> const &coefficients = pde.get_coefficients(k, dim);
+      op_layout->bases.push_back(coefficients.data());
+      if (!fits_offset(static_cast<int64_t>(coefficients.stride()) *
+                       coefficients.ncols()))
       {
-        // FIXME here we would have to use each dimension's
-        // degree when calculating the index if we want different
-        // degree in each dim
-        op_row(d) = elem_indices(d) * degree;
+        op_layout.reset();
+        break;
       }
-      return op_row;
-    }();
-
-    // loop over connected elements. for now, we assume
-    // full connectivity
-    for (int j = connected.start; j <= connected.stop; ++j)
-    {
-      // get linearized indices for this connected element
-      fk::vector<int> coords = elem_table.get_coords(j);
-      assert(coords.size() == pde.num_dims * 2);
-      fk::vector<int> connected_indices = linearize(coords);
-
-      // calculate the col portion of the
-      // operator position used for this
-      // element's gemm calls
-      fk::vector<int> operator_col = [&] {
-        fk::vector<int> op_col(pde.num_dims);
-        for (int d = 0; d < pde.num_dims; ++d)
-        {
-          // FIXME here we would have to use each dimension's
-          // degree when calculating the index if we want different
-          // degree in each dim
-          op_col(d) = connected_indices(d) * degree;
-        }
-        return op_col;
-      }();
+    }
+    std::optional<batch_layout<P>> in_layout;
+    std::optional<batch_layout<P>> out_layout;
+    if (fits_offset(region_size))
+    {
+      in_layout =
+          batch_layout<P>{{region(stage - 1)}, run, true, 0, gemm_offset};
+      out_layout = batch_layout<P>{{region(stage)}, run, true, 0, out_offset};
+    }
+    if (!regroup)
+    {
+      out_layout =
+          batch_layout<P>{{region(stage)}, run, false, slice_size, out_offset};
+    }
 
-      for (int k = 0; k < pde.num_terms; ++k)
+    std::vector<batch<P>> operands;
+    operands.push_back(
+        make_batch<P>(num_gemms, rows, degree, rows, false, in_layout));
+    operands.push_back(
+        make_batch<P>(num_gemms, degree, degree, stride, true, op_layout));
+    operands.push_back(
+        make_batch<P>(num_gemms, rows, degree, out_stride, false, out_layout));
+
+    parallel_for(num_entries, [&](int const e) {
+      auto const [row, col] = block_position(entries[e].op, dim);
+      int64_t const in_start =
+          region_offset(stage - 1) +
+          static_cast<int64_t>(entries[e].input) * product_size;
+      int64_t const out_start =
+          region_offset(stage) + static_cast<int64_t>(e) * product_size;
+      for (int i = 0; i < degree; ++i)
       {
-        // term major y-space layout, followed by connected items, finally work
-        // items.
-        int const prev_row_elems = [i = i, &chunk] {
-          if (i == chunk.begin()->first)
-          {
-            return 0;
-          }
-          int prev_elems = 0;
-          for (int r = chunk.begin()->first; r < i; ++r)
+        for (int t = 0; t < num_terms; ++t)
+        {
+          fk::matrix<P, mem_type::view> const op_view(
+              pde.get_coefficients(t, dim), row, row + degree - 1, col,
+              col + degree - 1);
+          int64_t const slice = t + num_terms * i;
+          for (int r = 0; r < run; ++r)
           {
-            prev_elems += chunk.at(r).stop - chunk.at(r).start + 1;
+            int const position = ((e * degree + i) * num_terms + t) * run + r;
+            operands[1].assign_entry(op_view, position);
+            operands[0].assign_entry(
+                fk::matrix<P, mem_type::view>(
+                    workspace.batch_intermediate, rows, degree,
+                    in_start + slice * slice_size + r * gemm_offset),
+                position);
+            if (regroup)
+            {
+              operands[2].assign_raw(
+                  workspace.batch_intermediate.data() + out_start +
+                      t * degree + (r + run * i) * out_offset,
+                  position);
+            }
+            else
+            {
+              operands[2].assign_entry(
+                  fk::matrix<P, mem_type::view>(
+                      workspace.batch_intermediate, rows, degree,
+                      out_start + slice * slice_size + r * gemm_offset),
+                  position);
+            }
           }
-          return prev_elems;
-        }();
-        int const total_prev_elems = prev_row_elems + j - connected.start;
-        int const kron_index       = k + total_prev_elems * pde.num_terms;
-
-        // y space, where kron outputs are written
-        int const y_index = elem_size * kron_index;
-
-        fk::vector<P, mem_type::view> const y_view(
-            workspace.reduction_space, y_index, y_index + elem_size - 1);
-
-        // work space, intermediate kron data
-        int const work_index =
-            elem_size * kron_index * std::min(pde.num_dims - 1, 2);
-        std::vector<fk::vector<P, mem_type::view>> work_views(
-            num_workspaces, fk::vector<P, mem_type::view>(
-                                workspace.batch_intermediate, work_index,
-                                work_index + elem_size - 1));
-        if (num_workspaces == 2)
-        {
-          work_views[1] = fk::vector<P, mem_type::view>(
-              workspace.batch_intermediate, work_index + elem_size,
-              work_index + elem_size * 2 - 1);
         }
+      }
+    });
+    batches.push_back(std::move(operands));
+  }
+
+  // last stage, summing over the terms
+  {
+    int const num_gemms = static_cast<int>(finals.size());
+    int const stride    = stacked.last.stride();
+
+    std::optional<batch_layout<P>> op_layout;
+    if (fits_offset(stacked.last.size()))
+    {
+      op_layout = batch_layout<P>{{stacked.last.data()}, 1, true, 0, 0};
+    }
+    std::optional<batch_layout<P>> in_layout;
+    if (fits_offset(region_size))
+    {
+      in_layout = batch_layout<P>{{region(last - 1)}, 1, true, 0, 0};
+    }
+    batch_layout<P> const out_layout{
+        {workspace.reduction_space.data()}, 1, false, elem_size, 0};
+
+    std::vector<batch<P>> operands;
+    operands.push_back(make_batch<P>(num_gemms, degree, degree * num_terms,
+                                     stride, false, op_layout));
+    operands.push_back(make_batch<P>(num_gemms, degree * num_terms, slice_size,
+                                     degree * num_terms, false, in_layout));
+    operands.push_back(make_batch<P>(num_gemms, degree, slice_size, degree,
+                                     false, out_layout));
+
+    parallel_for(num_gemms, [&](int const e) {
+      auto const [row, col] = block_position(finals[e].op, last);
+      operands[0].assign_entry(
+          fk::matrix<P, mem_type::view>(stacked.last, row, row + degree - 1,
+                                        col * num_terms,
+                                        (col + degree) * num_terms - 1),
+          e);
+      operands[1].assign_entry(
+          fk::matrix<P, mem_type::view>(
+              workspace.batch_intermediate, degree * num_terms, slice_size,
+              region_offset(last - 1) +
+                  static_cast<int64_t>(finals[e].input) * product_size),
+          e);
+      operands[2].assign_entry(
+          fk::matrix<P, mem_type::view>(workspace.reduction_space, degree,
+                                        slice_size, e * elem_size),
+          e);
+    });
+    batches.push_back(std::move(operands));
+  }
+
+  return batches;
+}
+
+// --- fused kronmult code --- //
+
+template<typename P>
+kron_batch<P>::kron_batch(int const num_entries, int const num_dims,
+                          int const degree, int const lda)
+    : num_entries_(num_entries), num_dims_(num_dims), degree_(degree),
+      lda_(lda),
+      operators_(static_cast<int64_t>(num_entries) * num_dims, nullptr),
+      kinds_(static_cast<int64_t>(num_entries) * num_dims,
+             kronmult::block_kind::dense),
+      inputs_(num_entries, nullptr), outputs_(num_entries, nullptr),
+      accumulates_(num_entries, false)
+{
+  assert(num_entries >= 0);
+  assert(num_dims > 0);
+  assert(degree > 0);
+  assert(lda >= degree);
+}
+
+template<typename P>
+void kron_batch<P>::assign_entry(P const *const *A,
+                                 kronmult::block_kind const *kinds,
+                                 P const *x, P *y, int const position,
+                                 bool const accumulate)
+{
+  assert(A);
+  assert(kinds);
+  assert(x);
+  assert(y);
+  assert(position >= 0);
+  assert(position < num_entries());
+  assert(!inputs_[position]);
+
+  int64_t const offset = static_cast<int64_t>(position) * num_dims();
+  std::copy_n(A, num_dims(), operators_.begin() + offset);
+  std::copy_n(kinds, num_dims(), kinds_.begin() + offset);
+  inputs_[position]      = x;
+  outputs_[position]     = y;
+  accumulates_[position] = accumulate;
+}
+
+// verify that every entry has been assigned to
+template<typename P>
+bool kron_batch<P>::is_filled() const
+{
+  return std::none_of(inputs_.begin(), inputs_.end(),
+                      [](P const *const ptr) { return !ptr; }) &&
+         std::none_of(outputs_.begin(), outputs_.end(),
+                      [](P const *const ptr) { return !ptr; }) &&
+         std::none_of(operators_.begin(), operators_.end(),
+                      [](P const *const ptr) { return !ptr; });
+}
+
+template<typename P>
+void batched_kronmult(kron_batch<P> const &krons, fk::vector<P> &work,
+                      workspace_binding<P> const &binding)
+{
+  kronmult::kernel<P> const kernel =
+      kronmult::get_fused_kernel<P>(krons.num_dims(), krons.degree());
+  assert(kernel);
+
+  int const elem_size = std::pow(krons.degree(), krons.num_dims());
+  assert(work.size() >= std::min(krons.num_dims() - 1, 2) * elem_size);
+  ignore(elem_size);
+
+  // consecutive products with the same output are summed into it, as are
+  // those marked to accumulate
+  kronmult::kernel<P> const accumulate = kronmult::get_fused_kernel<P>(
+      krons.num_dims(), krons.degree(), true);
 
-        // operator views, windows into operator matrix
-        std::vector<fk::matrix<P, mem_type::view>> operator_views;
-        for (int d = pde.num_dims - 1; d >= 0; --d)
+  int const lda = krons.get_lda();
+  for (int i = 0; i < krons.num_entries(); ++i)
+  {
+    P *const output = krons.get_output(i);
+    bool const adds = krons.accumulates(i) ||
+                      (i > 0 && output == krons.get_output(i - 1));
+    (adds ? accumulate : kernel)(krons.get_operators(i), krons.get_kinds(i),
+                                 lda, binding(krons.get_input(i)),
+                                 binding(output), work.data());
+  }
+}
+
+template<typename P>
+kron_batch<P>
+build_kron_batch(PDE<P> const &pde, element_table const &elem_table,
+                 rank_workspace<P> const &workspace, element_chunk const &chunk,
+                 block_structure<P> const *const blocks)
+{
+  int const degree = pde.get_dimensions()[0].get_degree();
+  assert(workspace.get_engine() == kronmult_engine::fused);
+  assert(kronmult::has_fused_kernel(pde.num_dims, degree));
+
+  chunk_index const index =
+      index_chunk(elem_table, chunk, pde.num_dims, degree);
+  std::vector<int> const offsets = count_outputs(pde, workspace, index, blocks);
+  kron_batch<P> krons(offsets.back(), pde.num_dims, degree,
+                      pde.get_coefficients(0, 0).stride());
+
+  // reducing in place, each product is added straight into its output row
+  // (see rank_workspace::output_row); the products of a row are
+  // consecutive. rows summed zero-copy into fx always accumulate, since the
+  // other products were added before
+  bool const in_place = workspace.get_reduction() == reduction_engine::in_place;
+  int const elem_size = element_segment_size(pde);
+  P const *const x    = workspace.get_input().data();
+  for_each_kron(
+      pde, workspace, index, offsets, blocks,
+      [&](P const *const *operators, kronmult::block_kind const *kinds,
+          int const x_index, int const term, int const output) {
+        ignore(term);
+        if (!in_place)
         {
-          operator_views.push_back(fk::matrix<P, mem_type::view>(
-              pde.get_coefficients(k, d), operator_row(d),
-              operator_row(d) + degree - 1, operator_col(d),
-              operator_col(d) + degree - 1));
+          krons.assign_entry(
+              operators, kinds, x + x_index,
+              workspace.reduction_space.data() +
+                  static_cast<int64_t>(output) * elem_size,
+              output);
+          return;
         }
+        int const entry = static_cast<int>(
+            std::upper_bound(offsets.begin(), offsets.end(), output) -
+            offsets.begin() - 1);
+        int const row = chunk.row(entry);
+        krons.assign_entry(operators, kinds, x + x_index,
+                           workspace.output_row(chunk, row).data(), output,
+                           !workspace.is_staged(chunk, row));
+      });
+
+  return krons;
+}
+
+template<typename P>
+std::vector<int>
+chunk_output_offsets(PDE<P> const &pde, element_table const &elem_table,
+                     rank_workspace<P> const &workspace,
+                     element_chunk const &chunk,
+                     block_structure<P> const *const blocks)
+{
+  int const degree = pde.get_dimensions()[0].get_degree();
+  return count_outputs(pde, workspace,
+                       index_chunk(elem_table, chunk, pde.num_dims, degree),
+                       blocks);
+}
+
+// static helper - record the storage a set of batches points into
+template<typename P>
+static std::vector<std::pair<P const *, int>>
+storage_fingerprint(PDE<P> const &pde, rank_workspace<P> const &workspace)
+{
+  std::vector<std::pair<P const *, int>> storage;
+  for (int k = 0; k < pde.num_terms; ++k)
+  {
+    for (int d = 0; d < pde.num_dims; ++d)
+    {
+      fk::matrix<P> const &coeffs = pde.get_coefficients(k, d);
+      storage.emplace_back(coeffs.data(), coeffs.size());
+    }
+  }
+  storage.emplace_back(workspace.get_input().data(),
+                       workspace.get_input().size());
+  storage.emplace_back(workspace.reduction_space.data(),
+                       workspace.reduction_space.size());
+  storage.emplace_back(workspace.batch_intermediate.data(),
+                       workspace.batch_intermediate.size());
+  storage.emplace_back(workspace.batch_output.data(),
+                       workspace.batch_output.size());
+  if (workspace.is_zero_copy())
+  {
+    storage.emplace_back(workspace.get_host()->fx.data(),
+                         workspace.get_host()->fx.size());
+  }
+  return storage;
+}
+
+template<typename P>
+batch_plan<P>::batch_plan(PDE<P> const &pde, element_table const &elem_table,
+                          rank_workspace<P> const &workspace,
+                          std::vector<element_chunk> const &chunks,
+                          P const drop_tol)
+    : drop_tol_(drop_tol)
+{
+  rebuild(pde, elem_table, workspace, chunks);
+}
+
+template<typename P>
+void batch_plan<P>::rebuild(PDE<P> const &pde, element_table const &elem_table,
+                            rank_workspace<P> const &workspace,
+                            std::vector<element_chunk> const &chunks)
+{
+  engine_      = workspace.get_engine();
+  num_chunks_  = static_cast<int>(chunks.size());
+  num_dropped_ = 0;
+  chunk_batches_.clear();
+  chunk_krons_.clear();
+  chunk_offsets_.clear();
+  blocks_.reset();
+  blocks_.emplace(pde, drop_tol_);
+  stacked_.reset();
+  if (engine_ == kronmult_engine::stacked)
+  {
+    stacked_.emplace(stack_operators(pde));
+  }
+  block_structure<P> const *const blocks = &*blocks_;
+  for (element_chunk const &chunk : chunks)
+  {
+    chunk_offsets_.push_back(
+        chunk_output_offsets(pde, elem_table, workspace, chunk, blocks));
+    num_dropped_ += static_cast<int64_t>(num_elements_in_chunk(chunk)) *
+                        workspace.products_per_element() -
+                    chunk_offsets_.back().back();
+
+    if (engine_ == kronmult_engine::fused)
+    {
+      chunk_krons_.push_back(
+          build_kron_batch(pde, elem_table, workspace, chunk, blocks));
+    }
+    else if (engine_ == kronmult_engine::stacked)
+    {
+      chunk_batches_.push_back(build_stacked_batches(
+          pde, elem_table, workspace, *stacked_, chunk, blocks));
+    }
+    else
+    {
+      chunk_batches_.push_back(
+          build_batches(pde, elem_table, workspace, chunk, blocks));
+    }
+  }
+  storage_                 = storage_fingerprint(pde, workspace);
+  coefficients_generation_ = pde.get_coefficients_generation();
+}
+
+template<typename P>
+bool batch_plan<P>::is_stale(PDE<P> const &pde,
+                             rank_workspace<P> const &workspace) const
+{
+  return coefficients_generation_ != pde.get_coefficients_generation() ||
+         storage_ != storage_fingerprint(pde, workspace);
+}
+
+template<typename P>
+std::vector<batch_operands_set<P>> const &
+batch_plan<P>::get_batches(int const chunk_index) const
+{
+  assert(!is_fused());
+  assert(chunk_index >= 0);
+  assert(chunk_index < num_chunks());
+  return chunk_batches_[chunk_index];
+}
 
-        int const x_index = (total_prev_elems % elem_table.size()) * elem_size;
+template<typename P>
+kron_batch<P> const &batch_plan<P>::get_kron_batch(int const chunk_index) const
+{
+  assert(is_fused());
+  assert(chunk_index >= 0);
+  assert(chunk_index < num_chunks());
+  return chunk_krons_[chunk_index];
+}
 
-        // x vector input to kronmult
-        fk::vector<P, mem_type::view> const x_view(
-            workspace.batch_input, x_index, x_index + elem_size - 1);
+template<typename P>
+std::vector<int> const &
+batch_plan<P>::get_output_offsets(int const chunk_index) const
+{
+  assert(chunk_index >= 0);
+  assert(chunk_index < num_chunks());
+  return chunk_offsets_[chunk_index];
+}
 
-        kronmult_to_batch_sets(operator_views, x_view, y_view, work_views,
-                               batches, kron_index, pde);
+template<typename P>
+double batch_plan<P>::size_MB() const
+{
+  int64_t bytes = 0;
+  for (auto const &batches : chunk_batches_)
+  {
+    for (batch_operands_set<P> const &operands : batches)
+    {
+      for (batch<P> const &operand : operands)
+      {
+        bytes += operand.metadata_bytes();
       }
     }
   }
-  return batches;
+  for (kron_batch<P> const &krons : chunk_krons_)
+  {
+    bytes += static_cast<int64_t>(krons.num_entries()) *
+             (krons.num_dims() + 2) * sizeof(P *);
+  }
+  if (stacked_)
+  {
+    bytes += (static_cast<int64_t>(stacked_->first.size()) +
+              stacked_->last.size()) *
+             sizeof(P);
+  }
+  double const megabytes = static_cast<double>(bytes) * 1e-6;
+  return megabytes;
 }
 
 template class batch<float>;
 template class batch<double>;
 
+template class workspace_binding<float>;
+template class workspace_binding<double>;
+
+template class block_structure<float>;
+template class block_structure<double>;
+
+template class kron_batch<float>;
+template class kron_batch<double>;
+
+template class batch_plan<float>;
+template class batch_plan<double>;
+
 template void batched_gemm(batch<float> const &a, batch<float> const &b,
                            batch<float> const &c, float const alpha,
-                           float const beta);
+                           float const beta,
+                           workspace_binding<float> const &binding,
+                           std::vector<float *> *const lists);
 
 template void batched_gemm(batch<double> const &a, batch<double> const &b,
                            batch<double> const &c, double const alpha,
-                           double const beta);
+                           double const beta,
+                           workspace_binding<double> const &binding,
+                           std::vector<double *> *const lists);
 
 template void batched_gemv(batch<float> const &a, batch<float> const &b,
                            batch<float> const &c, float const alpha,
@@ -721,8 +2221,56 @@ template void kronmult_to_batch_sets(
 template std::vector<batch_operands_set<float>>
 build_batches(PDE<float> const &pde, element_table const &elem_table,
               rank_workspace<float> const &workspace,
-              element_chunk const &chunk);
+              element_chunk const &chunk,
+              block_structure<float> const *const blocks);
+
+template std::vector<int>
+chunk_output_offsets(PDE<float> const &pde, element_table const &elem_table,
+                     rank_workspace<float> const &workspace,
+                     element_chunk const &chunk,
+                     block_structure<float> const *const blocks);
 template std::vector<batch_operands_set<double>>
 build_batches(PDE<double> const &pde, element_table const &elem_table,
               rank_workspace<double> const &workspace,
-              element_chunk const &chunk);
+              element_chunk const &chunk,
+              block_structure<double> const *const blocks);
+
+template std::vector<int>
+chunk_output_offsets(PDE<double> const &pde, element_table const &elem_table,
+                     rank_workspace<double> const &workspace,
+                     element_chunk const &chunk,
+                     block_structure<double> const *const blocks);
+
+template stacked_operators<float> stack_operators(PDE<float> const &pde);
+template stacked_operators<double> stack_operators(PDE<double> const &pde);
+
+template std::vector<batch_operands_set<float>>
+build_stacked_batches(PDE<float> const &pde, element_table const &elem_table,
+                      rank_workspace<float> const &workspace,
+                      stacked_operators<float> const &stacked,
+                      element_chunk const &chunk,
+                      block_structure<float> const *const blocks);
+template std::vector<batch_operands_set<double>>
+build_stacked_batches(PDE<double> const &pde, element_table const &elem_table,
+                      rank_workspace<double> const &workspace,
+                      stacked_operators<double> const &stacked,
+                      element_chunk const &chunk,
+                      block_structure<double> const *const blocks);
+
+template void batched_kronmult(kron_batch<float> const &krons,
+                               fk::vector<float> &work,
+                               workspace_binding<float> const &binding);
+template void batched_kronmult(kron_batch<double> const &krons,
+                               fk::vector<double> &work,
+                               workspace_binding<double> const &binding);
+
+template kron_batch<float>
+build_kron_batch(PDE<float> const &pde, element_table const &elem_table,
+                 rank_workspace<float> const &workspace,
+                 element_chunk const &chunk,
+                 block_structure<float> const *const blocks);
+template kron_batch<double>
+build_kron_batch(PDE<double> const &pde, element_table const &elem_table,
+                 rank_workspace<double> const &workspace,
+                 element_chunk const &chunk,
+                 block_structure<double> const *const blocks);
@@ -2,19 +2,49 @@
 
 #include "chunk.hpp"
 #include "element_table.hpp"
+#include "kronmult.hpp"
 #include "pde/pde_base.hpp"
 #include "tensors.hpp"
 #include <array>
+#include <cstdint>
+#include <functional>
+#include <optional>
+
+// compact alternative to storing a pointer per batch entry, for operands
+// that live in a few allocations with a regular layout. entry i is found at
+//
+//   bases[(i / run) % bases.size()] + offset(i / run) + (i % run) * inner
+//
+// if indexed, offset(r) is a 32 bit offset recorded when run r's entries are
+// assigned; otherwise it is r * outer and nothing is stored per entry.
+template<typename P>
+struct batch_layout
+{
+  std::vector<P *> bases; // e.g., one per pde term for operator blocks
+  int run;                // consecutive entries sharing a base and offset
+  bool indexed;
+  int64_t outer; // stride between runs, if not indexed
+  int64_t inner; // stride between entries within a run
+};
+
+template<typename P>
+class workspace_binding;
 
 // wrapper around an array of pointers to matrices or
 // vectors for a call to batch gemm/gemv; i.e., the class
 // represents the information for a batch operand
+//
+// a batch constructed with a batch_layout is compact: rather than a pointer
+// per entry, it holds at most a 32 bit offset per run of entries. compact
+// batches can't be cleared or iterated over, and have no pointer list.
 template<typename P>
 class batch
 {
 public:
   batch(int const num_entries, int const nrows, int const ncols,
         int const stride, bool const do_trans);
+  batch(int const num_entries, int const nrows, int const ncols,
+        int const stride, bool const do_trans, batch_layout<P> const &layout);
   batch(batch<P> const &other);
   batch &operator=(batch<P> const &other);
   batch(batch<P> &&other);
@@ -25,10 +55,20 @@ public:
   P *operator()(int const) const;
 
   void assign_entry(fk::matrix<P, mem_type::view> const a, int const position);
+  void assign_raw(P *const a, int const position);
   bool clear_entry(int const position);
 
   P *const *get_list() const;
 
+  // write where entries [start, start + count) are, moved by binding, to
+  // list. a compact batch's bases are moved once, rather than every entry
+  void expand(int const start, int const count,
+              workspace_binding<P> const &binding, P **list) const;
+
+  // whether every entry i is found at first + i * step; if so, sets first
+  // and step. only compact batches with a single, unindexed base can be
+  bool is_strided(P *&first, int64_t &step) const;
+
   bool is_filled() const;
   batch &clear_all();
 
@@ -37,6 +77,10 @@ public:
   int ncols() const { return ncols_; }
   int get_stride() const { return stride_; }
   bool get_trans() const { return do_trans_; }
+  bool is_compact() const { return !batch_; }
+
+  // bytes of pointers/offsets the batch holds to locate its entries
+  int64_t metadata_bytes() const;
 
   // using P* const * because P*const *const because the
   // last const on non-class return would be ignored
@@ -52,7 +96,10 @@ private:
                      // stride of vectors
   bool const do_trans_; // transpose passed into BLAS call for matrices
 
-  P **batch_; // array of pointers to pass into blas call
+  P **batch_; // array of pointers to pass into blas call; null if compact
+
+  batch_layout<P> layout_;        // compact only
+  std::vector<uint32_t> offsets_; // per run, if compact and indexed
 
   // want these for convenience in the class
   // don't want to expose them publicly...
@@ -61,10 +108,55 @@ private:
   iterator end() { return batch_ + num_entries(); }
 };
 
-// execute a batched gemm given a, b, c batch lists
+// moves pointers into one rank workspace's buffers to the same positions in
+// another's of the same sizes, so that batches built for the first can be
+// replayed against the second - e.g., by each worker of a chunk_executor.
+// pointers elsewhere, such as into the coefficients, are left alone. default
+// constructed, the binding moves nothing
+template<typename P>
+class workspace_binding
+{
+public:
+  workspace_binding() = default;
+  workspace_binding(rank_workspace<P> const &from, rank_workspace<P> &to);
+
+  bool is_identity() const { return buffers_.empty(); }
+
+  // T is P or P const
+  template<typename T>
+  T *operator()(T *const ptr) const
+  {
+    std::less<P const *> const before;
+    for (buffer const &b : buffers_)
+    {
+      if (!before(ptr, b.from) && before(ptr, b.from + b.size))
+      {
+        return b.to + (ptr - b.from);
+      }
+    }
+    return ptr;
+  }
+
+private:
+  struct buffer
+  {
+    P const *from;
+    int64_t size;
+    P *to;
+  };
+  std::vector<buffer> buffers_;
+};
+
+// execute a batched gemm given a, b, c batch lists, with their entries moved
+// by binding. if every operand is strided, the strides are passed to blas
+// as they are; otherwise compact or moved batches are expanded to pointer
+// lists a block at a time, in lists if given (e.g., a rank workspace's
+// gemm_lists), so that replaying batches doesn't allocate
 template<typename P>
 void batched_gemm(batch<P> const &a, batch<P> const &b, batch<P> const &c,
-                  P const alpha, P const beta);
+                  P const alpha, P const beta,
+                  workspace_binding<P> const &binding = workspace_binding<P>(),
+                  std::vector<P *> *const lists       = nullptr);
 
 // execute a batched gemv given a, b, c batch lists
 template<typename P>
@@ -122,21 +214,318 @@ void kronmult_to_batch_sets(
     std::vector<batch_operands_set<P>> &batches, int const batch_offset,
     PDE<P> const &pde);
 
+// the kind (see kronmult::block_kind) of every degree by degree block of
+// each term's coefficient matrix in each dimension, classified once after the
+// coefficients are generated. the batch builders use it to drop products with
+// a zero block, and the fused kernels to skip identity and diagonal blocks.
+//
+// blocks with no entry larger than drop_tol in magnitude are classified as
+// zero, so the products over them are dropped; the result then matches the
+// full product to within the tolerance.
+template<typename P>
+class block_structure
+{
+public:
+  explicit block_structure(PDE<P> const &pde, P const drop_tol = 0);
+
+  // kind of the block whose first row and column are (row, col) in the
+  // term's coefficients for dimension dim
+  kronmult::block_kind
+  kind(int const term, int const dim, int const row, int const col) const
+  {
+    assert(row % degree_ == 0);
+    assert(col % degree_ == 0);
+    int const num_blocks = num_blocks_[dim];
+    return kinds_[term * num_dims_ + dim]
+                 [(col / degree_) * num_blocks + row / degree_];
+  }
+
+  // number of blocks of this kind, over every term and dimension
+  int64_t count(kronmult::block_kind const kind) const;
+
+  // whether any term's product over the element pair (row, col) has no zero
+  // block; if not, the pair contributes nothing and can be left out of the
+  // chunks entirely
+  bool is_connected(element_table const &elem_table, int const row,
+                    int const col) const;
+
+  // the given connectivity lists, less the pairs that aren't connected
+  list_set prune(element_table const &elem_table,
+                 list_set const &connectivity) const;
+
+  // the predicted cost of each listed pair's products, in multiply-adds per
+  // element entry: a stage per dimension for each term with no zero block,
+  // plus summing the product. the fused engine's stages cost degree for a
+  // dense block and one for a diagonal or identity block; the gemm engines
+  // treat every block as dense
+  cost_model pair_costs(element_table const &elem_table,
+                        list_set const &connectivity,
+                        kronmult_engine const engine) const;
+
+  P drop_tolerance() const { return drop_tol_; }
+
+private:
+  P drop_tol_;
+  int num_dims_;
+  int degree_;
+  std::vector<int> num_blocks_; // blocks per row/column, for each dimension
+  // for each term and dimension, column major
+  std::vector<std::vector<kronmult::block_kind>> kinds_;
+};
+
+// if given blocks, the builders drop products with a zero operator block;
+// the remaining outputs are packed by row (see reduce_chunk)
 template<typename P>
 std::vector<batch_operands_set<P>>
 build_batches(PDE<P> const &pde, element_table const &elem_table,
-              rank_workspace<P> const &workspace, element_chunk const &chunk);
+              rank_workspace<P> const &workspace, element_chunk const &chunk,
+              block_structure<P> const *const blocks = nullptr);
+
+// where each chunk entry's outputs start in the reduction space, counted in
+// products, followed by the total number of outputs - for reduce_chunk
+template<typename P>
+std::vector<int>
+chunk_output_offsets(PDE<P> const &pde, element_table const &elem_table,
+                     rank_workspace<P> const &workspace,
+                     element_chunk const &chunk,
+                     block_structure<P> const *const blocks = nullptr);
+
+// every term's coefficients for the first and last dimensions, rearranged
+// so that a block at the same position in each term forms one operand. with
+// T terms:
+//
+//   first(T * (r + i) + t, c) = dimension 0's A_t(r + i, c)
+//   last(r, T * c + degree * t + j) = dimension num_dims - 1's A_t(r, c + j)
+//
+// for block offsets r, c and 0 <= i, j < degree. generation is the pde's
+// coefficient generation they were stacked from; a copy is stale once the
+// pde's coefficients are set again.
+template<typename P>
+struct stacked_operators
+{
+  fk::matrix<P> first;
+  fk::matrix<P> last;
+  int64_t generation;
+};
+
+template<typename P>
+stacked_operators<P> stack_operators(PDE<P> const &pde);
+
+// build_batches for a workspace using the stacked engine, which applies all
+// terms in one pass; the operators must have been stacked from the pde's
+// current coefficients
+template<typename P>
+std::vector<batch_operands_set<P>>
+build_stacked_batches(PDE<P> const &pde, element_table const &elem_table,
+                      rank_workspace<P> const &workspace,
+                      stacked_operators<P> const &stacked,
+                      element_chunk const &chunk,
+                      block_structure<P> const *const blocks = nullptr);
+
+// operand lists for fused kronmult. each entry is one whole kronecker
+// product * vector - num_dims operator blocks, an input and an output - that
+// a fused kernel (see kronmult.hpp) computes in a single call, in place of
+// the num_dims rounds of small gemms enqueued by kronmult_to_batch_sets.
+template<typename P>
+class kron_batch
+{
+public:
+  kron_batch(int const num_entries, int const num_dims, int const degree,
+             int const lda);
+
+  // A holds num_dims blocks of degree x degree, leading dimension lda,
+  // ordered as in kronmult_to_batch_sets, and kinds gives the structure of
+  // each; cannot overwrite a previous assignment. distinct positions may be
+  // assigned concurrently. an accumulating product is added to y rather
+  // than overwriting it
+  void assign_entry(P const *const *A, kronmult::block_kind const *kinds,
+                    P const *x, P *y, int const position,
+                    bool const accumulate = false);
+
+  P const *const *get_operators(int const position) const
+  {
+    return &operators_[static_cast<int64_t>(position) * num_dims_];
+  }
+  kronmult::block_kind const *get_kinds(int const position) const
+  {
+    return &kinds_[static_cast<int64_t>(position) * num_dims_];
+  }
+  P const *get_input(int const position) const { return inputs_[position]; }
+  P *get_output(int const position) const { return outputs_[position]; }
+  bool accumulates(int const position) const
+  {
+    return accumulates_[position];
+  }
+
+  bool is_filled() const;
+
+  int num_entries() const { return num_entries_; }
+  int num_dims() const { return num_dims_; }
+  int degree() const { return degree_; }
+  int get_lda() const { return lda_; }
+
+private:
+  int num_entries_;
+  int num_dims_;
+  int degree_;
+  int lda_; // leading dimension shared by all operator blocks
+
+  std::vector<P const *> operators_;        // num_dims per entry
+  std::vector<kronmult::block_kind> kinds_; // num_dims per entry
+  std::vector<P const *> inputs_;
+  std::vector<P *> outputs_;
+  std::vector<char> accumulates_;
+};
+
+// execute every product in a kron_batch with the fused kernel for its
+// shape, with the inputs and outputs moved by binding. work must hold
+// min(num_dims - 1, 2) * degree^num_dims elements
+template<typename P>
+void batched_kronmult(
+    kron_batch<P> const &krons, fk::vector<P> &work,
+    workspace_binding<P> const &binding = workspace_binding<P>());
+
+// fused kronmult counterpart to build_batches; the workspace must have
+// been allocated for fused kronmult
+template<typename P>
+kron_batch<P>
+build_kron_batch(PDE<P> const &pde, element_table const &elem_table,
+                 rank_workspace<P> const &workspace, element_chunk const &chunk,
+                 block_structure<P> const *const blocks = nullptr);
+
+// the batches for a chunk depend only on the element table, the chunk
+// itself, and the storage locations of the rank workspace and coefficient
+// matrices - none of which change from one time step to the next. this class
+// builds every chunk's batches once so they can be replayed each time the
+// system matrix is applied, instead of calling build_batches per chunk per
+// stage.
+//
+// the plan remembers the storage it was built against, and the pde's
+// coefficient generation. it must be rebuilt if the coefficients are
+// regenerated, in place or into new storage, or the workspace is reallocated;
+// is_stale() detects all of these. the plan classifies the coefficient blocks
+// when it is built, with the given drop tolerance, and drops products with a
+// zero block; for the stacked engine, it also holds its own copy of the
+// stacked operators.
+template<typename P>
+class batch_plan
+{
+public:
+  batch_plan(PDE<P> const &pde, element_table const &elem_table,
+             rank_workspace<P> const &workspace,
+             std::vector<element_chunk> const &chunks, P const drop_tol = 0);
+
+  // rebuild all chunks' batches against the current pde/workspace storage
+  void rebuild(PDE<P> const &pde, element_table const &elem_table,
+               rank_workspace<P> const &workspace,
+               std::vector<element_chunk> const &chunks);
+
+  // true if any coefficient matrix or workspace vector the batches point
+  // into has moved since the plan was built
+  bool is_stale(PDE<P> const &pde, rank_workspace<P> const &workspace) const;
+
+  // batched gemm operands for a chunk - one operand set per dimension; only
+  // if !is_fused()
+  std::vector<batch_operands_set<P>> const &
+  get_batches(int const chunk_index) const;
+  // fused kronmult operands for a chunk; only if is_fused()
+  kron_batch<P> const &get_kron_batch(int const chunk_index) const;
+  // where each chunk entry's outputs start; pass to reduce_chunk
+  std::vector<int> const &get_output_offsets(int const chunk_index) const;
+
+  block_structure<P> const &get_block_structure() const { return *blocks_; }
+  // products dropped for having a zero operator block, over all chunks
+  int64_t num_dropped() const { return num_dropped_; }
+
+  // the engine of the workspace the plan was built for
+  kronmult_engine get_engine() const { return engine_; }
+  bool is_fused() const { return engine_ == kronmult_engine::fused; }
+  int num_chunks() const { return num_chunks_; }
+
+  // memory held by the plan's pointer lists and stacked operators. this is
+  // in addition to the rank workspace, and should be weighed against the
+  // workspace budget
+  double size_MB() const;
+
+private:
+  // fingerprint (data pointer, size) of the storage the plan was built
+  // against
+  std::vector<std::pair<P const *, int>> storage_;
+  // pde coefficient generation the plan was built from
+  int64_t coefficients_generation_;
+  kronmult_engine engine_;
+  P drop_tol_;
+  int num_chunks_;
+  int64_t num_dropped_;
+  std::optional<block_structure<P>> blocks_;
+  std::optional<stacked_operators<P>> stacked_;
+  std::vector<std::vector<int>> chunk_offsets_;
+  std::vector<std::vector<batch_operands_set<P>>> chunk_batches_;
+  std::vector<kron_batch<P>> chunk_krons_;
+};
 
 extern template class batch<float>;
 extern template class batch<double>;
 
+extern template class workspace_binding<float>;
+extern template class workspace_binding<double>;
+
+extern template class block_structure<float>;
+extern template class block_structure<double>;
+
+extern template class kron_batch<float>;
+extern template class kron_batch<double>;
+
+extern template class batch_plan<float>;
+extern template class batch_plan<double>;
+
+extern template stacked_operators<float>
+stack_operators(PDE<float> const &pde);
+extern template stacked_operators<double>
+stack_operators(PDE<double> const &pde);
+
+extern template std::vector<batch_operands_set<float>>
+build_stacked_batches(PDE<float> const &pde, element_table const &elem_table,
+                      rank_workspace<float> const &workspace,
+                      stacked_operators<float> const &stacked,
+                      element_chunk const &chunk,
+                      block_structure<float> const *const blocks);
+extern template std::vector<batch_operands_set<double>>
+build_stacked_batches(PDE<double> const &pde, element_table const &elem_table,
+                      rank_workspace<double> const &workspace,
+                      stacked_operators<double> const &stacked,
+                      element_chunk const &chunk,
+                      block_structure<double> const *const blocks);
+
+extern template void
+batched_kronmult(kron_batch<float> const &krons, fk::vector<float> &work,
+                 workspace_binding<float> const &binding);
+extern template void
+batched_kronmult(kron_batch<double> const &krons, fk::vector<double> &work,
+                 workspace_binding<double> const &binding);
+
+extern template kron_batch<float>
+build_kron_batch(PDE<float> const &pde, element_table const &elem_table,
+                 rank_workspace<float> const &workspace,
+                 element_chunk const &chunk,
+                 block_structure<float> const *const blocks);
+extern template kron_batch<double>
+build_kron_batch(PDE<double> const &pde, element_table const &elem_table,
+                 rank_workspace<double> const &workspace,
+                 element_chunk const &chunk,
+                 block_structure<double> const *const blocks);
+
 extern template void batched_gemm(batch<float> const &a, batch<float> const &b,
                                   batch<float> const &c, float const alpha,
-                                  float const beta);
+                                  float const beta,
+                                  workspace_binding<float> const &binding,
+                                  std::vector<float *> *const lists);
 
 extern template void
 batched_gemm(batch<double> const &a, batch<double> const &b,
-             batch<double> const &c, double const alpha, double const beta);
+             batch<double> const &c, double const alpha, double const beta,
+             workspace_binding<double> const &binding,
+             std::vector<double *> *const lists);
 
 extern template void batched_gemv(batch<float> const &a, batch<float> const &b,
                                   batch<float> const &c, float const alpha,
@@ -167,8 +556,21 @@ extern template void kronmult_to_batch_sets(
 extern template std::vector<batch_operands_set<float>>
 build_batches(PDE<float> const &pde, element_table const &elem_table,
               rank_workspace<float> const &workspace,
-              element_chunk const &chunk);
+              element_chunk const &chunk,
+              block_structure<float> const *const blocks);
 extern template std::vector<batch_operands_set<double>>
 build_batches(PDE<double> const &pde, element_table const &elem_table,
               rank_workspace<double> const &workspace,
-              element_chunk const &chunk);
+              element_chunk const &chunk,
+              block_structure<double> const *const blocks);
+
+extern template std::vector<int>
+chunk_output_offsets(PDE<float> const &pde, element_table const &elem_table,
+                     rank_workspace<float> const &workspace,
+                     element_chunk const &chunk,
+                     block_structure<float> const *const blocks);
+extern template std::vector<int>
+chunk_output_offsets(PDE<double> const &pde, element_table const &elem_table,
+                     rank_workspace<double> const &workspace,
+                     element_chunk const &chunk,
+                     block_structure<double> const *const blocks);
@@ -2,6 +2,7 @@
 #include "chunk.hpp"
 #include "coefficients.hpp"
 #include "fast_math.hpp"
+#include "lib_dispatch.hpp"
 #include "tensors.hpp"
 #include "tests_general.hpp"
 #include <numeric>
@@ -181,6 +182,67 @@ TEMPLATE_TEST_CASE("batch", "[batch]", float, double)
     }
   }
 
+  SECTION("batch: compact layouts")
+  {
+    // first_v, second_v, third_v cycle through the three matrices' bases at
+    // the same offset
+    batch_layout<TestType> const indexed_layout{
+        {first.data(), second.data(), third.data()}, 1, true, 0, 0};
+    batch<TestType> indexed(num_batch, nrows, ncols, stride, do_trans,
+                            indexed_layout);
+    REQUIRE(indexed.is_compact());
+    REQUIRE(!indexed.is_filled());
+    REQUIRE(indexed(0) == nullptr);
+    indexed.assign_entry(first_v, 0);
+    indexed.assign_entry(second_v, 1);
+    REQUIRE(!indexed.is_filled());
+    indexed.assign_entry(third_v, 2);
+    REQUIRE(indexed.is_filled());
+    REQUIRE(indexed == gold);
+    REQUIRE(indexed.metadata_bytes() ==
+            static_cast<int64_t>(num_batch * sizeof(uint32_t) +
+                                 3 * sizeof(TestType *)));
+
+    // strided: windows stepping down the rows of a single matrix
+    int const step = 1;
+    batch_layout<TestType> const strided_layout{
+        {first.data()}, 1, false, step, 0};
+    batch<TestType> strided(num_batch, 2, ncols, stride, do_trans,
+                            strided_layout);
+    REQUIRE(strided.is_filled());
+    batch<TestType> strided_gold(num_batch, 2, ncols, stride, do_trans);
+    for (int i = 0; i < num_batch; ++i)
+    {
+      fk::matrix<TestType, mem_type::view> const window(
+          first, i * step, i * step + 1, 0, ncols - 1);
+      strided.assign_entry(window, i);
+      strided_gold.assign_entry(window, i);
+    }
+    REQUIRE(strided == strided_gold);
+
+    // runs of entries sharing an offset, stepping by inner within the run
+    batch_layout<TestType> const run_layout{{first.data()}, 3, true, 0, 1};
+    batch<TestType> run(num_batch, 2, ncols, stride, do_trans, run_layout);
+    for (int i = 0; i < num_batch; ++i)
+    {
+      fk::matrix<TestType, mem_type::view> const window(first, i + 1, i + 2, 1,
+                                                        ncols);
+      run.assign_entry(window, i);
+      REQUIRE(run(i) == window.data());
+    }
+    REQUIRE(run.metadata_bytes() ==
+            static_cast<int64_t>(sizeof(uint32_t) + sizeof(TestType *)));
+
+    // copies keep the layout
+    batch<TestType> const run_copy(run);
+    REQUIRE(run_copy.is_compact());
+    REQUIRE(run_copy == run);
+    batch<TestType> assigned(num_batch, 2, ncols, stride, do_trans);
+    assigned = run;
+    REQUIRE(assigned.is_compact());
+    REQUIRE(assigned == run);
+  }
+
   SECTION("batch: utility functions")
   {
     SECTION("is_filled")
@@ -832,6 +894,77 @@ TEMPLATE_TEST_CASE("batched gemm", "[batch]", float, double)
     // compare
     REQUIRE(c == gold);
   }
+
+  SECTION("batched gemm: compact operands, strided and expanded")
+  {
+    // every a side by side, and every b; entry i is the i-th a times the
+    // transpose of the i-th b
+    fk::matrix<TestType> a(a1.nrows(), a1.ncols() * num_batch);
+    a.set_submatrix(0, 0, a1);
+    a.set_submatrix(0, a1.ncols(), a2);
+    a.set_submatrix(0, 2 * a1.ncols(), a3);
+    fk::matrix<TestType> b(b1.nrows(), b1.ncols() * num_batch);
+    b.set_submatrix(0, 0, b1);
+    b.set_submatrix(0, b1.ncols(), b2);
+    b.set_submatrix(0, 2 * b1.ncols(), b3);
+    int const a_size = a1.nrows() * a1.ncols();
+    int const b_size = b1.nrows() * b1.ncols();
+    int const c_size = a1.nrows() * b1.nrows();
+
+    fk::matrix<TestType> gold(a1.nrows(), b1.nrows() * num_batch);
+    gold.set_submatrix(0, 0, a1 * fk::matrix<TestType>(b1).transpose());
+    gold.set_submatrix(0, b1.nrows(),
+                       a2 * fk::matrix<TestType>(b2).transpose());
+    gold.set_submatrix(0, 2 * b1.nrows(),
+                       a3 * fk::matrix<TestType>(b3).transpose());
+
+    TestType const alpha = 1.0;
+    TestType const beta  = 0.0;
+    fk::matrix<TestType> c(gold.nrows(), gold.ncols());
+    batch<TestType> const a_strided(num_batch, a1.nrows(), a1.ncols(),
+                                    a1.nrows(), false,
+                                    {{a.data()}, 1, false, a_size, 0});
+    batch<TestType> const b_strided(num_batch, b1.nrows(), b1.ncols(),
+                                    b1.nrows(), true,
+                                    {{b.data()}, 1, false, b_size, 0});
+    batch<TestType> const c_strided(num_batch, a1.nrows(), b1.nrows(),
+                                    a1.nrows(), false,
+                                    {{c.data()}, 1, false, c_size, 0});
+
+    TestType *first;
+    int64_t step;
+    REQUIRE(a_strided.is_strided(first, step));
+    REQUIRE(first == a.data());
+    REQUIRE(step == a_size);
+    batched_gemm(a_strided, b_strided, c_strided, alpha, beta);
+    REQUIRE(c == gold);
+
+    // an indexed operand is expanded into the given lists
+    batch<TestType> a_indexed(num_batch, a1.nrows(), a1.ncols(), a1.nrows(),
+                              false, {{a.data()}, 1, true, 0, 0});
+    for (int i = 0; i < num_batch; ++i)
+    {
+      a_indexed.assign_raw(a.data() + (num_batch - 1 - i) * a_size, i);
+    }
+    REQUIRE(!a_indexed.is_strided(first, step));
+    std::vector<TestType *> expanded(num_batch);
+    a_indexed.expand(1, num_batch - 1, workspace_binding<TestType>(),
+                     expanded.data());
+    REQUIRE(expanded[0] == a.data() + a_size);
+    REQUIRE(expanded[1] == a.data());
+
+    fk::matrix<TestType> reversed(gold.nrows(), gold.ncols());
+    reversed.set_submatrix(0, 0, a3 * fk::matrix<TestType>(b1).transpose());
+    reversed.set_submatrix(0, b1.nrows(),
+                           a2 * fk::matrix<TestType>(b2).transpose());
+    reversed.set_submatrix(0, 2 * b1.nrows(),
+                           a1 * fk::matrix<TestType>(b3).transpose());
+    std::vector<TestType *> lists;
+    batched_gemm(a_indexed, b_strided, c_strided, alpha, beta,
+                 workspace_binding<TestType>(), &lists);
+    REQUIRE(c == reversed);
+    REQUIRE(lists.size() == 3 * num_batch);
+  }
 }
 
 TEMPLATE_TEST_CASE("batched gemv", "[batch]", float, double)
@@ -2045,3 +2178,485 @@ TEMPLATE_TEST_CASE("batch builder", "[batch]", float, double)
     relaxed_comparison(gold, host_space.fx);
   }
 }
+
+TEMPLATE_TEST_CASE("batch plan", "[batch]", float, double)
+{
+  int const degree = 2;
+  int const level  = 3;
+
+  auto pde = make_PDE<TestType>(PDE_opts::continuity_2, level, degree);
+
+  // the default coefficients are identities; fill them so that no products
+  // are dropped for zero blocks
+  for (int d = 0; d < pde->num_dims; ++d)
+  {
+    for (int k = 0; k < pde->num_terms; ++k)
+    {
+      fk::matrix<TestType> coeffs(pde->get_coefficients(k, d));
+      std::iota(coeffs.begin(), coeffs.end(), 1.0);
+      pde->set_coefficients(coeffs, k, d);
+    }
+  }
+
+  options const o = make_options(
+      {"-l", std::to_string(level), "-d", std::to_string(degree)});
+
+  element_table const elem_table(o, pde->num_dims);
+
+  // split the problem so the plan covers several chunks
+  int const num_chunks = 5;
+  auto const chunks    = assign_elements(elem_table, num_chunks);
+  rank_workspace<TestType> const rank_space(*pde, chunks);
+
+  batch_plan<TestType> plan(*pde, elem_table, rank_space, chunks);
+
+  SECTION("plan matches per-chunk batch building")
+  {
+    REQUIRE(plan.num_chunks() == num_chunks);
+    int64_t num_pointers = 0;
+    int64_t num_bytes    = 0;
+    for (int i = 0; i < num_chunks; ++i)
+    {
+      std::vector<batch_operands_set<TestType>> const gold = build_batches(
+          *pde, elem_table, rank_space, chunks[i], &plan.get_block_structure());
+      std::vector<batch_operands_set<TestType>> const &test =
+          plan.get_batches(i);
+      REQUIRE(gold.size() == test.size());
+      for (int d = 0; d < static_cast<int>(gold.size()); ++d)
+      {
+        REQUIRE(gold[d].size() == test[d].size());
+        for (int j = 0; j < static_cast<int>(gold[d].size()); ++j)
+        {
+          REQUIRE(gold[d][j] == test[d][j]);
+          num_pointers += test[d][j].num_entries();
+          num_bytes += test[d][j].metadata_bytes();
+        }
+      }
+    }
+    double const gold_MB = static_cast<double>(num_bytes) * 1e-6;
+    REQUIRE(plan.size_MB() == Approx(gold_MB));
+
+    // the plan's batches are compact - at most a 32 bit offset per gemm
+    // operand, rather than a pointer
+    REQUIRE(num_bytes * 2 < num_pointers * static_cast<int64_t>(
+                                               sizeof(TestType *)));
+  }
+
+  SECTION("shared partial products are computed once")
+  {
+    int64_t total_krons = 0;
+    int64_t total_first = 0;
+    for (int i = 0; i < num_chunks; ++i)
+    {
+      std::vector<batch_operands_set<TestType>> const &batches =
+          plan.get_batches(i);
+      int const num_krons = plan.get_output_offsets(i).back();
+      // the last stage writes one output per nonzero kronecker product...
+      REQUIRE(batches.back()[0].num_entries() == num_krons);
+      REQUIRE(batches[0][0].num_entries() <= num_krons);
+      total_krons += num_krons;
+      total_first += batches[0][0].num_entries();
+    }
+    // ...but first stage products are shared by row elements with the same
+    // index in that dimension
+    REQUIRE(total_first < total_krons);
+    REQUIRE(plan.num_dropped() == 0);
+  }
+
+  SECTION("products over zero blocks are dropped")
+  {
+    // with identity coefficients, only products over diagonal blocks in
+    // every dimension remain
+    for (int d = 0; d < pde->num_dims; ++d)
+    {
+      for (int k = 0; k < pde->num_terms; ++k)
+      {
+        pde->set_coefficients(
+            eye<TestType>(pde->get_coefficients(k, d).nrows()), k, d);
+      }
+    }
+    batch_plan<TestType> const identity_plan(*pde, elem_table, rank_space,
+                                             chunks);
+    int64_t total_krons = 0;
+    for (int i = 0; i < num_chunks; ++i)
+    {
+      std::vector<int> const &offsets = identity_plan.get_output_offsets(i);
+      REQUIRE(identity_plan.get_batches(i).back()[0].num_entries() ==
+              offsets.back());
+      total_krons += offsets.back();
+    }
+    REQUIRE(identity_plan.num_dropped() > 0);
+    REQUIRE(total_krons + identity_plan.num_dropped() ==
+            static_cast<int64_t>(pde->num_terms) * elem_table.size() *
+                elem_table.size());
+    auto const &blocks = identity_plan.get_block_structure();
+    REQUIRE(blocks.count(kronmult::block_kind::identity) > 0);
+    REQUIRE(blocks.count(kronmult::block_kind::zero) > 0);
+    REQUIRE(blocks.count(kronmult::block_kind::dense) == 0);
+  }
+
+  SECTION("plan does not depend on the thread count")
+  {
+    int const grain_size = lib_dispatch::get_grain_size();
+    lib_dispatch::set_num_threads(1);
+    batch_plan<TestType> const serial(*pde, elem_table, rank_space, chunks);
+    lib_dispatch::set_num_threads(4);
+    lib_dispatch::set_grain_size(1);
+    batch_plan<TestType> const threaded(*pde, elem_table, rank_space, chunks);
+    lib_dispatch::set_num_threads(0);
+    lib_dispatch::set_grain_size(grain_size);
+
+    for (int i = 0; i < num_chunks; ++i)
+    {
+      REQUIRE(serial.get_output_offsets(i) == threaded.get_output_offsets(i));
+      std::vector<batch_operands_set<TestType>> const &gold =
+          serial.get_batches(i);
+      std::vector<batch_operands_set<TestType>> const &test =
+          threaded.get_batches(i);
+      REQUIRE(gold.size() == test.size());
+      for (int d = 0; d < static_cast<int>(gold.size()); ++d)
+      {
+        REQUIRE(gold[d].size() == test[d].size());
+        for (int j = 0; j < static_cast<int>(gold[d].size()); ++j)
+        {
+          REQUIRE(gold[d][j] == test[d][j]);
+        }
+      }
+    }
+  }
+
+  SECTION("plan staleness")
+  {
+    REQUIRE(!plan.is_stale(*pde, rank_space));
+
+    // a reallocated workspace invalidates the plan
+    rank_workspace<TestType> const new_space(*pde, chunks);
+    REQUIRE(plan.is_stale(*pde, new_space));
+
+    plan.rebuild(*pde, elem_table, new_space, chunks);
+    REQUIRE(!plan.is_stale(*pde, new_space));
+    REQUIRE(plan.is_stale(*pde, rank_space));
+
+    // so do regenerated coefficients, even if the storage is unchanged, along
+    // with any operators stacked from them
+    stacked_operators<TestType> const stacked = stack_operators(*pde);
+    REQUIRE(stacked.generation == pde->get_coefficients_generation());
+    fk::matrix<TestType> const coeffs = pde->get_coefficients(0, 0);
+    pde->set_coefficients(coeffs, 0, 0);
+    REQUIRE(plan.is_stale(*pde, new_space));
+    REQUIRE(stacked.generation != pde->get_coefficients_generation());
+
+    plan.rebuild(*pde, elem_table, new_space, chunks);
+    REQUIRE(!plan.is_stale(*pde, new_space));
+  }
+}
+
+TEMPLATE_TEST_CASE("kronmult engine plans", "[batch]", float, double)
+{
+  std::random_device rd;
+  std::mt19937 mersenne_engine(rd());
+  std::uniform_real_distribution<TestType> dist(-2.0, 2.0);
+  auto gen = [&dist, &mersenne_engine]() { return dist(mersenne_engine); };
+
+  // apply the system matrix to x using the given plan
+  auto const apply = [](PDE<TestType> const &pde,
+                        std::vector<element_chunk> const &chunks,
+                        batch_plan<TestType> const &plan,
+                        rank_workspace<TestType> &rank_space,
+                        host_workspace<TestType> &host_space) {
+    fm::scal(static_cast<TestType>(0.0), host_space.fx);
+    for (int i = 0; i < plan.num_chunks(); ++i)
+    {
+      copy_chunk_inputs(pde, rank_space, host_space, chunks[i]);
+      if (plan.is_fused())
+      {
+        batched_kronmult(plan.get_kron_batch(i), rank_space.batch_intermediate);
+      }
+      else
+      {
+        for (auto const &operands : plan.get_batches(i))
+        {
+          batched_gemm(operands[0], operands[1], operands[2],
+                       static_cast<TestType>(1.0), static_cast<TestType>(0.0));
+        }
+      }
+      reduce_chunk(pde, rank_space, chunks[i], plan.get_output_offsets(i));
+      copy_chunk_outputs(pde, rank_space, host_space, chunks[i]);
+    }
+    return host_space.fx;
+  };
+
+  // compare a plan for the given engine against unpruned batched gemms. with
+  // structured set, some coefficients are identities and the rest have zero
+  // and diagonal blocks, up to entries below the plan's drop tolerance. the
+  // plan's products are summed by the given reduction, and with zero_copy
+  // read from x and summed into fx without staging
+  auto const test_engine = [&](PDE_opts const choice, int const level,
+                               int const degree, kronmult_engine const engine,
+                               int const num_chunks = 1,
+                               bool const structured = false,
+                               reduction_engine const reduction =
+                                   reduction_engine::gemv,
+                               bool const zero_copy = false) {
+    auto pde = make_PDE<TestType>(choice, level, degree);
+    options const o = make_options(
+        {"-l", std::to_string(level), "-d", std::to_string(degree)});
+    element_table const elem_table(o, pde->num_dims);
+
+    TestType const small    = std::numeric_limits<TestType>::epsilon();
+    TestType const drop_tol = structured ? 2 * small : 0;
+    for (int d = 0; d < pde->num_dims; ++d)
+    {
+      for (int k = 0; k < pde->num_terms; ++k)
+      {
+        fk::matrix<TestType> coeffs(pde->get_coefficients(k, d));
+        if (structured && (k + d) % 2 == 0)
+        {
+          pde->set_coefficients(eye<TestType>(coeffs.nrows()), k, d);
+          continue;
+        }
+        std::generate(coeffs.begin(), coeffs.end(), gen);
+        for (int c = 0; structured && c < coeffs.ncols(); ++c)
+        {
+          for (int r = 0; r < coeffs.nrows(); ++r)
+          {
+            int const block_row = r / degree;
+            int const block_col = c / degree;
+            bool const zero_block = (block_row + 2 * block_col) % 3 == 0;
+            bool const off_diagonal =
+                block_row == block_col && r % degree != c % degree;
+            if (zero_block || off_diagonal)
+            {
+              coeffs(r, c) = (r + c) % 2 == 0 ? 0 : small;
+            }
+          }
+        }
+        pde->set_coefficients(coeffs, k, d);
+      }
+    }
+
+    host_workspace<TestType> host_space(*pde, elem_table);
+    std::generate(host_space.x.begin(), host_space.x.end(), gen);
+
+    auto const chunks = assign_elements(elem_table, num_chunks);
+
+    rank_workspace<TestType> gemm_space(*pde, chunks);
+    fm::scal(static_cast<TestType>(0.0), host_space.fx);
+    for (auto const &chunk : chunks)
+    {
+      copy_chunk_inputs(*pde, gemm_space, host_space, chunk);
+      for (auto const &operands :
+           build_batches(*pde, elem_table, gemm_space, chunk))
+      {
+        batched_gemm(operands[0], operands[1], operands[2],
+                     static_cast<TestType>(1.0), static_cast<TestType>(0.0));
+      }
+      reduce_chunk(*pde, gemm_space, chunk);
+      copy_chunk_outputs(*pde, gemm_space, host_space, chunk);
+    }
+    fk::vector<TestType> const gold(host_space.fx);
+
+    // element pairs with no nonzero product are left out of the plan's
+    // chunks altogether, which splits rows into several chunk entries
+    list_set all_pairs;
+    for (int i = 0; i < elem_table.size(); ++i)
+    {
+      fk::vector<int> connected(elem_table.size());
+      std::iota(connected.begin(), connected.end(), 0);
+      all_pairs.push_back(connected);
+    }
+    block_structure<TestType> const blocks(*pde, drop_tol);
+    auto const plan_chunks =
+        assign_elements(blocks.prune(elem_table, all_pairs), num_chunks);
+    int64_t num_pruned = 0;
+    for (int i = 0; i < num_chunks; ++i)
+    {
+      num_pruned += num_elements_in_chunk(chunks[i]);
+    }
+    for (auto const &chunk : plan_chunks)
+    {
+      num_pruned -= num_elements_in_chunk(chunk);
+    }
+
+    // pairs with no nonzero product are predicted to cost nothing, and the
+    // fused engine's stages cost no more than the gemm engines'
+    cost_model const costs = blocks.pair_costs(elem_table, all_pairs, engine);
+    cost_model const gemm_costs =
+        blocks.pair_costs(elem_table, all_pairs, kronmult_engine::batched);
+    REQUIRE(costs.size() == all_pairs.size());
+    for (int row = 0; row < elem_table.size(); ++row)
+    {
+      REQUIRE(static_cast<int>(costs[row].size()) == all_pairs[row].size());
+      for (int col = 0; col < elem_table.size(); ++col)
+      {
+        REQUIRE((costs[row][col] > 0.0) ==
+                blocks.is_connected(elem_table, row, col));
+        REQUIRE(costs[row][col] <= gemm_costs[row][col]);
+      }
+    }
+
+    rank_workspace<TestType> space(*pde, plan_chunks, engine, reduction,
+                                   zero_copy ? &host_space : nullptr);
+    batch_plan<TestType> const plan(*pde, elem_table, space, plan_chunks,
+                                    drop_tol);
+    REQUIRE(plan.get_engine() == engine);
+    REQUIRE(space.is_zero_copy() == zero_copy);
+    if (zero_copy)
+    {
+      REQUIRE(space.batch_input.size() == 0);
+      REQUIRE(space.batch_output.size() <= 2 * element_segment_size(*pde));
+      REQUIRE(&space.get_input() == &host_space.x);
+    }
+    REQUIRE((num_pruned + plan.num_dropped() > 0) == structured);
+    if (reduction == reduction_engine::in_place)
+    {
+      REQUIRE(space.reduction_space.size() == 0);
+    }
+    if (engine == kronmult_engine::fused)
+    {
+      REQUIRE(space.batch_intermediate.size() <
+              gemm_space.batch_intermediate.size());
+      REQUIRE(plan.get_kron_batch(0).is_filled());
+    }
+    if (engine == kronmult_engine::stacked)
+    {
+      // one output per element pair, rather than one per term
+      REQUIRE(space.products_per_element() == 1);
+      REQUIRE(space.reduction_space.size() * pde->num_terms <=
+              gemm_space.reduction_space.size());
+      for (int i = 0; i < plan.num_chunks(); ++i)
+      {
+        auto const &batches = plan.get_batches(i);
+        REQUIRE(static_cast<int>(batches.size()) == pde->num_dims);
+        REQUIRE(batches.back()[0].num_entries() ==
+                plan.get_output_offsets(i).back());
+        REQUIRE(plan.get_output_offsets(i).back() <=
+                num_elements_in_chunk(plan_chunks[i]));
+      }
+    }
+    fk::vector<TestType> const test =
+        apply(*pde, plan_chunks, plan, space, host_space);
+
+    TestType const tol = std::numeric_limits<TestType>::epsilon() * 1e4;
+    for (int i = 0; i < gold.size(); ++i)
+    {
+      TestType const scale =
+          std::max(static_cast<TestType>(1.0), std::abs(gold(i)));
+      REQUIRE(std::abs(test(i) - gold(i)) <= tol * scale);
+    }
+  };
+
+  SECTION("fused, continuity 2, level 3, degree 3")
+  {
+    test_engine(PDE_opts::continuity_2, 3, 3, kronmult_engine::fused);
+  }
+  SECTION("fused, continuity 3, level 2, degree 4")
+  {
+    test_engine(PDE_opts::continuity_3, 2, 4, kronmult_engine::fused);
+  }
+  SECTION("fused, continuity 6, level 2, degree 2")
+  {
+    test_engine(PDE_opts::continuity_6, 2, 2, kronmult_engine::fused);
+  }
+  SECTION("stacked, continuity 2, level 3, degree 3")
+  {
+    test_engine(PDE_opts::continuity_2, 3, 3, kronmult_engine::stacked);
+  }
+  SECTION("stacked, continuity 3, level 2, degree 4")
+  {
+    test_engine(PDE_opts::continuity_3, 2, 4, kronmult_engine::stacked);
+  }
+  SECTION("stacked, continuity 6, level 2, degree 2")
+  {
+    test_engine(PDE_opts::continuity_6, 2, 2, kronmult_engine::stacked);
+  }
+  SECTION("stacked, continuity 3, level 3, degree 2, several chunks")
+  {
+    test_engine(PDE_opts::continuity_3, 3, 2, kronmult_engine::stacked, 5);
+  }
+  SECTION("batched, structured blocks, continuity 2, level 3, degree 3")
+  {
+    test_engine(PDE_opts::continuity_2, 3, 3, kronmult_engine::batched, 3,
+                true);
+  }
+  SECTION("batched, structured blocks, continuity 3, level 2, degree 2")
+  {
+    test_engine(PDE_opts::continuity_3, 2, 2, kronmult_engine::batched, 1,
+                true);
+  }
+  SECTION("fused, structured blocks, continuity 2, level 3, degree 3")
+  {
+    test_engine(PDE_opts::continuity_2, 3, 3, kronmult_engine::fused, 3,
+                true);
+  }
+  SECTION("fused, structured blocks, continuity 3, level 2, degree 4")
+  {
+    test_engine(PDE_opts::continuity_3, 2, 4, kronmult_engine::fused, 1,
+                true);
+  }
+  SECTION("stacked, structured blocks, continuity 2, level 3, degree 3")
+  {
+    test_engine(PDE_opts::continuity_2, 3, 3, kronmult_engine::stacked, 3,
+                true);
+  }
+  SECTION("stacked, structured blocks, continuity 3, level 2, degree 2")
+  {
+    test_engine(PDE_opts::continuity_3, 2, 2, kronmult_engine::stacked, 1,
+                true);
+  }
+  SECTION("column sum reduction, batched, structured, continuity 2")
+  {
+    test_engine(PDE_opts::continuity_2, 3, 3, kronmult_engine::batched, 3,
+                true, reduction_engine::column_sum);
+  }
+  SECTION("tree reduction, stacked, continuity 3, several chunks")
+  {
+    test_engine(PDE_opts::continuity_3, 3, 2, kronmult_engine::stacked, 5,
+                false, reduction_engine::tree);
+  }
+  SECTION("tree reduction, fused, structured, continuity 2")
+  {
+    test_engine(PDE_opts::continuity_2, 3, 3, kronmult_engine::fused, 3, true,
+                reduction_engine::tree);
+  }
+  SECTION("in place reduction, fused, continuity 3, several chunks")
+  {
+    test_engine(PDE_opts::continuity_3, 3, 2, kronmult_engine::fused, 5,
+                false, reduction_engine::in_place);
+  }
+  SECTION("in place reduction, fused, structured, continuity 2")
+  {
+    test_engine(PDE_opts::continuity_2, 3, 3, kronmult_engine::fused, 3, true,
+                reduction_engine::in_place);
+  }
+  SECTION("in place reduction, fused, structured, continuity 3")
+  {
+    test_engine(PDE_opts::continuity_3, 2, 4, kronmult_engine::fused, 1, true,
+                reduction_engine::in_place);
+  }
+  SECTION("zero-copy, batched, structured, continuity 2")
+  {
+    test_engine(PDE_opts::continuity_2, 3, 3, kronmult_engine::batched, 3,
+                true, reduction_engine::gemv, true);
+  }
+  SECTION("zero-copy, stacked, continuity 3, several chunks")
+  {
+    test_engine(PDE_opts::continuity_3, 3, 2, kronmult_engine::stacked, 5,
+                false, reduction_engine::tree, true);
+  }
+  SECTION("zero-copy, fused, structured, continuity 2")
+  {
+    test_engine(PDE_opts::continuity_2, 3, 3, kronmult_engine::fused, 3, true,
+                reduction_engine::column_sum, true);
+  }
+  SECTION("zero-copy, in place reduction, fused, continuity 3, several chunks")
+  {
+    test_engine(PDE_opts::continuity_3, 3, 2, kronmult_engine::fused, 5,
+                false, reduction_engine::in_place, true);
+  }
+  SECTION("zero-copy, in place reduction, fused, structured, continuity 2")
+  {
+    test_engine(PDE_opts::continuity_2, 3, 3, kronmult_engine::fused, 7, true,
+                reduction_engine::in_place, true);
+  }
+}
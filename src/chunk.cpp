@@ -1,62 +1,102 @@
 #include "chunk.hpp"
 #include "fast_math.hpp"
+#include <algorithm>
+#include <numeric>
 
-int num_elements_in_chunk(element_chunk const &g)
+void element_chunk::add(int const row, limits const &columns)
 {
-  int num_elems = 0;
-  for (auto const &[row, cols] : g)
-  {
-    ignore(row);
-    num_elems += cols.stop - cols.start + 1;
-  }
-  return num_elems;
+  assert(rows_.empty() || row >= rows_.back());
+  assert(columns.start <= columns.stop);
+  int const num_columns = columns.stop - columns.start + 1;
+  rows_.push_back(row);
+  starts_.push_back(columns.start);
+  stops_.push_back(columns.stop);
+  pair_offsets_.push_back(pair_offsets_.back() + num_columns);
+  max_columns_ = std::max(max_columns_, num_columns);
+  min_column_  = std::min(min_column_, columns.start);
+  max_column_  = std::max(max_column_, columns.stop);
 }
-int max_connected_in_chunk(element_chunk const &g)
+
+limits element_chunk::rows() const
 {
-  int current_max = 0;
-  for (auto const &[row, cols] : g)
-  {
-    ignore(row);
-    current_max = std::max(current_max, cols.stop - cols.start + 1);
-  }
-  return current_max;
+  assert(!empty());
+  return limits(rows_.front(), rows_.back());
 }
 
-limits columns_in_chunk(element_chunk const &g)
+limits element_chunk::columns() const
 {
-  assert(g.size() > 0);
-  int const min_col =
-      (*std::min_element(g.begin(), g.end(),
-                         [](auto const &a, auto const &b) {
-                           return a.second.start < b.second.stop;
-                         }))
-          .second.start;
-
-  int const max_col = (*std::max_element(g.begin(), g.end(),
-                                         [](auto const &a, auto const &b) {
-                                           return a.second.stop < b.second.stop;
-                                         }))
-                          .second.stop;
-  return limits(min_col, max_col);
+  assert(!empty());
+  return limits(min_column_, max_column_);
 }
-limits rows_in_chunk(element_chunk const &g)
+
+int num_elements_in_chunk(element_chunk const &g) { return g.num_pairs(); }
+int max_connected_in_chunk(element_chunk const &g) { return g.max_columns(); }
+
+limits columns_in_chunk(element_chunk const &g) { return g.columns(); }
+limits rows_in_chunk(element_chunk const &g) { return g.rows(); }
+
+std::vector<limits> input_ranges(element_chunk const &g)
 {
-  assert(g.size() > 0);
-  return limits(g.begin()->first, g.rbegin()->first);
+  std::vector<std::pair<int, int>> cols;
+  cols.reserve(g.size());
+  for (int i = 0; i < g.size(); ++i)
+  {
+    limits const range = g.columns(i);
+    cols.emplace_back(range.start, range.stop);
+  }
+  std::sort(cols.begin(), cols.end());
+
+  // merge overlapping and adjacent ranges
+  std::vector<limits> ranges;
+  for (int i = 0; i < static_cast<int>(cols.size());)
+  {
+    int const start = cols[i].first;
+    int stop        = cols[i].second;
+    for (++i; i < static_cast<int>(cols.size()) && cols[i].first <= stop + 1;
+         ++i)
+    {
+      stop = std::max(stop, cols[i].second);
+    }
+    ranges.emplace_back(start, stop);
+  }
+  return ranges;
+}
+int num_inputs_in_chunk(element_chunk const &g)
+{
+  int num_inputs = 0;
+  for (limits const &range : input_ranges(g))
+  {
+    num_inputs += range.stop - range.start + 1;
+  }
+  return num_inputs;
 }
 
 template<typename P>
 rank_workspace<P>::rank_workspace(PDE<P> const &pde,
-                                  std::vector<element_chunk> const &chunks)
+                                  std::vector<element_chunk> const &chunks,
+                                  kronmult_engine const engine,
+                                  reduction_engine const reduction,
+                                  host_workspace<P> *const host)
+    : engine_(engine), reduction_(reduction),
+      products_per_element_(engine == kronmult_engine::stacked ? 1
+                                                               : pde.num_terms),
+      host_(host), elem_size_(element_segment_size(pde))
 {
+  assert(engine != kronmult_engine::stacked || pde.num_dims > 1);
+  assert(reduction != reduction_engine::in_place ||
+         engine == kronmult_engine::fused);
   int const elem_size = element_segment_size(pde);
 
-  int const max_elems =
-      (*std::max_element(chunks.begin(), chunks.end(),
-                         [](const element_chunk &a, const element_chunk &b) {
-                           return a.size() < b.size();
-                         }))
-          .size();
+  // outputs are written for a chunk's whole row span
+  int const max_elems = [&chunks] {
+    int span = 0;
+    for (element_chunk const &chunk : chunks)
+    {
+      limits const rows = rows_in_chunk(chunk);
+      span              = std::max(span, rows.stop - rows.start + 1);
+    }
+    return span;
+  }();
 
   int const max_conn = max_connected_in_chunk(*std::max_element(
       chunks.begin(), chunks.end(),
@@ -70,15 +110,39 @@ rank_workspace<P>::rank_workspace(PDE<P> const &pde,
         return num_elements_in_chunk(a) < num_elements_in_chunk(b);
       }));
 
-  batch_input.resize(elem_size * max_conn);
-  batch_output.resize(elem_size * max_elems);
-  reduction_space.resize(elem_size * max_total * pde.num_terms);
+  // a chunk's rows can touch more columns than any one row does
+  int const max_inputs = num_inputs_in_chunk(*std::max_element(
+      chunks.begin(), chunks.end(),
+      [](const element_chunk &a, const element_chunk &b) {
+        return num_inputs_in_chunk(a) < num_inputs_in_chunk(b);
+      }));
+
+  // zero-copy, only a chunk's first and last rows are staged
+  if (!host)
+  {
+    batch_input.resize(elem_size * max_inputs);
+  }
+  batch_output.resize(elem_size * (host ? std::min(max_elems, 2) : max_elems));
+  // reduced in place, the products go straight to the batch output
+  if (reduction != reduction_engine::in_place)
+  {
+    reduction_space.resize(elem_size * max_total * products_per_element_);
+  }
 
-  // intermediate workspaces for kron product.
+  // intermediate workspaces for kron product, one product per term for each
+  // connected element. the fused kernels only need scratch space for one
+  // product at a time
   int const num_workspaces = std::min(pde.num_dims - 1, 2);
-  batch_intermediate.resize(reduction_space.size() * num_workspaces);
-  unit_vector_.resize(pde.num_terms * max_conn);
-  std::fill(unit_vector_.begin(), unit_vector_.end(), 1.0);
+  int const workspace_size = engine == kronmult_engine::fused
+                                 ? elem_size
+                                 : elem_size * max_total * pde.num_terms;
+  batch_intermediate.resize(workspace_size * num_workspaces);
+  // only the gemv reduction needs the ones
+  if (reduction == reduction_engine::gemv)
+  {
+    unit_vector_.resize(products_per_element_ * max_conn);
+    std::fill(unit_vector_.begin(), unit_vector_.end(), 1.0);
+  }
 }
 
 template<typename P>
@@ -88,17 +152,96 @@ fk::vector<P> const &rank_workspace<P>::get_unit_vector() const
 }
 
 template<typename P>
-host_workspace<P>::host_workspace(PDE<P> const &pde, element_table const &table)
+fk::vector<P> const &rank_workspace<P>::get_input() const
+{
+  return host_ ? host_->x : batch_input;
+}
+
+template<typename P>
+bool rank_workspace<P>::is_staged(element_chunk const &chunk,
+                                  int const row) const
+{
+  limits const rows = chunk.rows();
+  assert(row >= rows.start && row <= rows.stop);
+  return !host_ || row == rows.start || row == rows.stop;
+}
+
+template<typename P>
+fk::vector<P, mem_type::view>
+rank_workspace<P>::output_row(element_chunk const &chunk, int const row) const
+{
+  if (!is_staged(chunk, row))
+  {
+    return fk::vector<P, mem_type::view>(host_->fx, row * elem_size_,
+                                         (row + 1) * elem_size_ - 1);
+  }
+  limits const rows = chunk.rows();
+  int const staged  = !host_ ? row - rows.start : row == rows.start ? 0 : 1;
+  assert((staged + 1) * elem_size_ <= batch_output.size());
+  return fk::vector<P, mem_type::view>(batch_output, staged * elem_size_,
+                                       (staged + 1) * elem_size_ - 1);
+}
+
+template<typename P>
+host_workspace<P>::host_workspace(PDE<P> const &pde, element_table const &table,
+                                  time_scheme const scheme,
+                                  int const krylov_dimension)
+    : scheme_(scheme)
 {
   int elem_size             = element_segment_size(pde);
   int64_t const vector_size = elem_size * static_cast<int64_t>(table.size());
-  x_orig.resize(vector_size);
   x.resize(vector_size);
   fx.resize(vector_size);
-  scaled_source.resize(vector_size);
-  result_1.resize(vector_size);
-  result_2.resize(vector_size);
-  result_3.resize(vector_size);
+  switch (scheme)
+  {
+  case time_scheme::rk3:
+    x_orig.resize(vector_size);
+    result_1.resize(vector_size);
+    break;
+  case time_scheme::ssp_rk3:
+    x_orig.resize(vector_size);
+    break;
+  case time_scheme::ls_rk3:
+  case time_scheme::ls_rk4:
+    // the stage increment
+    result_1.resize(vector_size);
+    break;
+  case time_scheme::bs23:
+    // the derivatives, summed toward the solution and the error estimate
+    x_orig.resize(vector_size);
+    result_1.resize(vector_size);
+    result_2.resize(vector_size);
+    break;
+  case time_scheme::ab2:
+    derivatives.resize(2);
+    break;
+  case time_scheme::ab3:
+    derivatives.resize(3);
+    break;
+  case time_scheme::backward_euler:
+  case time_scheme::crank_nicolson:
+    // the system's right-hand side and the solution
+    assert(krylov_dimension > 0);
+    x_orig.resize(vector_size);
+    result_1.resize(vector_size);
+    krylov_basis.resize(krylov_dimension + 1);
+    break;
+  case time_scheme::exponential:
+    // the sources' interpolant over a substep
+    assert(krylov_dimension > 0);
+    x_orig.resize(vector_size);
+    result_1.resize(vector_size);
+    result_2.resize(vector_size);
+    krylov_basis.resize(krylov_dimension + 1);
+    break;
+  }
+  for (auto *const vectors : {&krylov_basis, &derivatives})
+  {
+    for (fk::vector<P> &vector : *vectors)
+    {
+      vector.resize(vector_size);
+    }
+  }
 }
 
 // calculate how much workspace we need on device to compute a single connected
@@ -108,7 +251,7 @@ host_workspace<P>::host_workspace(PDE<P> const &pde, element_table const &table)
 // all be resident*
 
 template<typename P>
-static double get_element_size_MB(PDE<P> const &pde)
+double get_element_size_MB(PDE<P> const &pde, kronmult_engine const engine)
 {
   auto const get_MB = [](auto const num_elems) -> double {
     assert(num_elems > 0);
@@ -120,10 +263,15 @@ static double get_element_size_MB(PDE<P> const &pde)
   int const elem_size = element_segment_size(pde);
   // number of intermediate workspaces for kron product.
   // FIXME this only applies to explicit
-  int const num_workspaces = std::min(pde.num_dims - 1, 2);
-
-  // calc size of reduction space for a single work item
-  double const elem_reduction_space_MB = get_MB(pde.num_terms * elem_size);
+  // fused kernels keep their intermediates in a single, fixed-size scratch
+  int const num_workspaces =
+      engine == kronmult_engine::fused ? 0 : std::min(pde.num_dims - 1, 2);
+
+  // calc size of reduction space for a single work item. the stacked engine
+  // sums the terms' products as it computes them
+  int const num_products =
+      engine == kronmult_engine::stacked ? 1 : pde.num_terms;
+  double const elem_reduction_space_MB = get_MB(num_products * elem_size);
   // calc size of intermediate space for a single work item
   double const elem_intermediate_space_MB =
       num_workspaces == 0 ? 0.0
@@ -142,14 +290,14 @@ static double get_element_size_MB(PDE<P> const &pde)
 // a chunk is a subset of all elements whose total workspace requirement
 // is less than the limit passed in rank_size_MB
 template<typename P>
-int get_num_chunks(element_table const &table, PDE<P> const &pde,
-                   int const num_ranks, int const rank_size_MB)
+static int get_num_chunks(double const num_elems, PDE<P> const &pde,
+                          int const num_ranks, int const rank_size_MB,
+                          kronmult_engine const engine)
 {
   assert(num_ranks > 0);
   assert(rank_size_MB > 0);
   // determine total problem size
-  double const num_elems = static_cast<double>(table.size()) * table.size();
-  double const space_per_elem = get_element_size_MB(pde);
+  double const space_per_elem = get_element_size_MB(pde, engine);
 
   // make sure rank size is something reasonable
   // a single element is the finest we can split the problem
@@ -171,6 +319,28 @@ int get_num_chunks(element_table const &table, PDE<P> const &pde,
   return num_chunks;
 }
 
+template<typename P>
+int get_num_chunks(element_table const &table, PDE<P> const &pde,
+                   int const num_ranks, int const rank_size_MB,
+                   kronmult_engine const engine)
+{
+  double const num_elems = static_cast<double>(table.size()) * table.size();
+  return get_num_chunks(num_elems, pde, num_ranks, rank_size_MB, engine);
+}
+
+template<typename P>
+int get_num_chunks(list_set const &connectivity, PDE<P> const &pde,
+                   int const num_ranks, int const rank_size_MB,
+                   kronmult_engine const engine)
+{
+  double num_elems = 0.0;
+  for (fk::vector<int> const &connected : connectivity)
+  {
+    num_elems += connected.size();
+  }
+  return get_num_chunks(num_elems, pde, num_ranks, rank_size_MB, engine);
+}
+
 // divide the problem given the previously computed number of chunks
 // this function divides via a greedy, row-major split.
 // i.e., consecutive elements are taken row-wise until the end of a
@@ -195,12 +365,6 @@ assign_elements(element_table const &table, int const num_chunks)
 
   for (int i = 0; i < num_chunks; ++i)
   {
-    std::map<int, std::vector<int>> chunk_map;
-
-    auto const insert = [&chunk_map](int const key, int col) {
-      chunk_map.try_emplace(key, std::vector<int>());
-      chunk_map[key].push_back(col);
-    };
     int64_t const elems_this_task =
         i < still_left_over ? elems_per_task + 1 : elems_per_task;
     int64_t const task_end = assigned + elems_this_task - 1;
@@ -212,40 +376,189 @@ assign_elements(element_table const &table, int const num_chunks)
 
     assigned += elems_this_task;
 
-    if (chunk_end_row > chunk_start_row)
+    // whole rows between the first and last, which may be partial
+    element_chunk chunk;
+    for (int64_t row = chunk_start_row;
+         row <= chunk_end_row && elems_this_task > 0; ++row)
+    {
+      int64_t const start = row == chunk_start_row ? chunk_start_col : 0;
+      int64_t const stop =
+          row == chunk_end_row ? chunk_end_col : table.size() - 1;
+      chunk.add(row, limits(start, stop));
+    }
+    chunks.push_back(chunk);
+  }
+  return chunks;
+}
+
+// take each chunk's number of the listed pairs in turn, each row's connected
+// elements in order. the columns a chunk takes from a row are split into
+// contiguous ranges, one chunk entry each. rows with no connected elements
+// are skipped, as are chunks taking no pairs
+static std::vector<element_chunk>
+take_pairs(list_set const &connectivity,
+           std::vector<int64_t> const &pairs_per_chunk)
+{
+  std::vector<element_chunk> chunks;
+  int row      = 0;
+  int position = 0;
+  for (int64_t elems_this_task : pairs_per_chunk)
+  {
+    element_chunk chunk;
+    while (elems_this_task > 0)
     {
-      for (int i = chunk_start_row + 1; i < chunk_end_row; ++i)
+      fk::vector<int> const &connected = connectivity[row];
+      int const stop                   = static_cast<int>(
+          std::min<int64_t>(connected.size(), position + elems_this_task));
+      for (int start = position; start < stop;)
       {
-        for (int j = 0; j < table.size(); ++j)
+        int end = start;
+        while (end + 1 < stop && connected(end + 1) == connected(end) + 1)
         {
-          insert(i, j);
+          ++end;
         }
+        chunk.add(row, limits(connected(start), connected(end)));
+        start = end + 1;
       }
-      for (int j = chunk_start_col; j < table.size(); ++j)
+      elems_this_task -= stop - position;
+      position = stop;
+      if (position == connected.size())
       {
-        insert(chunk_start_row, j);
-      }
-      for (int j = 0; j <= chunk_end_col; ++j)
-      {
-        insert(chunk_end_row, j);
+        ++row;
+        position = 0;
       }
     }
-    else
+    if (!chunk.empty())
     {
-      for (int j = chunk_start_col; j <= chunk_end_col; ++j)
-      {
-        insert(chunk_start_row, j);
-      }
+      chunks.push_back(chunk);
     }
+  }
+  return chunks;
+}
 
-    element_chunk chunk;
-    for (auto const &[row, cols] : chunk_map)
+// divide the connected pairs as above. if there are fewer pairs than
+// chunks, fewer chunks are returned
+std::vector<element_chunk>
+assign_elements(list_set const &connectivity, int const num_chunks)
+{
+  assert(num_chunks > 0);
+
+  int64_t num_elems = 0;
+  for (fk::vector<int> const &connected : connectivity)
+  {
+    num_elems += connected.size();
+  }
+  int64_t const elems_per_task  = num_elems / num_chunks;
+  int64_t const still_left_over = num_elems % num_chunks;
+
+  std::vector<int64_t> pairs_per_chunk;
+  for (int i = 0; i < num_chunks; ++i)
+  {
+    pairs_per_chunk.push_back(i < still_left_over ? elems_per_task + 1
+                                                  : elems_per_task);
+  }
+  return take_pairs(connectivity, pairs_per_chunk);
+}
+
+// each chunk in turn aims for an equal share of the cost left, taking pairs
+// while that brings it closer. it takes at least one pair while there are as
+// many left as chunks, and enough that the chunks after it can hold the rest
+// within max_pairs
+std::vector<element_chunk>
+assign_elements(list_set const &connectivity, cost_model const &costs,
+                int const num_chunks, int64_t const max_pairs)
+{
+  assert(num_chunks > 0);
+  assert(max_pairs >= 0);
+  assert(costs.size() == connectivity.size());
+
+  std::vector<double> flat;
+  for (int row = 0; row < static_cast<int>(connectivity.size()); ++row)
+  {
+    assert(static_cast<int>(costs[row].size()) == connectivity[row].size());
+    flat.insert(flat.end(), costs[row].begin(), costs[row].end());
+  }
+  int64_t const num_pairs = static_cast<int64_t>(flat.size());
+  int64_t const limit     = max_pairs > 0 ? max_pairs : num_pairs;
+  assert(limit * num_chunks >= num_pairs);
+
+  double cost_left = 0.0;
+  for (double const cost : flat)
+  {
+    assert(cost >= 0.0);
+    cost_left += cost;
+  }
+
+  std::vector<int64_t> pairs_per_chunk;
+  int64_t next = 0;
+  for (int i = 0; i < num_chunks; ++i)
+  {
+    int64_t const pairs_left  = num_pairs - next;
+    int64_t const chunks_left = num_chunks - i;
+    int64_t const fewest      = std::max<int64_t>(
+        pairs_left >= chunks_left ? 1 : 0,
+        pairs_left - (chunks_left - 1) * limit);
+    int64_t const most =
+        std::min(limit, std::max<int64_t>(0, pairs_left - (chunks_left - 1)));
+    double const target = cost_left / chunks_left;
+
+    int64_t take = 0;
+    double cost  = 0.0;
+    while (take < most &&
+           (take < fewest || cost + 0.5 * flat[next + take] <= target))
     {
-      chunk.insert({row, limits(cols[0], cols.back())});
+      cost += flat[next + take];
+      ++take;
     }
-    chunks.push_back(chunk);
+    pairs_per_chunk.push_back(take);
+    next += take;
+    cost_left -= cost;
   }
-  return chunks;
+  assert(next == num_pairs);
+  return take_pairs(connectivity, pairs_per_chunk);
+}
+
+std::vector<double> chunk_costs(std::vector<element_chunk> const &chunks,
+                                list_set const &connectivity,
+                                cost_model const &costs)
+{
+  assert(costs.size() == connectivity.size());
+  std::vector<double> chunk_cost;
+  chunk_cost.reserve(chunks.size());
+  for (element_chunk const &chunk : chunks)
+  {
+    double total = 0.0;
+    for (int i = 0; i < chunk.size(); ++i)
+    {
+      int const row                    = chunk.row(i);
+      fk::vector<int> const &connected = connectivity[row];
+      limits const cols                = chunk.columns(i);
+      // the entry's columns are consecutive among the row's connected
+      // elements
+      int const first = static_cast<int>(
+          std::lower_bound(connected.begin(), connected.end(), cols.start) -
+          connected.begin());
+      assert(first < connected.size() && connected(first) == cols.start);
+      for (int j = first; j <= first + cols.stop - cols.start; ++j)
+      {
+        total += costs[row][j];
+      }
+    }
+    chunk_cost.push_back(total);
+  }
+  return chunk_cost;
+}
+
+double load_imbalance(std::vector<double> const &loads)
+{
+  assert(loads.size() > 0);
+  double const total = std::accumulate(loads.begin(), loads.end(), 0.0);
+  if (total <= 0.0)
+  {
+    return 1.0;
+  }
+  double const largest = *std::max_element(loads.begin(), loads.end());
+  return largest * loads.size() / total;
 }
 
 template<typename P>
@@ -253,12 +566,25 @@ void copy_chunk_inputs(PDE<P> const &pde, rank_workspace<P> &rank_space,
                        host_workspace<P> const &host_space,
                        element_chunk const &chunk)
 {
+  // zero-copy, the products read x where it is
+  if (rank_space.is_zero_copy())
+  {
+    assert(rank_space.get_host() == &host_space);
+    return;
+  }
   int const elem_size = element_segment_size(pde);
-  auto const x_range  = columns_in_chunk(chunk);
-  fk::vector<P, mem_type::view> const x_view(
-      host_space.x, x_range.start * elem_size,
-      (x_range.stop + 1) * elem_size - 1);
-  fm::copy(x_view, rank_space.batch_input);
+  int input_start     = 0;
+  for (limits const &x_range : input_ranges(chunk))
+  {
+    int const range_size = (x_range.stop - x_range.start + 1) * elem_size;
+    fk::vector<P, mem_type::view> const x_view(
+        host_space.x, x_range.start * elem_size,
+        (x_range.stop + 1) * elem_size - 1);
+    fk::vector<P, mem_type::view> input_view(
+        rank_space.batch_input, input_start, input_start + range_size - 1);
+    fm::copy(x_view, input_view);
+    input_start += range_size;
+  }
 }
 
 template<typename P>
@@ -268,6 +594,24 @@ void copy_chunk_outputs(PDE<P> const &pde, rank_workspace<P> &rank_space,
 {
   int const elem_size = element_segment_size(pde);
   auto const y_range  = rows_in_chunk(chunk);
+
+  // zero-copy, only the staged first and last rows are left to add
+  if (rank_space.is_zero_copy())
+  {
+    assert(rank_space.get_host() == &host_space);
+    for (int const row : {y_range.start, y_range.stop})
+    {
+      fk::vector<P, mem_type::view> y_view(host_space.fx, row * elem_size,
+                                           (row + 1) * elem_size - 1);
+      y_view = fm::axpy(rank_space.output_row(chunk, row), y_view);
+      if (y_range.start == y_range.stop)
+      {
+        break;
+      }
+    }
+    return;
+  }
+
   fk::vector<P, mem_type::view> y_view(host_space.fx, y_range.start * elem_size,
                                        (y_range.stop + 1) * elem_size - 1);
 
@@ -281,55 +625,187 @@ void copy_chunk_outputs(PDE<P> const &pde, rank_workspace<P> &rank_space,
 template<typename P>
 void reduce_chunk(PDE<P> const &pde, rank_workspace<P> &rank_space,
                   element_chunk const &chunk)
+{
+  // every element pair in the chunk has its full set of outputs
+  std::vector<int> row_offsets(chunk.size() + 1);
+  for (int i = 0; i <= chunk.size(); ++i)
+  {
+    row_offsets[i] = chunk.pair_offset(i) * rank_space.products_per_element();
+  }
+  reduce_chunk(pde, rank_space, chunk, row_offsets);
+}
+
+// add num_segments consecutive element segments, each elem_size long, to
+// out: a contiguous inner loop per segment, vectorized
+template<typename P>
+static void add_segments(P *const out, P const *const in,
+                         int const num_segments, int const elem_size)
+{
+  for (int s = 0; s < num_segments; ++s)
+  {
+    P const *const segment = in + static_cast<int64_t>(s) * elem_size;
+#ifdef ASGARD_USE_OPENMP
+#pragma omp simd
+#endif
+    for (int k = 0; k < elem_size; ++k)
+    {
+      out[k] += segment[k];
+    }
+  }
+}
+
+template<typename P>
+void reduce_chunk(PDE<P> const &pde, rank_workspace<P> &rank_space,
+                  element_chunk const &chunk,
+                  std::vector<int> const &row_offsets)
 {
   int const elem_size = element_segment_size(pde);
+  assert(static_cast<int>(row_offsets.size()) == chunk.size() + 1);
+
+  int const first_row              = chunk.rows().start;
+  reduction_engine const reduction = rank_space.get_reduction();
+
+  // the products were added to their rows as they were computed; only the
+  // staged rows without any are left to clear. zero-copy, fx was cleared
+  // before any chunk was applied
+  if (reduction == reduction_engine::in_place)
+  {
+    std::vector<char> written(chunk.rows().stop - first_row + 1, false);
+    for (int i = 0; i < chunk.size(); ++i)
+    {
+      written[chunk.row(i) - first_row] |= row_offsets[i + 1] > row_offsets[i];
+    }
+    for (int r = 0; r < static_cast<int>(written.size()); ++r)
+    {
+      if (!written[r] && rank_space.is_staged(chunk, first_row + r))
+      {
+        fk::vector<P, mem_type::view> out =
+            rank_space.output_row(chunk, first_row + r);
+        std::fill(out.begin(), out.end(), static_cast<P>(0.0));
+      }
+    }
+    return;
+  }
 
   fm::scal(static_cast<P>(0.0), rank_space.batch_output);
-  for (auto const &[row, cols] : chunk)
+  if (reduction == reduction_engine::gemv)
   {
-    int const prev_row_elems = [i = row, &chunk] {
-      if (i == chunk.begin()->first)
+    for (int i = 0; i < chunk.size(); ++i)
+    {
+      int const first_output = row_offsets[i];
+      int const num_outputs  = row_offsets[i + 1] - first_output;
+      if (num_outputs == 0)
       {
-        return 0;
+        continue;
       }
-      int prev_elems = 0;
-      for (int r = chunk.begin()->first; r < i; ++r)
+
+      fk::matrix<P, mem_type::view> const reduction_matrix(
+          rank_space.reduction_space, elem_size, num_outputs,
+          first_output * elem_size);
+
+      fk::vector<P, mem_type::view> output_view =
+          rank_space.output_row(chunk, chunk.row(i));
+
+      fk::vector<P, mem_type::view> const unit_view(
+          rank_space.get_unit_vector(), 0, num_outputs - 1);
+
+      P const alpha     = 1.0;
+      P const beta      = 1.0;
+      bool const transA = false;
+      fm::gemv(reduction_matrix, unit_view, output_view, transA, alpha, beta);
+    }
+    return;
+  }
+
+  // a row's entries are consecutive, and so are their outputs; find the
+  // first entry of each row
+  std::vector<int> row_starts;
+  for (int i = 0; i < chunk.size(); ++i)
+  {
+    if (i == 0 || chunk.row(i) != chunk.row(i - 1))
+    {
+      row_starts.push_back(i);
+    }
+  }
+  row_starts.push_back(chunk.size());
+  int const num_rows = static_cast<int>(row_starts.size()) - 1;
+
+  P *const products = rank_space.reduction_space.data();
+  auto const product = [products, elem_size](int const p) {
+    return products + static_cast<int64_t>(p) * elem_size;
+  };
+  auto const output_row = [&](int const r) {
+    return rank_space.output_row(chunk, chunk.row(row_starts[r])).data();
+  };
+
+  // column sum: each row's products are consecutive, so are summed in one
+  // sweep down their columns. the rows write their own outputs, so are split
+  // across threads
+  if (reduction == reduction_engine::column_sum)
+  {
+#ifdef ASGARD_USE_OPENMP
+#pragma omp parallel for num_threads(lib_dispatch::get_num_threads())
+#endif
+    for (int r = 0; r < num_rows; ++r)
+    {
+      int const first = row_offsets[row_starts[r]];
+      add_segments(output_row(r), product(first),
+                   row_offsets[row_starts[r + 1]] - first, elem_size);
+    }
+    return;
+  }
+
+  // tree: halve each row's products by adding them in pairs, in place,
+  // until one is left. the rows are independent, so are split across threads
+  assert(reduction == reduction_engine::tree);
+#ifdef ASGARD_USE_OPENMP
+#pragma omp parallel for num_threads(lib_dispatch::get_num_threads())
+#endif
+  for (int r = 0; r < num_rows; ++r)
+  {
+    int const first       = row_offsets[row_starts[r]];
+    int const num_outputs = row_offsets[row_starts[r + 1]] - first;
+    if (num_outputs == 0)
+    {
+      continue;
+    }
+    for (int step = 1; step < num_outputs; step *= 2)
+    {
+      for (int p = 0; p + step < num_outputs; p += 2 * step)
       {
-        prev_elems += chunk.at(r).stop - chunk.at(r).start + 1;
+        add_segments(product(first + p), product(first + p + step), 1,
+                     elem_size);
       }
-      return prev_elems;
-    }();
-
-    fk::matrix<P, mem_type::view> const reduction_matrix(
-        rank_space.reduction_space, elem_size,
-        (cols.stop - cols.start + 1) * pde.num_terms,
-        prev_row_elems * elem_size * pde.num_terms);
-
-    int const reduction_row = row - chunk.begin()->first;
-    fk::vector<P, mem_type::view> output_view(
-        rank_space.batch_output, reduction_row * elem_size,
-        ((reduction_row + 1) * elem_size) - 1);
-
-    fk::vector<P, mem_type::view> const unit_view(
-        rank_space.get_unit_vector(), 0,
-        (cols.stop - cols.start + 1) * pde.num_terms - 1);
-
-    P const alpha     = 1.0;
-    P const beta      = 1.0;
-    bool const transA = false;
-    fm::gemv(reduction_matrix, unit_view, output_view, transA, alpha, beta);
+    }
+    add_segments(output_row(r), product(first), 1, elem_size);
   }
 }
+
 template class rank_workspace<float>;
 template class rank_workspace<double>;
 
 template class host_workspace<float>;
 template class host_workspace<double>;
 
+template double get_element_size_MB(PDE<float> const &pde,
+                                    kronmult_engine const engine);
+template double get_element_size_MB(PDE<double> const &pde,
+                                    kronmult_engine const engine);
+
 template int get_num_chunks(element_table const &table, PDE<float> const &pde,
-                            int const num_ranks, int const rank_size_MB);
+                            int const num_ranks, int const rank_size_MB,
+                            kronmult_engine const engine);
 template int get_num_chunks(element_table const &table, PDE<double> const &pde,
-                            int const num_ranks, int const rank_size_MB);
+                            int const num_ranks, int const rank_size_MB,
+                            kronmult_engine const engine);
+template int get_num_chunks(list_set const &connectivity,
+                            PDE<float> const &pde, int const num_ranks,
+                            int const rank_size_MB,
+                            kronmult_engine const engine);
+template int get_num_chunks(list_set const &connectivity,
+                            PDE<double> const &pde, int const num_ranks,
+                            int const rank_size_MB,
+                            kronmult_engine const engine);
 
 template void copy_chunk_inputs(PDE<float> const &pde,
                                 rank_workspace<float> &rank_space,
@@ -358,3 +834,13 @@ template void reduce_chunk(PDE<float> const &pde,
 template void reduce_chunk(PDE<double> const &pde,
                            rank_workspace<double> &rank_space,
                            element_chunk const &chunk);
+
+template void reduce_chunk(PDE<float> const &pde,
+                           rank_workspace<float> &rank_space,
+                           element_chunk const &chunk,
+                           std::vector<int> const &row_offsets);
+
+template void reduce_chunk(PDE<double> const &pde,
+                           rank_workspace<double> &rank_space,
+                           element_chunk const &chunk,
+                           std::vector<int> const &row_offsets);
@@ -1,7 +1,10 @@
 #pragma once
+#include "connectivity.hpp"
 #include "element_table.hpp"
 #include "pde.hpp"
 #include "tensors.hpp"
+#include <limits>
+#include <vector>
 
 struct limits
 {
@@ -16,7 +19,48 @@ struct limits
   int const stop;
 };
 
-using element_chunk = std::map<int, limits>;
+// the element pairs (row, col) assigned to a chunk. each entry is a row
+// element and a contiguous range of the column elements connected to it; a
+// row has an entry per range of its connected elements in the chunk. the
+// entries are stored flat, in row order, along with the number of pairs
+// before each, so any entry and its pairs are found in constant time
+class element_chunk
+{
+public:
+  // append an entry; rows must be added in order
+  void add(int const row, limits const &columns);
+
+  int size() const { return static_cast<int>(rows_.size()); }
+  bool empty() const { return rows_.empty(); }
+
+  int row(int const entry) const { return rows_[entry]; }
+  limits columns(int const entry) const
+  {
+    return limits(starts_[entry], stops_[entry]);
+  }
+  // number of pairs before the entry; pair_offset(size()) is the total
+  int pair_offset(int const entry) const { return pair_offsets_[entry]; }
+
+  int num_pairs() const { return pair_offsets_.back(); }
+  int max_columns() const { return max_columns_; }
+  limits rows() const;
+  limits columns() const;
+
+  bool operator==(element_chunk const &rhs) const
+  {
+    return rows_ == rhs.rows_ && starts_ == rhs.starts_ &&
+           stops_ == rhs.stops_;
+  }
+
+private:
+  std::vector<int> rows_;
+  std::vector<int> starts_;
+  std::vector<int> stops_;
+  std::vector<int> pair_offsets_ = {0};
+  int max_columns_               = 0;
+  int min_column_                = std::numeric_limits<int>::max();
+  int max_column_                = -1;
+};
 
 // convenience functions when working with element chunks
 int num_elements_in_chunk(element_chunk const &g);
@@ -25,26 +69,77 @@ int max_connected_in_chunk(element_chunk const &g);
 limits columns_in_chunk(element_chunk const &g);
 limits rows_in_chunk(element_chunk const &g);
 
+// the columns the chunk's rows touch, as sorted, disjoint ranges. the chunk's
+// inputs are gathered from these ranges, in order (see copy_chunk_inputs)
+std::vector<limits> input_ranges(element_chunk const &g);
+int num_inputs_in_chunk(element_chunk const &g);
+
 // FIXME we should eventually put this in the pde class?
 auto const element_segment_size = [](auto const &pde) {
   int const degree = pde.get_dimensions()[0].get_degree();
   return static_cast<int>(std::pow(degree, pde.num_dims));
 };
 
+// how the kronecker products * vector making up A*x are computed
+enum class kronmult_engine
+{
+  batched, // num_dims rounds of small batched gemms per term
+  stacked, // as batched, but the terms share the first and last rounds, and
+           // their products are summed; see build_stacked_batches
+  fused    // one compile time specialized kernel per product; see kronmult.hpp
+};
+
 // workspace for the primary computation in time advance. along with
 // the coefficient matrices, we need this space resident on whatever
 // accelerator we are using
+//
+// when the kronmult is done by fused kernels (see kronmult.hpp), the
+// intermediate products never leave the kernel, and batch_intermediate is
+// only scratch space for a single product. the stacked engine needs at least
+// two dimensions, and writes a single output per connected element rather
+// than one per term.
+//
+// given the host workspace, the chunks are staged zero-copy, for when the
+// workspace is in host memory too: the products read host->x directly, and
+// a chunk's rows are summed straight into host->fx. only a chunk's first and
+// last rows, which the chunks before and after it may share, are summed into
+// the batch output - its first and second row - to be added to fx after.
+// there is no batch input, and chunks' interior rows must not be shared.
+template<typename P>
+class host_workspace;
+
 template<typename P>
 class rank_workspace
 {
 public:
-  rank_workspace(PDE<P> const &pde, std::vector<element_chunk> const &chunks);
+  rank_workspace(PDE<P> const &pde, std::vector<element_chunk> const &chunks,
+                 kronmult_engine const engine = kronmult_engine::batched,
+                 reduction_engine const reduction = reduction_engine::gemv,
+                 host_workspace<P> *const host = nullptr);
   fk::vector<P> const &get_unit_vector() const;
+  kronmult_engine get_engine() const { return engine_; }
+  reduction_engine get_reduction() const { return reduction_; }
+  bool is_zero_copy() const { return host_ != nullptr; }
+  host_workspace<P> *get_host() const { return host_; }
+  // what the products read their inputs from: the batch input, or x
+  fk::vector<P> const &get_input() const;
+  // where the products for one of the chunk's rows are summed: that row of
+  // the batch output or, zero-copy, its staged row or fx itself
+  fk::vector<P, mem_type::view>
+  output_row(element_chunk const &chunk, int const row) const;
+  // whether the chunk's row is summed into the batch output, to be added to
+  // fx after
+  bool is_staged(element_chunk const &chunk, int const row) const;
+  // outputs each connected element writes to the reduction space
+  int products_per_element() const { return products_per_element_; }
   // input, output, workspace for batched gemm/reduction
   fk::vector<P> batch_input;
   fk::vector<P> reduction_space;
   fk::vector<P> batch_intermediate;
   fk::vector<P> batch_output;
+  // pointer lists compact batches are expanded into by batched_gemm, kept
+  // between calls so that replaying a plan doesn't allocate
+  std::vector<P *> gemm_lists;
   double size_MB() const
   {
     int64_t num_elems = batch_input.size() + reduction_space.size() +
@@ -57,6 +152,11 @@ public:
 
 private:
   fk::vector<P> unit_vector_;
+  kronmult_engine engine_;
+  reduction_engine reduction_;
+  int products_per_element_;
+  host_workspace<P> *host_;
+  int elem_size_;
 };
 
 // larger, host-side memory space holding the entire input/output vectors.
@@ -67,35 +167,92 @@ template<typename P>
 class host_workspace
 {
 public:
-  host_workspace(PDE<P> const &pde, element_table const &table);
-  // working vectors for time advance (e.g. intermediate RK result vects,
-  // source vector space)
-  fk::vector<P> scaled_source;
+  // implicit and exponential schemes keep a krylov basis of
+  // krylov_dimension + 1 vectors
+  host_workspace(PDE<P> const &pde, element_table const &table,
+                 time_scheme const scheme   = time_scheme::rk3,
+                 int const krylov_dimension = 20);
+  time_scheme get_scheme() const { return scheme_; }
+  // working vectors for time advance. the registers the scheme doesn't keep
+  // (see explicit_step in time_advance.hpp) are left empty
   fk::vector<P> x_orig;
   fk::vector<P> x;
   fk::vector<P> fx;
   fk::vector<P> result_1;
   fk::vector<P> result_2;
-  fk::vector<P> result_3;
+  // whether result_1 holds the derivative at x, left by the last bs23 step
+  // for the next to start from. clear it when changing x
+  bool has_derivative = false;
+  std::vector<fk::vector<P>> krylov_basis;
+  // a ring of the right-hand sides at the starts of the last multistep
+  // steps, the newest at derivatives[newest_derivative], and how many are
+  // known. clear num_derivatives when changing x or the step size
+  std::vector<fk::vector<P>> derivatives;
+  int newest_derivative = 0;
+  int num_derivatives   = 0;
 
   double size_MB() const
   {
-    int64_t num_elems = scaled_source.size() + x_orig.size() + fx.size() +
-                        x.size() + result_1.size() + result_2.size() +
-                        result_3.size();
+    int64_t num_elems = x_orig.size() + fx.size() + x.size() +
+                        result_1.size() + result_2.size();
+    for (auto const *const vectors : {&krylov_basis, &derivatives})
+    {
+      for (fk::vector<P> const &vector : *vectors)
+      {
+        num_elems += vector.size();
+      }
+    }
     double const bytes     = static_cast<double>(num_elems) * sizeof(P);
     double const megabytes = bytes * 1e-6;
     return megabytes;
   };
+
+private:
+  time_scheme scheme_;
 };
 
-// functions to assign chunks
+// workspace needed for a single element pair's products
+template<typename P>
+double get_element_size_MB(PDE<P> const &pde,
+                           kronmult_engine const engine =
+                               kronmult_engine::batched);
+
+// functions to assign chunks. the overloads taking the element table assume
+// every element is connected to every other; those taking connectivity
+// lists (see make_connectivity - each element's connected elements, sorted)
+// only size and assign the pairs listed
 template<typename P>
 int get_num_chunks(element_table const &table, PDE<P> const &pde,
-                   int const num_ranks = 1, int const rank_size_MB = 1000);
+                   int const num_ranks = 1, int const rank_size_MB = 1000,
+                   kronmult_engine const engine = kronmult_engine::batched);
+template<typename P>
+int get_num_chunks(list_set const &connectivity, PDE<P> const &pde,
+                   int const num_ranks = 1, int const rank_size_MB = 1000,
+                   kronmult_engine const engine = kronmult_engine::batched);
 
 std::vector<element_chunk>
 assign_elements(element_table const &table, int const num_chunks);
+std::vector<element_chunk>
+assign_elements(list_set const &connectivity, int const num_chunks);
+
+// a cost for each listed element pair, row by row, parallel to the
+// connectivity lists (see block_structure::pair_costs)
+using cost_model = std::vector<std::vector<double>>;
+
+// divide the listed pairs, in the same order, into chunks of about equal
+// cost rather than equal numbers of pairs. no chunk takes more than
+// max_pairs pairs - so its workspace stays in budget - unless max_pairs is 0
+std::vector<element_chunk>
+assign_elements(list_set const &connectivity, cost_model const &costs,
+                int const num_chunks, int64_t const max_pairs = 0);
+
+// each chunk's cost under the model; the chunks must hold listed pairs only
+std::vector<double> chunk_costs(std::vector<element_chunk> const &chunks,
+                                list_set const &connectivity,
+                                cost_model const &costs);
+
+// the largest of the loads over their mean; 1 is perfectly balanced
+double load_imbalance(std::vector<double> const &loads);
 
 // data management functions
 template<typename P>
@@ -113,12 +270,36 @@ template<typename P>
 void reduce_chunk(PDE<P> const &pde, rank_workspace<P> &rank_space,
                   element_chunk const &chunk);
 
+// reduce a chunk whose outputs are packed by entry, for when some element
+// pairs' products were dropped: the outputs for the chunk's r-th entry are
+// products row_offsets[r] through row_offsets[r + 1] - 1 of the reduction
+// space. the products are summed by the workspace's reduction engine
+template<typename P>
+void reduce_chunk(PDE<P> const &pde, rank_workspace<P> &rank_space,
+                  element_chunk const &chunk,
+                  std::vector<int> const &row_offsets);
+
+extern template double get_element_size_MB(PDE<float> const &pde,
+                                           kronmult_engine const engine);
+extern template double get_element_size_MB(PDE<double> const &pde,
+                                           kronmult_engine const engine);
+
 extern template int get_num_chunks(element_table const &table,
                                    PDE<float> const &pde, int const num_ranks,
-                                   int const rank_size_MB);
+                                   int const rank_size_MB,
+                                   kronmult_engine const engine);
 extern template int get_num_chunks(element_table const &table,
                                    PDE<double> const &pde, int const num_ranks,
-                                   int const rank_size_MB);
+                                   int const rank_size_MB,
+                                   kronmult_engine const engine);
+extern template int get_num_chunks(list_set const &connectivity,
+                                   PDE<float> const &pde, int const num_ranks,
+                                   int const rank_size_MB,
+                                   kronmult_engine const engine);
+extern template int get_num_chunks(list_set const &connectivity,
+                                   PDE<double> const &pde, int const num_ranks,
+                                   int const rank_size_MB,
+                                   kronmult_engine const engine);
 
 extern template void copy_chunk_inputs(PDE<float> const &pde,
                                        rank_workspace<float> &rank_space,
@@ -147,3 +328,13 @@ extern template void reduce_chunk(PDE<float> const &pde,
 extern template void reduce_chunk(PDE<double> const &pde,
                                   rank_workspace<double> &rank_space,
                                   element_chunk const &chunk);
+
+extern template void reduce_chunk(PDE<float> const &pde,
+                                  rank_workspace<float> &rank_space,
+                                  element_chunk const &chunk,
+                                  std::vector<int> const &row_offsets);
+
+extern template void reduce_chunk(PDE<double> const &pde,
+                                  rank_workspace<double> &rank_space,
+                                  element_chunk const &chunk,
+                                  std::vector<int> const &row_offsets);
@@ -1,6 +1,7 @@
 
 #include "chunk.hpp"
 #include "tests_general.hpp"
+#include <numeric>
 
 // check for complete, non-overlapping element assignment
 auto const validity_check = [](std::vector<element_chunk> const &chunks,
@@ -16,8 +17,10 @@ auto const validity_check = [](std::vector<element_chunk> const &chunks,
   // non-overlapping check
   for (element_chunk const &chunk : chunks)
   {
-    for (const auto &[row, cols] : chunk)
+    for (int i = 0; i < chunk.size(); ++i)
     {
+      int const row     = chunk.row(i);
+      limits const cols = chunk.columns(i);
       for (int col = cols.start; col <= cols.stop; ++col)
       {
         REQUIRE(coverage(row, col) == element_status::unassigned);
@@ -61,15 +64,15 @@ TEST_CASE("chunk convenience functions", "[chunk]")
   SECTION("elements in chunk - single row")
   {
     element_chunk g;
-    g.insert({2, limits(0, 4)});
+    g.add(2, limits(0, 4));
     assert(num_elements_in_chunk(g) == 5);
   }
 
   SECTION("elements in chunk - multiple rows")
   {
     element_chunk g;
-    g.insert({3, limits(1, 2)});
-    g.insert({4, limits(5, 10)});
+    g.add(3, limits(1, 2));
+    g.add(4, limits(5, 10));
     assert(num_elements_in_chunk(g) == 8);
   }
 
@@ -81,43 +84,85 @@ TEST_CASE("chunk convenience functions", "[chunk]")
   SECTION("max connected in chunk - single row")
   {
     element_chunk g;
-    g.insert({2, limits(0, 4)});
+    g.add(2, limits(0, 4));
     assert(max_connected_in_chunk(g) == 5);
   }
   SECTION("max connected in chunk - multiple rows")
   {
     element_chunk g;
-    g.insert({3, limits(1, 2)});
-    g.insert({4, limits(5, 10)});
+    g.add(3, limits(1, 2));
+    g.add(4, limits(5, 10));
     assert(max_connected_in_chunk(g) == 6);
   }
 
   SECTION("columns in chunk - single row")
   {
     element_chunk g;
-    g.insert({2, limits(0, 4)});
+    g.add(2, limits(0, 4));
     assert(columns_in_chunk(g) == limits(0, 4));
   }
 
   SECTION("columns in chunk - multiple rows")
   {
     element_chunk g;
-    g.insert({3, limits(1, 2)});
-    g.insert({4, limits(5, 10)});
+    g.add(3, limits(1, 2));
+    g.add(4, limits(5, 10));
     assert(columns_in_chunk(g) == limits(1, 10));
   }
 
+  SECTION("input ranges - single row")
+  {
+    element_chunk g;
+    g.add(2, limits(1, 5));
+    std::vector<limits> const ranges = input_ranges(g);
+    REQUIRE(ranges.size() == 1);
+    REQUIRE(ranges[0] == limits(1, 5));
+    REQUIRE(num_inputs_in_chunk(g) == 5);
+  }
+  SECTION("input ranges - multiple rows")
+  {
+    element_chunk g;
+    g.add(2, limits(8, 10));
+    g.add(3, limits(0, 2));
+    g.add(4, limits(3, 4));
+    g.add(5, limits(1, 3));
+    std::vector<limits> const ranges = input_ranges(g);
+    REQUIRE(ranges.size() == 2);
+    REQUIRE(ranges[0] == limits(0, 4));
+    REQUIRE(ranges[1] == limits(8, 10));
+    REQUIRE(num_inputs_in_chunk(g) == 8);
+  }
   SECTION("rows in chunk - single row")
   {
     element_chunk g;
-    g.insert({2, limits(0, 4)});
+    g.add(2, limits(0, 4));
     assert(rows_in_chunk(g) == limits(2, 2));
   }
+  SECTION("entries and pair offsets")
+  {
+    element_chunk g;
+    g.add(3, limits(1, 2));
+    g.add(3, limits(5, 7));
+    g.add(6, limits(0, 0));
+    REQUIRE(g.size() == 3);
+    REQUIRE(g.row(1) == 3);
+    REQUIRE(g.columns(1) == limits(5, 7));
+    REQUIRE(g.row(2) == 6);
+    std::vector<int> const gold = {0, 2, 5, 6};
+    for (int i = 0; i <= g.size(); ++i)
+    {
+      REQUIRE(g.pair_offset(i) == gold[i]);
+    }
+    REQUIRE(num_elements_in_chunk(g) == 6);
+    REQUIRE(max_connected_in_chunk(g) == 3);
+    REQUIRE(rows_in_chunk(g) == limits(3, 6));
+    REQUIRE(columns_in_chunk(g) == limits(0, 7));
+  }
   SECTION("rows in chunk - multiple rows")
   {
     element_chunk g;
-    g.insert({3, limits(1, 2)});
-    g.insert({4, limits(5, 10)});
+    g.add(3, limits(1, 2));
+    g.add(4, limits(5, 10));
     assert(rows_in_chunk(g) == limits(3, 4));
   }
 }
@@ -390,17 +435,240 @@ TEST_CASE("element chunk, continuity 6", "[chunk]")
   }
 }
 
+TEST_CASE("element chunk, connectivity lists", "[chunk]")
+{
+  SECTION("banded connectivity, with an unconnected row")
+  {
+    int const num_elems = 40;
+    int const last_row  = num_elems - 1;
+    auto const is_connected = [last_row](int const row, int const col) {
+      return row != last_row && (std::abs(row - col) <= 2 || col == 0);
+    };
+    list_set connectivity;
+    for (int row = 0; row < num_elems; ++row)
+    {
+      std::vector<int> connected;
+      for (int col = 0; col < num_elems; ++col)
+      {
+        if (is_connected(row, col))
+        {
+          connected.push_back(col);
+        }
+      }
+      connectivity.push_back(fk::vector<int>(connected));
+    }
+
+    for (int num_chunks = 1; num_chunks <= 9; num_chunks += 4)
+    {
+      auto const chunks = assign_elements(connectivity, num_chunks);
+      REQUIRE(static_cast<int>(chunks.size()) == num_chunks);
+
+      // every connected pair is assigned once, and nothing else
+      fk::matrix<int> coverage(num_elems, num_elems);
+      int max_elems = 0;
+      int min_elems = num_elems * num_elems;
+      for (element_chunk const &chunk : chunks)
+      {
+        for (int i = 0; i < chunk.size(); ++i)
+        {
+          int const row     = chunk.row(i);
+          limits const cols = chunk.columns(i);
+          for (int col = cols.start; col <= cols.stop; ++col)
+          {
+            REQUIRE(coverage(row, col) == 0);
+            coverage(row, col) = 1;
+          }
+        }
+        max_elems = std::max(max_elems, num_elements_in_chunk(chunk));
+        min_elems = std::min(min_elems, num_elements_in_chunk(chunk));
+      }
+      REQUIRE(max_elems - min_elems <= 1);
+      for (int i = 0; i < num_elems; ++i)
+      {
+        for (int j = 0; j < num_elems; ++j)
+        {
+          REQUIRE(coverage(i, j) == (is_connected(i, j) ? 1 : 0));
+        }
+      }
+    }
+  }
+
+  SECTION("make_connectivity, continuity 3, deg 3, level 4")
+  {
+    int const degree = 3;
+    int const level  = 4;
+    int const ranks  = 2;
+
+    auto const pde = make_PDE<double>(PDE_opts::continuity_3, level, degree);
+    options const o = make_options(
+        {"-l", std::to_string(level), "-d", std::to_string(degree)});
+    element_table const table(o, pde->num_dims);
+    list_set const connectivity =
+        make_connectivity(table, pde->num_dims, level, level);
+
+    int64_t num_connected = 0;
+    for (fk::vector<int> const &connected : connectivity)
+    {
+      num_connected += connected.size();
+    }
+    // the sparse pattern is what the workspaces are sized by
+    REQUIRE(num_connected < static_cast<int64_t>(table.size()) * table.size());
+
+    for (int limit_MB = 1; limit_MB <= 100; limit_MB *= 10)
+    {
+      int const num_chunks =
+          get_num_chunks(connectivity, *pde, ranks, limit_MB);
+      REQUIRE(num_chunks <= get_num_chunks(table, *pde, ranks, limit_MB));
+      auto const chunks = assign_elements(connectivity, num_chunks);
+      REQUIRE(static_cast<int>(chunks.size()) == num_chunks);
+
+      int64_t num_assigned = 0;
+      for (element_chunk const &chunk : chunks)
+      {
+        num_assigned += num_elements_in_chunk(chunk);
+        for (int i = 0; i < chunk.size(); ++i)
+        {
+          limits const cols                = chunk.columns(i);
+          fk::vector<int> const &connected = connectivity[chunk.row(i)];
+          for (int col = cols.start; col <= cols.stop; ++col)
+          {
+            REQUIRE(std::binary_search(connected.begin(), connected.end(),
+                                       col));
+          }
+        }
+      }
+      REQUIRE(num_assigned == num_connected);
+      size_check(chunks, *pde, limit_MB, false);
+    }
+  }
+
+  SECTION("balanced by cost")
+  {
+    // the first rows' pairs cost ten times the rest
+    int const num_elems = 30;
+    list_set connectivity;
+    cost_model costs;
+    for (int row = 0; row < num_elems; ++row)
+    {
+      std::vector<int> connected;
+      int const last = std::min(num_elems - 1, row + 3);
+      for (int col = std::max(0, row - 3); col <= last; ++col)
+      {
+        connected.push_back(col);
+      }
+      costs.push_back(std::vector<double>(connected.size(),
+                                          row < num_elems / 3 ? 10.0 : 1.0));
+      connectivity.push_back(fk::vector<int>(connected));
+    }
+    int64_t num_pairs = 0;
+    double total_cost = 0.0;
+    for (int row = 0; row < num_elems; ++row)
+    {
+      num_pairs += connectivity[row].size();
+      total_cost +=
+          std::accumulate(costs[row].begin(), costs[row].end(), 0.0);
+    }
+
+    // every pair is assigned once, in order
+    auto const check_order = [&](std::vector<element_chunk> const &chunks) {
+      std::vector<std::pair<int, int>> pairs;
+      for (element_chunk const &chunk : chunks)
+      {
+        REQUIRE(!chunk.empty());
+        for (int i = 0; i < chunk.size(); ++i)
+        {
+          for (int col = chunk.columns(i).start; col <= chunk.columns(i).stop;
+               ++col)
+          {
+            pairs.emplace_back(chunk.row(i), col);
+          }
+        }
+      }
+      std::vector<std::pair<int, int>> listed;
+      for (int row = 0; row < num_elems; ++row)
+      {
+        for (int const col : connectivity[row])
+        {
+          listed.emplace_back(row, col);
+        }
+      }
+      REQUIRE(pairs == listed);
+    };
+
+    for (int const num_chunks : {1, 4, 7})
+    {
+      auto const by_count = assign_elements(connectivity, num_chunks);
+      auto const by_cost  = assign_elements(connectivity, costs, num_chunks);
+      REQUIRE(static_cast<int>(by_cost.size()) == num_chunks);
+      check_order(by_cost);
+
+      std::vector<double> const cost =
+          chunk_costs(by_cost, connectivity, costs);
+      REQUIRE(std::abs(std::accumulate(cost.begin(), cost.end(), 0.0) -
+                       total_cost) < 1e-9);
+      double const imbalance = load_imbalance(cost);
+      REQUIRE(imbalance >= 1.0);
+      REQUIRE(imbalance <=
+              load_imbalance(chunk_costs(by_count, connectivity, costs)));
+      // no chunk is further from its share than the costliest pair
+      REQUIRE(*std::max_element(cost.begin(), cost.end()) <=
+              total_cost / num_chunks + 10.0);
+
+      // with equal costs, the split is by count
+      cost_model flat(costs);
+      for (std::vector<double> &row_costs : flat)
+      {
+        std::fill(row_costs.begin(), row_costs.end(), 2.0);
+      }
+      auto const by_flat = assign_elements(connectivity, flat, num_chunks);
+      REQUIRE(by_flat.size() == by_count.size());
+      for (element_chunk const &chunk : by_flat)
+      {
+        REQUIRE(num_elements_in_chunk(chunk) >= num_pairs / num_chunks);
+        REQUIRE(num_elements_in_chunk(chunk) <=
+                (num_pairs + num_chunks - 1) / num_chunks);
+      }
+    }
+
+    // the pair limit is kept, at the cost of balance
+    int const num_chunks    = 5;
+    int64_t const max_pairs = (num_pairs + num_chunks - 1) / num_chunks;
+    auto const limited =
+        assign_elements(connectivity, costs, num_chunks, max_pairs);
+    check_order(limited);
+    for (element_chunk const &chunk : limited)
+    {
+      REQUIRE(num_elements_in_chunk(chunk) <= max_pairs);
+    }
+
+    // fewer pairs than chunks
+    list_set const two = {fk::vector<int>{0, 1}, fk::vector<int>()};
+    cost_model const two_costs = {{1.0, 5.0}, {}};
+    REQUIRE(assign_elements(two, two_costs, 3).size() == 2);
+  }
+}
+
+TEST_CASE("load imbalance", "[chunk]")
+{
+  REQUIRE(load_imbalance({2.0, 2.0, 2.0}) == 1.0);
+  REQUIRE(load_imbalance({1.0, 3.0}) == 1.5);
+  REQUIRE(load_imbalance({0.0, 0.0}) == 1.0);
+}
+
 auto const test_copy_in = [](PDE<double> const &pde, element_chunk const &chunk,
                              rank_workspace<double> const &rank_space,
                              host_workspace<double> const &host_space) {
-  int const elem_size  = element_segment_size(pde);
-  auto const x_range   = columns_in_chunk(chunk);
-  auto const num_elems = (x_range.stop - x_range.start + 1) * elem_size;
-
-  for (int i = 0; i < num_elems; ++i)
+  int const elem_size = element_segment_size(pde);
+  int input_start     = 0;
+  for (limits const &x_range : input_ranges(chunk))
   {
-    REQUIRE(rank_space.batch_input(i) ==
-            host_space.x(i + x_range.start * elem_size));
+    auto const num_elems = (x_range.stop - x_range.start + 1) * elem_size;
+    for (int i = 0; i < num_elems; ++i)
+    {
+      REQUIRE(rank_space.batch_input(input_start + i) ==
+              host_space.x(i + x_range.start * elem_size));
+    }
+    input_start += num_elems;
   }
 };
 
@@ -645,21 +913,11 @@ auto const test_reduction = [](PDE<double> const &pde,
   auto const x_range  = columns_in_chunk(chunk);
 
   fk::vector<double> total_sum(rank_space.batch_output.size());
-  for (auto const &[row, cols] : chunk)
+  for (int r = 0; r < chunk.size(); ++r)
   {
-    int const prev_row_elems = [i = row, &chunk] {
-      if (i == chunk.begin()->first)
-      {
-        return 0;
-      }
-      int prev_elems = 0;
-      for (int r = chunk.begin()->first; r < i; ++r)
-      {
-        prev_elems += chunk.at(r).stop - chunk.at(r).start + 1;
-      }
-      return prev_elems;
-    }();
-    int const reduction_offset = prev_row_elems * pde.num_terms * elem_size;
+    limits const cols = chunk.columns(r);
+    int const reduction_offset =
+        chunk.pair_offset(r) * pde.num_terms * elem_size;
     fk::matrix<double, mem_type::view> const reduction_matrix(
         rank_space.reduction_space, elem_size,
         (cols.stop - cols.start + 1) * pde.num_terms, reduction_offset);
@@ -670,7 +928,7 @@ auto const test_reduction = [](PDE<double> const &pde,
       for (int j = 0; j < reduction_matrix.ncols(); ++j)
         sum(i) += reduction_matrix(i, j);
     }
-    int const row_this_task = row - chunk.begin()->first;
+    int const row_this_task = chunk.row(r) - rows_in_chunk(chunk).start;
     fk::vector<double, mem_type::view> partial_sum(
         total_sum, row_this_task * elem_size,
         (row_this_task + 1) * elem_size - 1);
@@ -802,3 +1060,86 @@ TEST_CASE("chunk reduction function", "[chunk]")
     }
   }
 }
+
+TEMPLATE_TEST_CASE("chunk reduction engines", "[chunk]", float, double)
+{
+  std::random_device rd;
+  std::mt19937 mersenne_engine(rd());
+  std::uniform_real_distribution<TestType> dist(-3.0, 3.0);
+  auto gen = [&dist, &mersenne_engine]() { return dist(mersenne_engine); };
+
+  int const degree = 2;
+  int const level  = 2;
+  auto const pde = make_PDE<TestType>(PDE_opts::continuity_2, level, degree);
+  int const elem_size = element_segment_size(*pde);
+
+  // row 1 has no entries, and row 3's only entry has had all of its
+  // products dropped
+  element_chunk chunk;
+  chunk.add(0, limits(0, 2));
+  chunk.add(0, limits(5, 5));
+  chunk.add(2, limits(1, 3));
+  chunk.add(3, limits(0, 0));
+  std::vector<int> const row_offsets = {0, 4, 5, 11, 11};
+  std::vector<element_chunk> const chunks = {chunk};
+  int const num_rows = 4;
+
+  // each row's products, summed in order
+  auto const sum_rows = [&](fk::vector<TestType> const &products) {
+    fk::vector<TestType> sums(num_rows * elem_size);
+    for (int i = 0; i < chunk.size(); ++i)
+    {
+      for (int p = row_offsets[i]; p < row_offsets[i + 1]; ++p)
+      {
+        for (int k = 0; k < elem_size; ++k)
+        {
+          sums(chunk.row(i) * elem_size + k) += products(p * elem_size + k);
+        }
+      }
+    }
+    return sums;
+  };
+
+  for (reduction_engine const reduction :
+       {reduction_engine::gemv, reduction_engine::column_sum,
+        reduction_engine::tree})
+  {
+    rank_workspace<TestType> rank_space(*pde, chunks,
+                                        kronmult_engine::batched, reduction);
+    REQUIRE(rank_space.get_reduction() == reduction);
+    REQUIRE((rank_space.get_unit_vector().size() == 0) ==
+            (reduction != reduction_engine::gemv));
+    std::generate(rank_space.reduction_space.begin(),
+                  rank_space.reduction_space.end(), gen);
+    std::generate(rank_space.batch_output.begin(),
+                  rank_space.batch_output.end(), gen);
+    fk::vector<TestType> const gold = sum_rows(rank_space.reduction_space);
+
+    reduce_chunk(*pde, rank_space, chunk, row_offsets);
+    TestType const tol = std::numeric_limits<TestType>::epsilon() * 1e2;
+    for (int i = 0; i < gold.size(); ++i)
+    {
+      REQUIRE(std::abs(rank_space.batch_output(i) - gold(i)) <= tol);
+    }
+  }
+
+  // reduced in place, the products are already in the output; only the rows
+  // without any are cleared
+  rank_workspace<TestType> rank_space(*pde, chunks, kronmult_engine::fused,
+                                      reduction_engine::in_place);
+  REQUIRE(rank_space.reduction_space.size() == 0);
+  std::generate(rank_space.batch_output.begin(), rank_space.batch_output.end(),
+                gen);
+  fk::vector<TestType> const before(rank_space.batch_output);
+  reduce_chunk(*pde, rank_space, chunk, row_offsets);
+  for (int row = 0; row < num_rows; ++row)
+  {
+    bool const has_products = row == 0 || row == 2;
+    for (int k = 0; k < elem_size; ++k)
+    {
+      int const i = row * elem_size + k;
+      REQUIRE(rank_space.batch_output(i) ==
+              (has_products ? before(i) : static_cast<TestType>(0.0)));
+    }
+  }
+}
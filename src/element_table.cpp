@@ -4,12 +4,42 @@
 #include "matlab_utilities.hpp"
 #include "program_options.hpp"
 #include "tensors.hpp"
+#include <algorithm>
 #include <cmath>
 #include <functional>
 #include <map>
 #include <numeric>
 #include <vector>
 
+// the z-order of an element, keyed (levels, cells): each dimension's cell
+// center, in units of half the finest cell, interleaved bit by bit. if the
+// centers' bits don't all fit, the finest are dropped
+static uint64_t morton_code(fk::vector<int> const &key, int const num_dims,
+                            int const num_levels)
+{
+  int const num_bits = std::min(num_levels + 1, 64 / num_dims);
+  int const dropped  = num_levels + 1 - num_bits;
+
+  std::vector<uint64_t> centers(num_dims);
+  for (int d = 0; d < num_dims; ++d)
+  {
+    int const level = std::max(0, key(d) - 1);
+    uint64_t const center = static_cast<uint64_t>(2 * key(num_dims + d) + 1)
+                            << (num_levels - level);
+    centers[d] = center >> dropped;
+  }
+
+  uint64_t code = 0;
+  for (int bit = num_bits - 1; bit >= 0; --bit)
+  {
+    for (int d = 0; d < num_dims; ++d)
+    {
+      code = (code << 1) | ((centers[d] >> bit) & 1);
+    }
+  }
+  return code;
+}
+
 // Construct forward and reverse element tables
 element_table::element_table(options const program_opts, int const num_dims)
 {
@@ -32,8 +62,8 @@ element_table::element_table(options const program_opts, int const num_dims)
   // to explore the thread-safety of our tables / build a thread-safe
   // table to see any benefit. -TM
 
-  // build the element tables (forward and reverse)
-  int index = 0;
+  // build the element coordinates, in permutation order
+  std::vector<fk::vector<int>> keys;
   for (int row = 0; row < perm_table.nrows(); ++row)
   {
     // get the level tuple to work on
@@ -51,13 +81,55 @@ element_table::element_table(options const program_opts, int const num_dims)
       // (level-1, ..., level-d, cell-1, ... cell-d)
       fk::vector<int> key = level_tuple;
       key.concat(cell_indices);
+      keys.push_back(key);
+    }
+  }
 
-      forward_table[key] = index++;
-      // note the matlab code has an option to append 1d cell indices to the
-      // reverse element table. //FIXME do we need to precompute or can we call
-      // the 1d helper as needed?
-      reverse_table.push_back(key);
+  // renumber them, if asked; ties keep permutation order
+  std::vector<int> order(keys.size());
+  std::iota(order.begin(), order.end(), 0);
+  auto const reorder = [&order](auto const &sort_keys) {
+    std::stable_sort(order.begin(), order.end(),
+                     [&sort_keys](int const a, int const b) {
+                       return sort_keys[a] < sort_keys[b];
+                     });
+  };
+  switch (program_opts.get_element_ordering())
+  {
+  case element_ordering::permutation:
+    break;
+  case element_ordering::levels:
+  {
+    std::vector<int> level_sums(keys.size());
+    for (int i = 0; i < static_cast<int>(keys.size()); ++i)
+    {
+      level_sums[i] =
+          std::accumulate(keys[i].begin(), keys[i].begin() + num_dims, 0);
     }
+    reorder(level_sums);
+    break;
+  }
+  case element_ordering::morton:
+  {
+    std::vector<uint64_t> codes(keys.size());
+    for (int i = 0; i < static_cast<int>(keys.size()); ++i)
+    {
+      codes[i] = morton_code(keys[i], num_dims, num_levels);
+    }
+    reorder(codes);
+    break;
+  }
+  }
+
+  // build the element tables (forward and reverse)
+  for (int index = 0; index < static_cast<int>(order.size()); ++index)
+  {
+    fk::vector<int> const &key = keys[order[index]];
+    forward_table[key]         = index;
+    // note the matlab code has an option to append 1d cell indices to the
+    // reverse element table. //FIXME do we need to precompute or can we call
+    // the 1d helper as needed?
+    reverse_table.push_back(key);
   }
   assert(forward_table.size() == reverse_table.size());
 }
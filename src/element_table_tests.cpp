@@ -1,5 +1,6 @@
 #include "element_table.hpp"
 
+#include "fast_math.hpp"
 #include "matlab_utilities.hpp"
 #include "tests_general.hpp"
 #include <string>
@@ -92,3 +93,67 @@ TEST_CASE("Static helper - cell builder", "[element_table]")
     }
   }
 }
+
+TEST_CASE("element table orderings", "[element_table]")
+{
+  int const levels = 4;
+  int const dims   = 2;
+  element_table const permuted(make_options({"-l", std::to_string(levels)}),
+                               dims);
+
+  // every ordering numbers the same elements, one to one
+  auto const same_elements = [&permuted](element_table const &t) {
+    REQUIRE(t.size() == permuted.size());
+    for (int i = 0; i < t.size(); ++i)
+    {
+      fk::vector<int> const coords = t.get_coords(i);
+      REQUIRE(t.get_index(coords) == i);
+      REQUIRE(permuted.get_coords(permuted.get_index(coords)) == coords);
+    }
+  };
+
+  SECTION("level blocks")
+  {
+    element_table const t(
+        make_options({"-l", std::to_string(levels), "-o", "levels"}), dims);
+    same_elements(t);
+    auto const level_sum = [](fk::vector<int> const &coords) {
+      return coords(0) + coords(1);
+    };
+    for (int i = 1; i < t.size(); ++i)
+    {
+      REQUIRE(level_sum(t.get_coords(i - 1)) <= level_sum(t.get_coords(i)));
+    }
+  }
+
+  // an element's cell center in dimension d, as a fraction of the domain
+  auto const center = [](fk::vector<int> const &coords, int const num_dims,
+                         int const d) {
+    int const num_cells = fm::two_raised_to(std::max(0, coords(d) - 1));
+    return (coords(num_dims + d) + 0.5) / num_cells;
+  };
+
+  SECTION("morton")
+  {
+    element_table const t(
+        make_options({"-l", std::to_string(levels), "-o", "morton"}), dims);
+    same_elements(t);
+    // z-order starts in the quadrant at the origin and ends in the far one
+    for (int d = 0; d < dims; ++d)
+    {
+      REQUIRE(center(t.get_coords(0), dims, d) < 0.5);
+      REQUIRE(center(t.get_coords(t.size() - 1), dims, d) > 0.5);
+    }
+  }
+
+  SECTION("morton, 1d, orders cells by center")
+  {
+    element_table const t(
+        make_options({"-l", std::to_string(levels), "-o", "morton"}), 1);
+    for (int i = 1; i < t.size(); ++i)
+    {
+      REQUIRE(center(t.get_coords(i - 1), 1, 0) <=
+              center(t.get_coords(i), 1, 0));
+    }
+  }
+}
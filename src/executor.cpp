@@ -0,0 +1,332 @@
+#include "executor.hpp"
+#include "fast_math.hpp"
+#include <atomic>
+#include <chrono>
+#include <numeric>
+
+#ifdef ASGARD_USE_OPENMP
+#include <omp.h>
+#endif
+
+// stage inputs, compute, reduce and write outputs
+static int constexpr num_pipeline_stages = 3;
+
+int available_workers(int const num_workers)
+{
+#ifdef ASGARD_USE_OPENMP
+  return num_workers > 0 ? num_workers : omp_get_max_threads();
+#else
+  ignore(num_workers);
+  return 1;
+#endif
+}
+
+template<typename P>
+chunk_executor<P>::chunk_executor(PDE<P> const &pde,
+                                  std::vector<element_chunk> const &chunks,
+                                  rank_workspace<P> const &rank_space,
+                                  int const num_workers,
+                                  chunk_schedule const schedule)
+    : schedule_(schedule)
+{
+  assert(chunks.size() > 0);
+  int const num_chunks = static_cast<int>(chunks.size());
+  num_workers_         = std::min(available_workers(num_workers), num_chunks);
+
+  int const num_workspaces = schedule == chunk_schedule::pipelined
+                                 ? std::min(2, num_chunks)
+                                 : num_workers_;
+  if (schedule == chunk_schedule::pipelined)
+  {
+    num_workers_ = std::min(num_workers_, num_pipeline_stages);
+  }
+  workspaces_.reserve(num_workspaces - 1);
+  for (int w = 1; w < num_workspaces; ++w)
+  {
+    workspaces_.emplace_back(pde, chunks, rank_space.get_engine(),
+                             rank_space.get_reduction(), rank_space.get_host());
+  }
+
+  // count the chunks spanning each row
+  int num_rows = 0;
+  for (element_chunk const &chunk : chunks)
+  {
+    num_rows = std::max(num_rows, rows_in_chunk(chunk).stop + 1);
+  }
+  std::vector<int> coverage(num_rows + 1, 0);
+  for (element_chunk const &chunk : chunks)
+  {
+    limits const rows = rows_in_chunk(chunk);
+    ++coverage[rows.start];
+    --coverage[rows.stop + 1];
+  }
+  std::partial_sum(coverage.begin(), coverage.end(), coverage.begin());
+
+  int const elem_size = element_segment_size(pde);
+  for (element_chunk const &chunk : chunks)
+  {
+    limits const rows = rows_in_chunk(chunk);
+    std::vector<int> shared;
+    for (int row = rows.start; row <= rows.stop; ++row)
+    {
+      if (coverage[row] > 1)
+      {
+        // zero-copy, chunks only stage their first and last rows
+        assert(rank_space.is_staged(chunk, row));
+        shared.push_back(row);
+      }
+    }
+    staged_.emplace_back(static_cast<int>(shared.size()) * elem_size);
+    shared_rows_.push_back(std::move(shared));
+  }
+  chunk_seconds_.resize(num_chunks, 0.0);
+}
+
+// the start of each worker's run of chunks, padded so that the workers'
+// counters don't share a cache line
+struct alignas(64) chunk_queue
+{
+  std::atomic<int> next;
+  int stop;
+};
+
+template<typename P>
+void chunk_executor<P>::apply(PDE<P> const &pde,
+                              std::vector<element_chunk> const &chunks,
+                              batch_plan<P> const &plan,
+                              host_workspace<P> &host_space,
+                              rank_workspace<P> &rank_space)
+{
+  int const num_chunks = static_cast<int>(chunks.size());
+  assert(plan.num_chunks() == num_chunks);
+  assert(static_cast<int>(shared_rows_.size()) == num_chunks);
+  assert(!plan.is_stale(pde, rank_space));
+  assert(!rank_space.is_zero_copy() || rank_space.get_host() == &host_space);
+
+  int const elem_size = element_segment_size(pde);
+
+  std::vector<workspace_binding<P>> bindings(1);
+  for (rank_workspace<P> &space : workspaces_)
+  {
+    bindings.emplace_back(rank_space, space);
+  }
+
+  std::vector<chunk_queue> queues(num_workers_);
+  for (int w = 0; w < num_workers_; ++w)
+  {
+    queues[w].next = static_cast<int>(static_cast<int64_t>(num_chunks) * w /
+                                      num_workers_);
+    queues[w].stop = static_cast<int>(static_cast<int64_t>(num_chunks) *
+                                      (w + 1) / num_workers_);
+  }
+
+  // add a chunk's output to the rows it alone writes, and stage the rest.
+  // zero-copy, the rows between the first and last are in fx already
+  auto const write_outputs = [&](int const c, rank_workspace<P> &space) {
+    limits const rows              = rows_in_chunk(chunks[c]);
+    std::vector<int> const &shared = shared_rows_[c];
+
+    auto const add_rows = [&](int const start, int const stop) {
+      if (start > stop)
+      {
+        return;
+      }
+      if (space.is_zero_copy())
+      {
+        for (int const row : {start, stop})
+        {
+          if (space.is_staged(chunks[c], row))
+          {
+            fk::vector<P, mem_type::view> fx_view(
+                host_space.fx, row * elem_size, (row + 1) * elem_size - 1);
+            fm::axpy(space.output_row(chunks[c], row), fx_view);
+          }
+          if (start == stop)
+          {
+            break;
+          }
+        }
+        return;
+      }
+      fk::vector<P, mem_type::view> const out_view(
+          space.batch_output, (start - rows.start) * elem_size,
+          (stop - rows.start + 1) * elem_size - 1);
+      fk::vector<P, mem_type::view> fx_view(
+          host_space.fx, start * elem_size, (stop + 1) * elem_size - 1);
+      fm::axpy(out_view, fx_view);
+    };
+
+    int start = rows.start;
+    for (int s = 0; s < static_cast<int>(shared.size()); ++s)
+    {
+      add_rows(start, shared[s] - 1);
+      fk::vector<P, mem_type::view> const out_view =
+          space.output_row(chunks[c], shared[s]);
+      fk::vector<P, mem_type::view> staged_view(
+          staged_[c], s * elem_size, (s + 1) * elem_size - 1);
+      fm::copy(out_view, staged_view);
+      start = shared[s] + 1;
+    }
+    add_rows(start, rows.stop);
+  };
+
+  auto const workspace = [&](int const w) -> rank_workspace<P> & {
+    return w == 0 ? rank_space : workspaces_[w - 1];
+  };
+
+  // the three stages of applying chunk c in workspace w
+  auto const stage = [&](int const c, int const w) {
+    copy_chunk_inputs(pde, workspace(w), host_space, chunks[c]);
+  };
+  auto const compute = [&](int const c, int const w) {
+    auto const start = std::chrono::steady_clock::now();
+    if (plan.is_fused())
+    {
+      batched_kronmult(plan.get_kron_batch(c), workspace(w).batch_intermediate,
+                       bindings[w]);
+    }
+    else
+    {
+      P const alpha = 1.0;
+      P const beta  = 0.0;
+      for (batch_operands_set<P> const &operands : plan.get_batches(c))
+      {
+        batched_gemm(operands[0], operands[1], operands[2], alpha, beta,
+                     bindings[w], &workspace(w).gemm_lists);
+      }
+    }
+    std::chrono::duration<double> const elapsed =
+        std::chrono::steady_clock::now() - start;
+    chunk_seconds_[c] += elapsed.count();
+  };
+  auto const drain = [&](int const c, int const w) {
+    reduce_chunk(pde, workspace(w), chunks[c], plan.get_output_offsets(c));
+    write_outputs(c, workspace(w));
+  };
+
+  // take from our own queue first, then from the others' in turn
+  auto const steal = [&](int const worker) {
+    for (int i = 0; i < num_workers_; ++i)
+    {
+      chunk_queue &queue = queues[(worker + i) % num_workers_];
+      for (int c = queue.next++; c < queue.stop; c = queue.next++)
+      {
+        stage(c, worker);
+        compute(c, worker);
+        drain(c, worker);
+      }
+    }
+  };
+
+  // step t stages chunk t, computes chunk t - 1 and drains chunk t - 2; a
+  // worker takes every num_threads-th stage
+  auto const pipeline_step = [&](int const t, int const worker,
+                                 int const num_threads) {
+    for (int s = worker; s < num_pipeline_stages; s += num_threads)
+    {
+      int const c = t - s;
+      if (c < 0 || c >= num_chunks)
+      {
+        continue;
+      }
+      int const w = c % (static_cast<int>(workspaces_.size()) + 1);
+      if (s == 0)
+      {
+        stage(c, w);
+      }
+      else if (s == 1)
+      {
+        compute(c, w);
+      }
+      else
+      {
+        drain(c, w);
+      }
+    }
+  };
+  int const num_steps = num_chunks + num_pipeline_stages - 1;
+
+  fm::scal(static_cast<P>(0.0), host_space.fx);
+  if (schedule_ == chunk_schedule::stealing)
+  {
+#ifdef ASGARD_USE_OPENMP
+#pragma omp parallel num_threads(num_workers_)
+    {
+      steal(omp_get_thread_num());
+    }
+#else
+    steal(0);
+#endif
+  }
+  else
+  {
+#ifdef ASGARD_USE_OPENMP
+#pragma omp parallel num_threads(num_workers_)
+    {
+      int const worker      = omp_get_thread_num();
+      int const num_threads = omp_get_num_threads();
+      for (int t = 0; t < num_steps; ++t)
+      {
+        pipeline_step(t, worker, num_threads);
+#pragma omp barrier
+      }
+    }
+#else
+    for (int t = 0; t < num_steps; ++t)
+    {
+      pipeline_step(t, 0, 1);
+    }
+#endif
+  }
+
+  // the shared rows, in chunk order
+  for (int c = 0; c < num_chunks; ++c)
+  {
+    std::vector<int> const &shared = shared_rows_[c];
+    for (int s = 0; s < static_cast<int>(shared.size()); ++s)
+    {
+      fk::vector<P, mem_type::view> const staged_view(
+          staged_[c], s * elem_size, (s + 1) * elem_size - 1);
+      fk::vector<P, mem_type::view> fx_view(host_space.fx,
+                                            shared[s] * elem_size,
+                                            (shared[s] + 1) * elem_size - 1);
+      fm::axpy(staged_view, fx_view);
+    }
+  }
+}
+
+template<typename P>
+void chunk_executor<P>::reset_chunk_seconds()
+{
+  std::fill(chunk_seconds_.begin(), chunk_seconds_.end(), 0.0);
+}
+
+template<typename P>
+int chunk_executor<P>::num_shared_rows() const
+{
+  int total = 0;
+  for (std::vector<int> const &shared : shared_rows_)
+  {
+    total += static_cast<int>(shared.size());
+  }
+  return total;
+}
+
+template<typename P>
+double chunk_executor<P>::size_MB() const
+{
+  double megabytes = 0.0;
+  for (rank_workspace<P> const &space : workspaces_)
+  {
+    megabytes += space.size_MB();
+  }
+  int64_t num_staged = 0;
+  for (fk::vector<P> const &staged : staged_)
+  {
+    num_staged += staged.size();
+  }
+  return megabytes + static_cast<double>(num_staged) * sizeof(P) * 1e-6;
+}
+
+template class chunk_executor<float>;
+template class chunk_executor<double>;
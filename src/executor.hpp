@@ -0,0 +1,89 @@
+#pragma once
+#include "batch.hpp"
+#include "chunk.hpp"
+#include "pde.hpp"
+#include "tensors.hpp"
+
+// how a chunk_executor's workers divide the chunks
+enum class chunk_schedule
+{
+  stealing, // each worker applies whole chunks, stealing when out of its own
+  pipelined // the chunks pass through three stages - staging inputs,
+            // computing, and reducing and writing outputs - with the stages
+            // of consecutive chunks overlapped on two workspaces
+};
+
+// the number of workers a chunk_executor asked for this many would have,
+// before limiting to the number of chunks; num_workers <= 0 is every
+// available thread
+int available_workers(int const num_workers);
+
+// applies the system matrix to host_space.x, writing host_space.fx, across a
+// team of workers. each worker has its own rank workspace; the batch plan,
+// built for one workspace, is replayed against the others through a
+// workspace_binding.
+//
+// when stealing, the chunks are dealt out to the workers in contiguous runs.
+// a worker takes chunks from the front of its own run, and when that is
+// empty, steals from the others'.
+//
+// when pipelined, chunk i + 1's inputs are staged and chunk i - 1 reduced
+// and written while chunk i is computed. chunks alternate between two
+// workspaces; chunks i - 1 and i + 1 share one, but staging only writes its
+// batch input, which reducing doesn't touch. there are at most three
+// workers, one per stage. this is the shape needed once the compute stage
+// runs on a device; on the host it hides the copies behind the gemms.
+//
+// each chunk writes the output rows it spans. rows spanned by only one chunk
+// are added to fx by that chunk's worker directly. the rows chunks share are
+// staged per chunk, then added in chunk order once every chunk is done. so
+// fx needs no locks or atomics, and the result is bit for bit the same as
+// applying the chunks one after another, whatever the number of workers or
+// the schedule.
+template<typename P>
+class chunk_executor
+{
+public:
+  // the workers' workspaces are allocated like rank_space, with its kronmult
+  // and reduction engines. num_workers <= 0 uses every available thread.
+  // there are never more workers than chunks
+  chunk_executor(PDE<P> const &pde, std::vector<element_chunk> const &chunks,
+                 rank_workspace<P> const &rank_space, int const num_workers = 0,
+                 chunk_schedule const schedule = chunk_schedule::stealing);
+
+  // the first worker (or, pipelined, every other chunk) uses rank_space,
+  // which the plan was built for; the rest use the executor's workspaces
+  void apply(PDE<P> const &pde, std::vector<element_chunk> const &chunks,
+             batch_plan<P> const &plan, host_workspace<P> &host_space,
+             rank_workspace<P> &rank_space);
+
+  int num_workers() const { return num_workers_; }
+  chunk_schedule get_schedule() const { return schedule_; }
+  // number of (chunk, row) pairs staged because the row is shared
+  int num_shared_rows() const;
+  // memory for the workers' own workspaces and the staged rows
+  double size_MB() const;
+
+  // the seconds each chunk has spent in its products, summed over the
+  // applies since the last reset
+  std::vector<double> const &get_chunk_seconds() const
+  {
+    return chunk_seconds_;
+  }
+  void reset_chunk_seconds();
+
+private:
+  int num_workers_;
+  chunk_schedule schedule_;
+  // the workspaces besides rank_space: one per further worker when
+  // stealing, or the second buffer when pipelined
+  std::vector<rank_workspace<P>> workspaces_;
+  // each chunk's rows shared with another chunk, sorted, and where its
+  // output for them is staged
+  std::vector<std::vector<int>> shared_rows_;
+  std::vector<fk::vector<P>> staged_;
+  std::vector<double> chunk_seconds_;
+};
+
+extern template class chunk_executor<float>;
+extern template class chunk_executor<double>;
@@ -0,0 +1,184 @@
+#include "executor.hpp"
+#include "fast_math.hpp"
+#include "tests_general.hpp"
+#include <numeric>
+#include <random>
+
+TEMPLATE_TEST_CASE("chunk executor", "[executor]", float, double)
+{
+  std::random_device rd;
+  std::mt19937 mersenne_engine(rd());
+  std::uniform_real_distribution<TestType> dist(-2.0, 2.0);
+  auto gen = [&dist, &mersenne_engine]() { return dist(mersenne_engine); };
+
+  // apply the chunks one after another, in rank_space
+  auto const apply_serial = [](PDE<TestType> const &pde,
+                               std::vector<element_chunk> const &chunks,
+                               batch_plan<TestType> const &plan,
+                               rank_workspace<TestType> &rank_space,
+                               host_workspace<TestType> &host_space) {
+    fm::scal(static_cast<TestType>(0.0), host_space.fx);
+    for (int i = 0; i < plan.num_chunks(); ++i)
+    {
+      copy_chunk_inputs(pde, rank_space, host_space, chunks[i]);
+      if (plan.is_fused())
+      {
+        batched_kronmult(plan.get_kron_batch(i), rank_space.batch_intermediate);
+      }
+      else
+      {
+        for (auto const &operands : plan.get_batches(i))
+        {
+          batched_gemm(operands[0], operands[1], operands[2],
+                       static_cast<TestType>(1.0), static_cast<TestType>(0.0));
+        }
+      }
+      reduce_chunk(pde, rank_space, chunks[i], plan.get_output_offsets(i));
+      copy_chunk_outputs(pde, rank_space, host_space, chunks[i]);
+    }
+    return host_space.fx;
+  };
+
+  // the executor's result doesn't depend on the schedule or the number of
+  // workers, and matches applying the chunks in order exactly. with
+  // zero_copy, the workspaces read x and write fx in place
+  auto const test_executor = [&](PDE_opts const choice, int const level,
+                                 int const degree, kronmult_engine const engine,
+                                 int const num_chunks,
+                                 bool const zero_copy = false) {
+    auto pde = make_PDE<TestType>(choice, level, degree);
+    options const o = make_options(
+        {"-l", std::to_string(level), "-d", std::to_string(degree)});
+    element_table const elem_table(o, pde->num_dims);
+    for (int d = 0; d < pde->num_dims; ++d)
+    {
+      for (int k = 0; k < pde->num_terms; ++k)
+      {
+        fk::matrix<TestType> coeffs(pde->get_coefficients(k, d));
+        std::generate(coeffs.begin(), coeffs.end(), gen);
+        pde->set_coefficients(coeffs, k, d);
+      }
+    }
+
+    host_workspace<TestType> host_space(*pde, elem_table);
+    std::generate(host_space.x.begin(), host_space.x.end(), gen);
+
+    auto const chunks = assign_elements(elem_table, num_chunks);
+    rank_workspace<TestType> rank_space(*pde, chunks, engine,
+                                        reduction_engine::gemv,
+                                        zero_copy ? &host_space : nullptr);
+    batch_plan<TestType> const plan(*pde, elem_table, rank_space, chunks);
+    fk::vector<TestType> const gold =
+        apply_serial(*pde, chunks, plan, rank_space, host_space);
+
+    for (chunk_schedule const schedule :
+         {chunk_schedule::stealing, chunk_schedule::pipelined})
+    {
+      for (int const num_workers : {1, 2, 3, 8})
+      {
+        chunk_executor<TestType> executor(*pde, chunks, rank_space,
+                                          num_workers, schedule);
+        REQUIRE(executor.get_schedule() == schedule);
+        REQUIRE(executor.num_workers() >= 1);
+        REQUIRE(executor.num_workers() <= std::min(num_workers, num_chunks));
+        if (schedule == chunk_schedule::pipelined)
+        {
+          REQUIRE(executor.num_workers() <= 3);
+        }
+        if (num_chunks == 1)
+        {
+          REQUIRE(executor.num_shared_rows() == 0);
+        }
+
+        // a stale result must be overwritten
+        std::generate(host_space.fx.begin(), host_space.fx.end(), gen);
+        executor.apply(*pde, chunks, plan, host_space, rank_space);
+        REQUIRE(host_space.fx == gold);
+
+        // and again, with the workspaces as the last apply left them
+        executor.apply(*pde, chunks, plan, host_space, rank_space);
+        REQUIRE(host_space.fx == gold);
+      }
+    }
+
+    // the shared rows are staged, a row per chunk sharing it
+    chunk_executor<TestType> const single(*pde, chunks, rank_space, 1);
+    REQUIRE(single.size_MB() ==
+            Approx(static_cast<double>(single.num_shared_rows()) *
+                   element_segment_size(*pde) * sizeof(TestType) * 1e-6));
+
+    // each chunk's time in its products is summed until reset
+    chunk_executor<TestType> timed(*pde, chunks, rank_space, 2);
+    std::vector<double> const zeros(chunks.size(), 0.0);
+    REQUIRE(timed.get_chunk_seconds() == zeros);
+    timed.apply(*pde, chunks, plan, host_space, rank_space);
+    std::vector<double> const once = timed.get_chunk_seconds();
+    REQUIRE(once.size() == chunks.size());
+    REQUIRE(std::accumulate(once.begin(), once.end(), 0.0) > 0.0);
+    timed.apply(*pde, chunks, plan, host_space, rank_space);
+    for (size_t c = 0; c < once.size(); ++c)
+    {
+      REQUIRE(timed.get_chunk_seconds()[c] >= once[c]);
+    }
+    timed.reset_chunk_seconds();
+    REQUIRE(timed.get_chunk_seconds() == zeros);
+  };
+
+  SECTION("batched, continuity 2, level 3, degree 2, 1 chunk")
+  {
+    test_executor(PDE_opts::continuity_2, 3, 2, kronmult_engine::batched, 1);
+  }
+  SECTION("batched, continuity 2, level 3, degree 2, 7 chunks")
+  {
+    test_executor(PDE_opts::continuity_2, 3, 2, kronmult_engine::batched, 7);
+  }
+  SECTION("stacked, continuity 3, level 2, degree 3, 5 chunks")
+  {
+    test_executor(PDE_opts::continuity_3, 2, 3, kronmult_engine::stacked, 5);
+  }
+  SECTION("fused, continuity 3, level 3, degree 2, 9 chunks")
+  {
+    test_executor(PDE_opts::continuity_3, 3, 2, kronmult_engine::fused, 9);
+  }
+  SECTION("zero-copy, batched, continuity 2, level 3, degree 2, 7 chunks")
+  {
+    test_executor(PDE_opts::continuity_2, 3, 2, kronmult_engine::batched, 7,
+                  true);
+  }
+  SECTION("zero-copy, fused, continuity 3, level 3, degree 2, 9 chunks")
+  {
+    test_executor(PDE_opts::continuity_3, 3, 2, kronmult_engine::fused, 9,
+                  true);
+  }
+}
+
+TEMPLATE_TEST_CASE("workspace binding", "[executor]", float, double)
+{
+  int const degree = 2;
+  int const level  = 2;
+  auto pde         = make_PDE<TestType>(PDE_opts::continuity_2, level, degree);
+  options const o  = make_options(
+      {"-l", std::to_string(level), "-d", std::to_string(degree)});
+  element_table const elem_table(o, pde->num_dims);
+  auto const chunks = assign_elements(elem_table, 1);
+
+  rank_workspace<TestType> from(*pde, chunks);
+  rank_workspace<TestType> to(*pde, chunks);
+
+  workspace_binding<TestType> const identity;
+  REQUIRE(identity.is_identity());
+  REQUIRE(identity(from.batch_input.data()) == from.batch_input.data());
+
+  workspace_binding<TestType> const binding(from, to);
+  REQUIRE(!binding.is_identity());
+  REQUIRE(binding(from.batch_input.data() + 3) == to.batch_input.data() + 3);
+  REQUIRE(binding(from.reduction_space.data() + from.reduction_space.size() -
+                  1) ==
+          to.reduction_space.data() + to.reduction_space.size() - 1);
+  REQUIRE(binding(from.batch_intermediate.data()) ==
+          to.batch_intermediate.data());
+
+  // pointers outside the workspace's buffers stay put
+  TestType const *const coeffs = pde->get_coefficients(0, 0).data();
+  REQUIRE(binding(coeffs) == coeffs);
+}
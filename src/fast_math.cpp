@@ -1 +1,65 @@
 #include "fast_math.hpp"
+#include <algorithm>
+
+namespace fm
+{
+// lincomb works through the vectors in blocks small enough that each block of
+// y stays in the l1 cache while the terms are added to it. the loops over a
+// block are left to the compiler to vectorize
+static int64_t constexpr lincomb_block = 2048;
+
+template<typename P>
+fk::vector<P> &
+lincomb(scaled_vectors<P> const &terms, fk::vector<P> &y, P const beta)
+{
+  int64_t const size = y.size();
+  std::vector<P> alphas;
+  std::vector<P const *> xs;
+  for (auto const &[alpha, x] : terms)
+  {
+    assert(x->size() == size);
+    assert(x->data() != y.data());
+    alphas.push_back(alpha);
+    xs.push_back(x->data());
+  }
+  int const num_terms  = static_cast<int>(terms.size());
+  int64_t const blocks = (size + lincomb_block - 1) / lincomb_block;
+
+  P *const out = y.data();
+#ifdef ASGARD_USE_OPENMP
+#pragma omp parallel for num_threads(lib_dispatch::get_num_threads()) \
+    if (blocks > 1)
+#endif
+  for (int64_t b = 0; b < blocks; ++b)
+  {
+    int64_t const start = b * lincomb_block;
+    int64_t const stop  = std::min(size, start + lincomb_block);
+    if (beta == 0.0)
+    {
+      std::fill(out + start, out + stop, static_cast<P>(0.0));
+    }
+    else if (beta != 1.0)
+    {
+      for (int64_t i = start; i < stop; ++i)
+      {
+        out[i] *= beta;
+      }
+    }
+    for (int t = 0; t < num_terms; ++t)
+    {
+      P const alpha    = alphas[t];
+      P const *const x = xs[t];
+      for (int64_t i = start; i < stop; ++i)
+      {
+        out[i] += alpha * x[i];
+      }
+    }
+  }
+  return y;
+}
+
+template fk::vector<float> &lincomb(scaled_vectors<float> const &terms,
+                                    fk::vector<float> &y, float const beta);
+template fk::vector<double> &lincomb(scaled_vectors<double> const &terms,
+                                     fk::vector<double> &y, double const beta);
+} // namespace fm
@@ -1,6 +1,8 @@
 #pragma once
 #include "lib_dispatch.hpp"
 #include "tensors.hpp"
+#include <utility>
+#include <vector>
 
 namespace fm
 {
@@ -46,6 +48,17 @@ fk::vector<P, mem> &scal(P const alpha, fk::vector<P, mem> &x)
   return x;
 }
 
+// the terms alpha_i*x_i of a linear combination
+template<typename P>
+using scaled_vectors = std::vector<std::pair<P, fk::vector<P> const *>>;
+
+// lincomb - y = beta*y + sum of alpha_i*x_i, in one threaded, vectorized pass
+// over the vectors instead of a blas call per term. y must not be one of the
+// x_i; beta = 0 overwrites y without reading it
+template<typename P>
+fk::vector<P> &
+lincomb(scaled_vectors<P> const &terms, fk::vector<P> &y, P const beta = 0.0);
+
 // gemv - matrix vector multiplication
 template<typename P, mem_type amem, mem_type xmem, mem_type ymem>
 fk::vector<P, ymem> &
@@ -106,4 +119,11 @@ gemm(fk::matrix<P, amem> const &A, fk::matrix<P, bmem> const &B,
 
   return C;
 }
+
+extern template fk::vector<float> &lincomb(scaled_vectors<float> const &terms,
+                                           fk::vector<float> &y,
+                                           float const beta);
+extern template fk::vector<double> &
+lincomb(scaled_vectors<double> const &terms, fk::vector<double> &y,
+        double const beta);
 } // namespace fm
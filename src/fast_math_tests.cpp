@@ -249,3 +249,54 @@ TEMPLATE_TEST_CASE("other vector routines", "[fast_math]", float, double, int)
     REQUIRE(test_own == zeros);
   }
 }
+
+TEMPLATE_TEST_CASE("fm::lincomb", "[fast_math]", float, double)
+{
+  fk::vector<TestType> const a = {2, 3, 4, 5, 6};
+  fk::vector<TestType> const b = {7, 8, 9, 10, 11};
+  fk::vector<TestType> const y = {1, -1, 2, -2, 4};
+
+  SECTION("overwrite, scale or add to y")
+  {
+    fk::vector<TestType> test(y);
+    REQUIRE(fm::lincomb<TestType>({{2.0, &a}, {1.5, &b}}, test) ==
+            fk::vector<TestType>{14.5, 18, 21.5, 25, 28.5});
+
+    test = y;
+    REQUIRE(fm::lincomb<TestType>({{2.0, &a}}, test, 1.0) ==
+            fk::vector<TestType>{5, 5, 10, 8, 16});
+
+    test = y;
+    REQUIRE(fm::lincomb<TestType>({{-1.0, &a}, {0.5, &b}}, test, 2.0) ==
+            fk::vector<TestType>{3.5, -1, 4.5, -4, 7.5});
+
+    test = y;
+    REQUIRE(fm::lincomb<TestType>({}, test, 0.5) ==
+            fk::vector<TestType>{0.5, -0.5, 1, -1, 2});
+  }
+
+  SECTION("matches a chain of axpys, across blocks")
+  {
+    int const size = 10000;
+    fk::vector<TestType> x_1(size);
+    fk::vector<TestType> x_2(size);
+    fk::vector<TestType> x_3(size);
+    fk::vector<TestType> test(size);
+    for (int i = 0; i < size; ++i)
+    {
+      x_1(i)  = i % 7;
+      x_2(i)  = i % 11 - 5;
+      x_3(i)  = i % 3;
+      test(i) = i % 5;
+    }
+
+    fk::vector<TestType> gold(test);
+    fm::scal(static_cast<TestType>(0.5), gold);
+    fm::axpy(x_1, gold, static_cast<TestType>(2.0));
+    fm::axpy(x_2, gold, static_cast<TestType>(-0.25));
+    fm::axpy(x_3, gold, static_cast<TestType>(4.0));
+
+    REQUIRE(fm::lincomb<TestType>({{2.0, &x_1}, {-0.25, &x_2}, {4.0, &x_3}},
+                                  test, 0.5) == gold);
+  }
+}
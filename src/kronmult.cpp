@@ -0,0 +1,245 @@
+#include "kronmult.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <utility>
+
+namespace kronmult
+{
+// compile-time integer power
+static int constexpr ipow(int const base, int const exponent)
+{
+  int result = 1;
+  for (int i = 0; i < exponent; ++i)
+  {
+    result *= base;
+  }
+  return result;
+}
+
+// apply a degree by degree block A to the middle index of the tensor in,
+// viewed as (left, degree, right) in column major order, writing out:
+//
+//   out(l, i, r) = sum_j A(i, j) * in(l, j, r)
+//
+// the lowest dimension (left == 1) is then A*X and the higher dimensions are
+// X*A^T, matching the gemms enqueued by kronmult_to_batch_sets.
+//
+// an identity block leaves in as it is, and out is only written if it is the
+// final output. if accumulate, the result is added to out rather than
+// written over it. returns where the result is.
+template<typename P, int degree, int left, int right, bool accumulate>
+static P const *apply_stage(P const *const A, block_kind const kind,
+                            int const lda, P const *const in, P *const out,
+                            bool const is_final)
+{
+  int constexpr size = left * degree * right;
+  if (kind == block_kind::identity)
+  {
+    if (!is_final)
+    {
+      return in;
+    }
+    if constexpr (accumulate)
+    {
+      for (int i = 0; i < size; ++i)
+      {
+        out[i] += in[i];
+      }
+    }
+    else
+    {
+      std::copy(in, in + size, out);
+    }
+    return out;
+  }
+
+  if (kind == block_kind::diagonal)
+  {
+    for (int r = 0; r < right; ++r)
+    {
+      for (int i = 0; i < degree; ++i)
+      {
+        P const a_ii        = A[i + i * lda];
+        int const offset    = (r * degree + i) * left;
+        P const *const in_i = in + offset;
+        P *const out_i      = out + offset;
+        for (int l = 0; l < left; ++l)
+        {
+          if constexpr (accumulate)
+          {
+            out_i[l] += a_ii * in_i[l];
+          }
+          else
+          {
+            out_i[l] = a_ii * in_i[l];
+          }
+        }
+      }
+    }
+    return out;
+  }
+
+  // pull the operator block out of the (much larger) coefficient matrix once
+  P a[degree][degree];
+  for (int j = 0; j < degree; ++j)
+  {
+    for (int i = 0; i < degree; ++i)
+    {
+      a[i][j] = A[i + j * lda];
+    }
+  }
+
+  for (int r = 0; r < right; ++r)
+  {
+    P const *const in_r = in + r * degree * left;
+    P *const out_r      = out + r * degree * left;
+    for (int i = 0; i < degree; ++i)
+    {
+      P *const out_i = out_r + i * left;
+      if constexpr (!accumulate)
+      {
+        for (int l = 0; l < left; ++l)
+        {
+          out_i[l] = 0;
+        }
+      }
+      for (int j = 0; j < degree; ++j)
+      {
+        P const a_ij        = a[i][j];
+        P const *const in_j = in_r + j * left;
+        for (int l = 0; l < left; ++l)
+        {
+          out_i[l] += a_ij * in_j[l];
+        }
+      }
+    }
+  }
+  return out;
+}
+
+// run every stage of the product. intermediate results alternate between the
+// two halves of work - skipping a half that holds a stage's input, since
+// identity stages leave their input in place - and the final stage writes
+// directly into y, or adds to it if accumulate
+template<typename P, int num_dims, int degree, bool accumulate, int... stages>
+static void run_stages(P const *const *A, block_kind const *kinds,
+                       int const lda, P const *x, P *y, P *work,
+                       std::integer_sequence<int, stages...>)
+{
+  int constexpr size = ipow(degree, num_dims);
+  P const *in        = x;
+  ((in = apply_stage<P, degree, ipow(degree, stages),
+                     ipow(degree, num_dims - stages - 1),
+                     accumulate && stages == num_dims - 1>(
+        A[stages], kinds[stages], lda, in,
+        stages == num_dims - 1 ? y : (in == work ? work + size : work),
+        stages == num_dims - 1)),
+   ...);
+}
+
+template<typename P, int num_dims, int degree, bool accumulate>
+static void fused(P const *const *A, block_kind const *kinds, int const lda,
+                  P const *x, P *y, P *work)
+{
+  run_stages<P, num_dims, degree, accumulate>(
+      A, kinds, lda, x, y, work, std::make_integer_sequence<int, num_dims>{});
+}
+
+template<typename P, int num_dims, bool accumulate, int... degrees>
+static kernel<P>
+select_degree(int const degree, std::integer_sequence<int, degrees...>)
+{
+  kernel<P> selected = nullptr;
+  ((selected = (degree == degrees + 1)
+                   ? &fused<P, num_dims, degrees + 1, accumulate>
+                   : selected),
+   ...);
+  return selected;
+}
+
+template<typename P, bool accumulate, int... dims>
+static kernel<P> select_kernel(int const num_dims, int const degree,
+                               std::integer_sequence<int, dims...>)
+{
+  kernel<P> selected = nullptr;
+  ((selected = (num_dims == dims + 1)
+                   ? select_degree<P, dims + 1, accumulate>(
+                         degree,
+                         std::make_integer_sequence<int, max_fused_degree>{})
+                   : selected),
+   ...);
+  return selected;
+}
+
+template<typename P>
+block_kind classify_block(P const *const A, int const lda, int const degree,
+                          P const drop_tol)
+{
+  assert(A);
+  assert(lda >= degree);
+  assert(drop_tol >= 0);
+  bool is_zero     = true;
+  bool is_diagonal = true;
+  bool is_identity = true;
+  for (int j = 0; j < degree; ++j)
+  {
+    for (int i = 0; i < degree; ++i)
+    {
+      P const a = A[i + j * lda];
+      bool const small = std::abs(a) <= drop_tol;
+      is_zero          = is_zero && small;
+      if (i == j)
+      {
+        is_identity = is_identity && std::abs(a - 1) <= drop_tol;
+      }
+      else if (!small)
+      {
+        is_diagonal = false;
+        is_identity = false;
+      }
+    }
+  }
+  if (is_zero)
+  {
+    return block_kind::zero;
+  }
+  if (is_identity)
+  {
+    return block_kind::identity;
+  }
+  return is_diagonal ? block_kind::diagonal : block_kind::dense;
+}
+
+bool has_fused_kernel(int const num_dims, int const degree)
+{
+  assert(num_dims > 0);
+  assert(degree > 0);
+  return num_dims <= max_fused_dims && degree <= max_fused_degree;
+}
+
+template<typename P>
+kernel<P> get_fused_kernel(int const num_dims, int const degree,
+                           bool const accumulate)
+{
+  if (!has_fused_kernel(num_dims, degree))
+  {
+    return nullptr;
+  }
+  auto constexpr dims = std::make_integer_sequence<int, max_fused_dims>{};
+  return accumulate ? select_kernel<P, true>(num_dims, degree, dims)
+                    : select_kernel<P, false>(num_dims, degree, dims);
+}
+
+template block_kind
+classify_block(float const *const A, int const lda, int const degree,
+               float const drop_tol);
+template block_kind
+classify_block(double const *const A, int const lda, int const degree,
+               double const drop_tol);
+
+template kernel<float> get_fused_kernel(int const num_dims, int const degree,
+                                        bool const accumulate);
+template kernel<double> get_fused_kernel(int const num_dims, int const degree,
+                                         bool const accumulate);
+} // namespace kronmult
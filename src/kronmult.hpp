@@ -0,0 +1,73 @@
+#pragma once
+
+// -----------------------------------------------------------------------------
+// kronmult
+// this component applies a tensor encoded kronecker product to a vector,
+//
+//   y = (A[num_dims-1] kron ... kron A[1] kron A[0]) * x
+//
+// where each A[d] is a degree by degree block and x, y are degree^num_dims
+// long. A[0] acts on the fastest varying index of x; this is the same
+// convention used by kronmult_to_batch_sets in the batch component.
+//
+// rather than num_dims rounds of tiny blas gemms, the fused kernels here are
+// specialized at compile time on (num_dims, degree) so the whole product is
+// computed with fixed trip count loops on data that fits in L1.
+// -----------------------------------------------------------------------------
+
+#include <cstdint>
+
+namespace kronmult
+{
+// largest problem shapes we instantiate fused kernels for
+int constexpr max_fused_dims   = 6;
+int constexpr max_fused_degree = 8;
+
+// structure of a degree by degree operator block. the fused kernels skip
+// identity blocks and only scale by diagonal ones; a product with a zero block
+// is zero, and callers should drop it rather than compute it.
+enum class block_kind : uint8_t
+{
+  dense,
+  diagonal,
+  identity,
+  zero
+};
+
+// classify the degree by degree block at A, with leading dimension lda.
+// entries within drop_tol of zero (or, on the diagonal of an identity, of
+// one) are treated as exact
+template<typename P>
+block_kind classify_block(P const *const A, int const lda, int const degree,
+                          P const drop_tol = 0);
+
+// signature of a fused kernel. A is a list of num_dims pointers to the
+// degree by degree operator blocks, all with leading dimension lda, and kinds
+// their structure. work must hold min(num_dims - 1, 2) * degree^num_dims
+// elements and may not alias x or y.
+template<typename P>
+using kernel = void (*)(P const *const *A, block_kind const *kinds,
+                        int const lda, P const *x, P *y, P *work);
+
+// true if a fused kernel was instantiated for this problem shape
+bool has_fused_kernel(int const num_dims, int const degree);
+
+// returns the fused kernel for this problem shape, or nullptr if there is
+// none (callers fall back on batched gemm). if accumulate, the kernel adds
+// the product to y rather than writing over it
+template<typename P>
+kernel<P> get_fused_kernel(int const num_dims, int const degree,
+                           bool const accumulate = false);
+
+extern template block_kind
+classify_block(float const *const A, int const lda, int const degree,
+               float const drop_tol);
+extern template block_kind
+classify_block(double const *const A, int const lda, int const degree,
+               double const drop_tol);
+
+extern template kernel<float>
+get_fused_kernel(int const num_dims, int const degree, bool const accumulate);
+extern template kernel<double>
+get_fused_kernel(int const num_dims, int const degree, bool const accumulate);
+} // namespace kronmult
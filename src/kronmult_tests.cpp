@@ -0,0 +1,207 @@
+#include "kronmult.hpp"
+#include "tensors.hpp"
+#include "tests_general.hpp"
+#include <functional>
+#include <random>
+
+TEST_CASE("fused kernel availability", "[kronmult]")
+{
+  for (int dims = 1; dims <= kronmult::max_fused_dims; ++dims)
+  {
+    for (int degree = 1; degree <= kronmult::max_fused_degree; ++degree)
+    {
+      REQUIRE(kronmult::has_fused_kernel(dims, degree));
+      REQUIRE(kronmult::get_fused_kernel<double>(dims, degree));
+      REQUIRE(kronmult::get_fused_kernel<float>(dims, degree));
+    }
+  }
+  REQUIRE(!kronmult::has_fused_kernel(kronmult::max_fused_dims + 1, 2));
+  REQUIRE(!kronmult::has_fused_kernel(2, kronmult::max_fused_degree + 1));
+  REQUIRE(
+      !kronmult::get_fused_kernel<double>(kronmult::max_fused_dims + 1, 2));
+  REQUIRE(
+      !kronmult::get_fused_kernel<float>(2, kronmult::max_fused_degree + 1));
+}
+
+TEMPLATE_TEST_CASE("fused kronmult", "[kronmult]", float, double)
+{
+  std::random_device rd;
+  std::mt19937 mersenne_engine(rd());
+  std::uniform_real_distribution<TestType> dist(-2.0, 2.0);
+  auto gen = [&dist, &mersenne_engine]() { return dist(mersenne_engine); };
+
+  // compare against an explicitly formed kronecker product. the operator
+  // blocks are windows into a larger matrix, as they are when taken from
+  // the pde coefficient matrices. kinds gives the structure of each
+  // dimension's block, which defaults to dense
+  auto const test_kronmult =
+      [&gen](int const num_dims, int const degree,
+             std::vector<kronmult::block_kind> kinds = {}) {
+        int const lda = degree * 4;
+        fk::matrix<TestType> coefficients(lda, lda * num_dims);
+        std::generate(coefficients.begin(), coefficients.end(), gen);
+        kinds.resize(num_dims, kronmult::block_kind::dense);
+
+        std::vector<fk::matrix<TestType, mem_type::view>> A;
+        std::vector<TestType const *> A_ptrs;
+        for (int d = 0; d < num_dims; ++d)
+        {
+          int const row = degree;
+          int const col = d * lda + 2 * degree;
+          A.push_back(fk::matrix<TestType, mem_type::view>(
+              coefficients, row, row + degree - 1, col, col + degree - 1));
+          for (int j = 0; j < degree; ++j)
+          {
+            for (int i = 0; i < degree; ++i)
+            {
+              if (i != j && kinds[d] != kronmult::block_kind::dense)
+              {
+                A.back()(i, j) = 0;
+              }
+              if (i == j && kinds[d] == kronmult::block_kind::identity)
+              {
+                A.back()(i, j) = 1;
+              }
+            }
+          }
+          // random blocks are dense, except for degree 1
+          if (kinds[d] != kronmult::block_kind::dense)
+          {
+            REQUIRE(kronmult::classify_block(A.back().data(), lda, degree) ==
+                    kinds[d]);
+          }
+          A_ptrs.push_back(A.back().data());
+        }
+
+        // matrix assignment requires matching sizes, so grow the product by
+        // recursion rather than in a loop
+        std::function<fk::matrix<TestType>(int)> const kron_from =
+            [&A, &kron_from](int const d) -> fk::matrix<TestType> {
+          if (d == 0)
+          {
+            return fk::matrix<TestType>(A[0]);
+          }
+          return fk::matrix<TestType>(A[d]).kron(kron_from(d - 1));
+        };
+        fk::matrix<TestType> const kron_product = kron_from(num_dims - 1);
+
+        int const size = kron_product.nrows();
+        fk::vector<TestType> x(size);
+        std::generate(x.begin(), x.end(), gen);
+        fk::vector<TestType> const gold = kron_product * x;
+
+        fk::vector<TestType> y(size);
+        fk::vector<TestType> work(size * std::min(num_dims - 1, 2));
+        kronmult::kernel<TestType> const kernel =
+            kronmult::get_fused_kernel<TestType>(num_dims, degree);
+        kernel(A_ptrs.data(), kinds.data(), lda, x.data(), y.data(),
+               work.data());
+
+        TestType const tol = std::numeric_limits<TestType>::epsilon() * 1e3;
+        for (int i = 0; i < size; ++i)
+        {
+          TestType const scale =
+              std::max(static_cast<TestType>(1.0), std::abs(gold(i)));
+          REQUIRE(std::abs(y(i) - gold(i)) <= tol * scale);
+        }
+
+        // the accumulating kernel adds the product to y
+        kronmult::kernel<TestType> const accumulate =
+            kronmult::get_fused_kernel<TestType>(num_dims, degree, true);
+        fk::vector<TestType> z(size);
+        std::generate(z.begin(), z.end(), gen);
+        fk::vector<TestType> const z_gold = z + gold;
+        accumulate(A_ptrs.data(), kinds.data(), lda, x.data(), z.data(),
+                   work.data());
+        for (int i = 0; i < size; ++i)
+        {
+          TestType const scale =
+              std::max(static_cast<TestType>(1.0), std::abs(z_gold(i)));
+          REQUIRE(std::abs(z(i) - z_gold(i)) <= tol * scale);
+        }
+      };
+
+  SECTION("1d, degree 1-8")
+  {
+    for (int degree = 1; degree <= 8; ++degree)
+    {
+      test_kronmult(1, degree);
+    }
+  }
+  SECTION("2d, degree 1-8")
+  {
+    for (int degree = 1; degree <= 8; ++degree)
+    {
+      test_kronmult(2, degree);
+    }
+  }
+  SECTION("3d, degree 2-5")
+  {
+    for (int degree = 2; degree <= 5; ++degree)
+    {
+      test_kronmult(3, degree);
+    }
+  }
+  SECTION("4d, degree 3") { test_kronmult(4, 3); }
+  SECTION("6d, degree 2") { test_kronmult(6, 2); }
+  SECTION("identity and diagonal blocks")
+  {
+    using kronmult::block_kind;
+    test_kronmult(2, 3, {block_kind::identity, block_kind::dense});
+    test_kronmult(2, 3, {block_kind::dense, block_kind::identity});
+    test_kronmult(2, 4, {block_kind::identity, block_kind::identity});
+    test_kronmult(3, 2,
+                  {block_kind::identity, block_kind::diagonal,
+                   block_kind::identity});
+    test_kronmult(3, 3,
+                  {block_kind::dense, block_kind::identity,
+                   block_kind::identity});
+    test_kronmult(4, 3,
+                  {block_kind::diagonal, block_kind::identity,
+                   block_kind::identity, block_kind::dense});
+  }
+}
+
+TEMPLATE_TEST_CASE("classify operator blocks", "[kronmult]", float, double)
+{
+  using kronmult::block_kind;
+  int const degree = 3;
+  int const lda    = 5;
+  fk::matrix<TestType> A(lda, degree);
+  REQUIRE(kronmult::classify_block(A.data(), lda, degree) == block_kind::zero);
+  for (int i = 0; i < degree; ++i)
+  {
+    A(i, i) = 1;
+  }
+  // rows past the block don't count
+  A(degree, 0) = 7;
+  REQUIRE(kronmult::classify_block(A.data(), lda, degree) ==
+          block_kind::identity);
+  A(1, 1) = 2;
+  REQUIRE(kronmult::classify_block(A.data(), lda, degree) ==
+          block_kind::diagonal);
+  A(0, 2) = -1;
+  REQUIRE(kronmult::classify_block(A.data(), lda, degree) ==
+          block_kind::dense);
+
+  // entries within the drop tolerance count as exact
+  TestType const drop_tol = 1e-3;
+  fk::matrix<TestType> B(lda, degree);
+  B(2, 1) = drop_tol / 2;
+  REQUIRE(kronmult::classify_block(B.data(), lda, degree) ==
+          block_kind::dense);
+  REQUIRE(kronmult::classify_block(B.data(), lda, degree, drop_tol) ==
+          block_kind::zero);
+  for (int i = 0; i < degree; ++i)
+  {
+    B(i, i) = 1 - drop_tol / 2;
+  }
+  REQUIRE(kronmult::classify_block(B.data(), lda, degree, drop_tol) ==
+          block_kind::identity);
+  B(0, 0) = 3;
+  REQUIRE(kronmult::classify_block(B.data(), lda, degree, drop_tol) ==
+          block_kind::diagonal);
+  B(0, 1) = 2 * drop_tol;
+  REQUIRE(kronmult::classify_block(B.data(), lda, degree, drop_tol) ==
+          block_kind::dense);
+}
@@ -1,7 +1,12 @@
 #include "lib_dispatch.hpp"
+#include <cstdint>
 #include <iostream>
 #include <type_traits>
 
+#ifdef ASGARD_USE_OPENMP
+#include <omp.h>
+#endif
+
 //
 // temporary. used to ignore compiler warnings until we implement
 // switching on res variable
@@ -330,6 +335,191 @@ void getri(int *n, P *A, int *lda, int *ipiv, P *work, int *lwork, int *info,
   }
 }
 
+//
+// threading for the batched routines
+//
+static int num_threads_setting = 0;
+static int grain_size_setting  = 16;
+
+void set_num_threads(int const num_threads)
+{
+  num_threads_setting = num_threads;
+}
+
+int get_num_threads()
+{
+#ifdef ASGARD_USE_OPENMP
+  return num_threads_setting > 0 ? num_threads_setting : omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+void set_grain_size(int const grain_size)
+{
+  assert(grain_size > 0);
+  grain_size_setting = grain_size;
+}
+
+int get_grain_size() { return grain_size_setting; }
+
+// run func(i) for i in [0, num_entries), handing out grain size runs of
+// entries to the threads
+template<typename F>
+static void parallel_for(int const num_entries, F &&func)
+{
+#ifdef ASGARD_USE_OPENMP
+  int const grain_size  = grain_size_setting;
+  int const num_threads = get_num_threads();
+#pragma omp parallel for schedule(dynamic, grain_size) \
+    num_threads(num_threads) if (num_entries > grain_size && num_threads > 1)
+  for (int i = 0; i < num_entries; ++i)
+  {
+    func(i);
+  }
+#else
+  for (int i = 0; i < num_entries; ++i)
+  {
+    func(i);
+  }
+#endif
+}
+
+// products at or below this many multiply-adds are cheaper to compute inline
+// than to hand to blas. measured against openblas, the call overhead only
+// dominates up to about 3x3x3; past that blas' small kernels win
+static int constexpr max_inline_gemm_volume = 32;
+
+// gemm for a single small entry of a batch. the operands are too small for
+// blocking to pay off, so each element of C is a single short dot product
+template<typename P>
+static void small_gemm(bool const trans_A, bool const trans_B, int const m,
+                       int const n, int const k, P const alpha, P const *A,
+                       int const lda, P const *B, int const ldb, P const beta,
+                       P *C, int const ldc)
+{
+  // element strides of op(A) and op(B) along their rows and columns
+  int64_t const A_row = trans_A ? lda : 1;
+  int64_t const A_col = trans_A ? 1 : lda;
+  int64_t const B_row = trans_B ? ldb : 1;
+  int64_t const B_col = trans_B ? 1 : ldb;
+
+  for (int j = 0; j < n; ++j)
+  {
+    P const *const B_j = B + j * B_col;
+    P *const C_j       = C + static_cast<int64_t>(j) * ldc;
+    for (int i = 0; i < m; ++i)
+    {
+      P const *const A_i = A + i * A_row;
+      P result           = 0;
+      for (int z = 0; z < k; ++z)
+      {
+        result += A_i[z * A_col] * B_j[z * B_row];
+      }
+      // as in blas, C is not read when beta is zero
+      C_j[i] = (beta == P{0}) ? alpha * result : beta * C_j[i] + alpha * result;
+    }
+  }
+}
+
+// one entry of a batched gemm; picks the kernel by shape
+template<typename P>
+static void gemm_entry(char const *transa, char const *transb, int *m, int *n,
+                       int *k, P *alpha, P *A, int *lda, P *B, int *ldb,
+                       P *beta, P *C, int *ldc, resource const res)
+{
+  bool const inline_gemm =
+      *m > 0 && *n > 0 && *k > 0 &&
+      static_cast<int64_t>(*m) * *n * *k <= max_inline_gemm_volume;
+  if (inline_gemm)
+  {
+    small_gemm(*transa == 't', *transb == 't', *m, *n, *k, *alpha, A, *lda, B,
+               *ldb, *beta, C, *ldc);
+  }
+  else
+  {
+    gemm(transa, transb, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc, res);
+  }
+}
+
+template<typename P>
+void batched_gemm(char const *transa, char const *transb, int *m, int *n,
+                  int *k, P *alpha, P *const *A, int *lda, P *const *B,
+                  int *ldb, P *beta, P *const *C, int *ldc, int *num_batch,
+                  resource const res)
+{
+  assert(transa);
+  assert(transb);
+  assert(m);
+  assert(n);
+  assert(k);
+  assert(alpha);
+  assert(A);
+  assert(lda);
+  assert(B);
+  assert(ldb);
+  assert(beta);
+  assert(C);
+  assert(ldc);
+  assert(num_batch);
+  assert(*m >= 0);
+  assert(*n >= 0);
+  assert(*k >= 0);
+  assert(*num_batch >= 0);
+  assert(*transa == 't' || *transa == 'n');
+  assert(*transb == 't' || *transb == 'n');
+
+  parallel_for(*num_batch, [&](int const i) {
+    if (A[i] && B[i] && C[i])
+    {
+      gemm_entry(transa, transb, m, n, k, alpha, A[i], lda, B[i], ldb, beta,
+                 C[i], ldc, res);
+    }
+  });
+}
+
+template<typename P>
+void batched_gemm_strided(char const *transa, char const *transb, int *m,
+                          int *n, int *k, P *alpha, P *A, int *lda,
+                          int *stride_a, P *B, int *ldb, int *stride_b,
+                          P *beta, P *C, int *ldc, int *stride_c,
+                          int *num_batch, resource const res)
+{
+  assert(transa);
+  assert(transb);
+  assert(m);
+  assert(n);
+  assert(k);
+  assert(alpha);
+  assert(A);
+  assert(lda);
+  assert(stride_a);
+  assert(B);
+  assert(ldb);
+  assert(stride_b);
+  assert(beta);
+  assert(C);
+  assert(ldc);
+  assert(stride_c);
+  assert(num_batch);
+  assert(*m >= 0);
+  assert(*n >= 0);
+  assert(*k >= 0);
+  assert(*stride_a >= 0);
+  assert(*stride_b >= 0);
+  assert(*stride_c >= 0);
+  assert(*num_batch >= 0);
+  assert(*transa == 't' || *transa == 'n');
+  assert(*transb == 't' || *transb == 'n');
+
+  parallel_for(*num_batch, [&](int const i) {
+    int64_t const entry = i;
+    gemm_entry(transa, transb, m, n, k, alpha, A + entry * *stride_a, lda,
+               B + entry * *stride_b, ldb, beta, C + entry * *stride_c, ldc,
+               res);
+  });
+}
+
 template void
 copy(int *n, float *x, int *incx, float *y, int *incy, resource const res);
 template void
@@ -378,6 +568,41 @@ template void gemm(char const *transa, char const *transb, int *m, int *n,
                    int *k, int *alpha, int *A, int *lda, int *B, int *ldb,
                    int *beta, int *C, int *ldc, resource const res);
 
+template void batched_gemm(char const *transa, char const *transb, int *m,
+                           int *n, int *k, float *alpha, float *const *A,
+                           int *lda, float *const *B, int *ldb, float *beta,
+                           float *const *C, int *ldc, int *num_batch,
+                           resource const res);
+template void batched_gemm(char const *transa, char const *transb, int *m,
+                           int *n, int *k, double *alpha, double *const *A,
+                           int *lda, double *const *B, int *ldb, double *beta,
+                           double *const *C, int *ldc, int *num_batch,
+                           resource const res);
+template void batched_gemm(char const *transa, char const *transb, int *m,
+                           int *n, int *k, int *alpha, int *const *A, int *lda,
+                           int *const *B, int *ldb, int *beta, int *const *C,
+                           int *ldc, int *num_batch, resource const res);
+
+template void batched_gemm_strided(char const *transa, char const *transb,
+                                   int *m, int *n, int *k, float *alpha,
+                                   float *A, int *lda, int *stride_a, float *B,
+                                   int *ldb, int *stride_b, float *beta,
+                                   float *C, int *ldc, int *stride_c,
+                                   int *num_batch, resource const res);
+template void batched_gemm_strided(char const *transa, char const *transb,
+                                   int *m, int *n, int *k, double *alpha,
+                                   double *A, int *lda, int *stride_a,
+                                   double *B, int *ldb, int *stride_b,
+                                   double *beta, double *C, int *ldc,
+                                   int *stride_c, int *num_batch,
+                                   resource const res);
+template void batched_gemm_strided(char const *transa, char const *transb,
+                                   int *m, int *n, int *k, int *alpha, int *A,
+                                   int *lda, int *stride_a, int *B, int *ldb,
+                                   int *stride_b, int *beta, int *C, int *ldc,
+                                   int *stride_c, int *num_batch,
+                                   resource const res);
+
 template void getrf(int *m, int *n, float *A, int *lda, int *ipiv, int *info,
                     resource const res);
 template void getrf(int *m, int *n, double *A, int *lda, int *ipiv, int *info,
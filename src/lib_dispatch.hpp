@@ -108,6 +108,35 @@ void gemm(char const *transa, char const *transb, int *m, int *n, int *k,
           P *alpha, P *A, int *lda, P *B, int *ldb, P *beta, P *C, int *ldc,
           resource const res = resource::host);
 
+// batched matrix-matrix multiply; for each i in [0, num_batch),
+// C[i] := alpha*op(A[i])*op(B[i]) + beta*C[i]
+// all entries share one shape. entries with a null A, B or C are skipped.
+// the entries are divided among threads (see set_num_threads), and each is
+// computed inline or by blas depending on its size.
+template<typename P>
+void batched_gemm(char const *transa, char const *transb, int *m, int *n,
+                  int *k, P *alpha, P *const *A, int *lda, P *const *B,
+                  int *ldb, P *beta, P *const *C, int *ldc, int *num_batch,
+                  resource const res = resource::host);
+
+// as above, but entry i's operands are found at A + i*stride_a, etc.
+template<typename P>
+void batched_gemm_strided(char const *transa, char const *transb, int *m,
+                          int *n, int *k, P *alpha, P *A, int *lda,
+                          int *stride_a, P *B, int *ldb, int *stride_b,
+                          P *beta, P *C, int *ldc, int *stride_c,
+                          int *num_batch, resource const res = resource::host);
+
+// threads used by the batched routines. num_threads <= 0 (the default)
+// uses every thread available to the process. without openmp, the batched
+// routines are serial and get_num_threads() is always 1
+void set_num_threads(int const num_threads);
+int get_num_threads();
+
+// number of consecutive batch entries handed to a thread at a time
+void set_grain_size(int const grain_size);
+int get_grain_size();
+
 template<typename P>
 void getrf(int *m, int *n, P *A, int *lda, int *ipiv, int *info,
            resource const res = resource::host);
@@ -168,6 +197,41 @@ extern template void gemm(char const *transa, char const *transb, int *m,
                           int *ldb, int *beta, int *C, int *ldc,
                           resource const res);
 
+extern template void
+batched_gemm(char const *transa, char const *transb, int *m, int *n, int *k,
+             float *alpha, float *const *A, int *lda, float *const *B, int *ldb,
+             float *beta, float *const *C, int *ldc, int *num_batch,
+             resource const res);
+extern template void
+batched_gemm(char const *transa, char const *transb, int *m, int *n, int *k,
+             double *alpha, double *const *A, int *lda, double *const *B,
+             int *ldb, double *beta, double *const *C, int *ldc,
+             int *num_batch, resource const res);
+extern template void
+batched_gemm(char const *transa, char const *transb, int *m, int *n, int *k,
+             int *alpha, int *const *A, int *lda, int *const *B, int *ldb,
+             int *beta, int *const *C, int *ldc, int *num_batch,
+             resource const res);
+
+extern template void
+batched_gemm_strided(char const *transa, char const *transb, int *m, int *n,
+                     int *k, float *alpha, float *A, int *lda, int *stride_a,
+                     float *B, int *ldb, int *stride_b, float *beta, float *C,
+                     int *ldc, int *stride_c, int *num_batch,
+                     resource const res);
+extern template void
+batched_gemm_strided(char const *transa, char const *transb, int *m, int *n,
+                     int *k, double *alpha, double *A, int *lda, int *stride_a,
+                     double *B, int *ldb, int *stride_b, double *beta,
+                     double *C, int *ldc, int *stride_c, int *num_batch,
+                     resource const res);
+extern template void
+batched_gemm_strided(char const *transa, char const *transb, int *m, int *n,
+                     int *k, int *alpha, int *A, int *lda, int *stride_a,
+                     int *B, int *ldb, int *stride_b, int *beta, int *C,
+                     int *ldc, int *stride_c, int *num_batch,
+                     resource const res);
+
 extern template void getrf(int *m, int *n, float *A, int *lda, int *ipiv,
                            int *info, resource const res);
 extern template void getrf(int *m, int *n, double *A, int *lda, int *ipiv,
@@ -172,6 +172,127 @@ TEMPLATE_TEST_CASE("matrix-matrix multiply (lib_dispatch::gemm)",
   }
 }
 
+TEMPLATE_TEST_CASE(
+    "batched matrix-matrix multiply (lib_dispatch::batched_gemm)",
+    "[lib_dispatch]", float, double, int)
+{
+  // small integer values keep every product exact, so the inline and blas
+  // kernels can be compared against each other with ==
+  auto const fill = [](fk::vector<TestType> &v, int const seed) {
+    for (int i = 0; i < v.size(); ++i)
+    {
+      v(i) = static_cast<TestType>((i * 7 + seed) % 11 - 5);
+    }
+  };
+
+  int const num_batch = 37;
+
+  // compare both batched variants against a loop over gemm for one shape
+  auto const test_batched = [&](int m, int n, int k, char const trans_a,
+                                char const trans_b) {
+    int lda      = (trans_a == 't' ? k : m) + 1;
+    int ldb      = (trans_b == 't' ? n : k) + 2;
+    int ldc      = m + 3;
+    int stride_a = lda * (trans_a == 't' ? m : k);
+    int stride_b = ldb * (trans_b == 't' ? k : n);
+    int stride_c = ldc * n;
+
+    fk::vector<TestType> A(stride_a * num_batch);
+    fk::vector<TestType> B(stride_b * num_batch);
+    fk::vector<TestType> C(stride_c * num_batch);
+    fill(A, 1);
+    fill(B, 2);
+    fill(C, 3);
+
+    TestType alpha = 2;
+    TestType beta  = 3;
+
+    fk::vector<TestType> gold(C);
+    for (int i = 0; i < num_batch; ++i)
+    {
+      lib_dispatch::gemm(&trans_a, &trans_b, &m, &n, &k, &alpha,
+                         A.data(i * stride_a), &lda, B.data(i * stride_b),
+                         &ldb, &beta, gold.data(i * stride_c), &ldc);
+    }
+
+    std::vector<TestType *> a_list, b_list, c_list;
+    fk::vector<TestType> test(C);
+    for (int i = 0; i < num_batch; ++i)
+    {
+      a_list.push_back(A.data(i * stride_a));
+      b_list.push_back(B.data(i * stride_b));
+      c_list.push_back(test.data(i * stride_c));
+    }
+    int batch_size = num_batch;
+    lib_dispatch::batched_gemm(&trans_a, &trans_b, &m, &n, &k, &alpha,
+                               a_list.data(), &lda, b_list.data(), &ldb, &beta,
+                               c_list.data(), &ldc, &batch_size);
+    REQUIRE(test == gold);
+
+    fk::vector<TestType> test_strided(C);
+    lib_dispatch::batched_gemm_strided(
+        &trans_a, &trans_b, &m, &n, &k, &alpha, A.data(), &lda, &stride_a,
+        B.data(), &ldb, &stride_b, &beta, test_strided.data(), &ldc,
+        &stride_c, &batch_size);
+    REQUIRE(test_strided == gold);
+  };
+
+  SECTION("small entries")
+  {
+    test_batched(3, 4, 2, 'n', 'n');
+    test_batched(3, 4, 2, 't', 'n');
+    test_batched(3, 4, 2, 'n', 't');
+    test_batched(3, 4, 2, 't', 't');
+  }
+
+  SECTION("large entries")
+  {
+    test_batched(20, 11, 9, 'n', 'n');
+    test_batched(20, 11, 9, 't', 'n');
+    test_batched(20, 11, 9, 'n', 't');
+    test_batched(20, 11, 9, 't', 't');
+  }
+
+  SECTION("thread count and grain size")
+  {
+    int const num_threads = lib_dispatch::get_num_threads();
+    int const grain_size  = lib_dispatch::get_grain_size();
+    REQUIRE(num_threads >= 1);
+
+    lib_dispatch::set_num_threads(2);
+    lib_dispatch::set_grain_size(1);
+    REQUIRE(lib_dispatch::get_grain_size() == 1);
+    test_batched(4, 4, 4, 'n', 't');
+    test_batched(20, 11, 9, 't', 'n');
+
+    lib_dispatch::set_num_threads(0);
+    lib_dispatch::set_grain_size(grain_size);
+    REQUIRE(lib_dispatch::get_num_threads() == num_threads);
+  }
+
+  SECTION("null entries are skipped")
+  {
+    int m = 2, n = 2, k = 2, ld = 2;
+    fk::vector<TestType> A{1, 2, 3, 4};
+    fk::vector<TestType> C{5, 6, 7, 8};
+    fk::vector<TestType> const gold(C);
+
+    std::vector<TestType *> a_list{A.data(), nullptr};
+    std::vector<TestType *> b_list{nullptr, A.data()};
+    std::vector<TestType *> c_list{C.data(), C.data()};
+
+    TestType alpha     = 1;
+    TestType beta      = 0;
+    int batch_size     = 2;
+    char const trans_a = 'n';
+    char const trans_b = 'n';
+    lib_dispatch::batched_gemm(&trans_a, &trans_b, &m, &n, &k, &alpha,
+                               a_list.data(), &ld, b_list.data(), &ld, &beta,
+                               c_list.data(), &ld, &batch_size);
+    REQUIRE(C == gold);
+  }
+}
+
 TEMPLATE_TEST_CASE("matrix-vector multiply (lib_dispatch::gemv)",
                    "[lib_dispatch]", float, double, int)
 {
@@ -3,6 +3,8 @@
 #include "coefficients.hpp"
 #include "connectivity.hpp"
 #include "element_table.hpp"
+#include "executor.hpp"
+#include "kronmult.hpp"
 
 #ifdef ASGARD_IO_HIGHFIVE
 #include "io.hpp"
@@ -10,11 +12,13 @@
 
 #include "chunk.hpp"
 #include "pde.hpp"
+#include "planner.hpp"
 #include "predict.hpp"
 #include "program_options.hpp"
 #include "tensors.hpp"
 #include "time_advance.hpp"
 #include "transformations.hpp"
+#include <memory>
 #include <numeric>
 
 using prec = double;
@@ -26,6 +30,14 @@ int main(int argc, char **argv)
   std::cout << "This executable was built on " << BUILD_TIME << '\n';
 
   options opts(argc, argv);
+  if (!opts.is_valid())
+  {
+    return 1;
+  }
+
+  // the batched routines, reductions and vector updates use no more threads
+  // than the chunks are applied across
+  lib_dispatch::set_num_threads(opts.get_num_threads());
 
   // -- parse user input and generate pde
   std::cout << "generating: pde..." << '\n';
@@ -52,6 +64,20 @@ int main(int argc, char **argv)
   std::cout << "  full grid: " << opts.using_full_grid() << '\n';
   std::cout << "  CFL number: " << opts.get_cfl() << '\n';
   std::cout << "  Poisson solve: " << opts.do_poisson_solve() << '\n';
+  std::cout << "  element ordering: "
+            << (opts.get_element_ordering() == element_ordering::morton
+                    ? "morton"
+                    : opts.get_element_ordering() == element_ordering::levels
+                          ? "levels"
+                          : "permutation")
+            << '\n';
+  std::cout << "  time scheme: "
+            << std::find_if(scheme_mapping.begin(), scheme_mapping.end(),
+                            [&opts](auto const &scheme) {
+                              return scheme.second == opts.get_time_scheme();
+                            })
+                   ->first
+            << '\n';
 
   // -- print out time and memory estimates based on profiling
   std::pair<std::string, double> runtime_info = expected_time(
@@ -149,22 +175,205 @@ int main(int argc, char **argv)
     return megabytes;
   };
 
-  // Our default workspace size is ~1GB.
+  // use the fused kronmult kernels if there is one for this problem shape,
+  // otherwise fall back on batched gemm - stacking the terms, if there are
+  // terms and dimensions to stack
+  kronmult_engine const engine = [&pde, degree] {
+    if (kronmult::has_fused_kernel(pde->num_dims, degree))
+    {
+      return kronmult_engine::fused;
+    }
+    if (pde->num_dims > 1 && pde->num_terms > 1)
+    {
+      return kronmult_engine::stacked;
+    }
+    return kronmult_engine::batched;
+  }();
+  std::cout << "kronmult engine: "
+            << (engine == kronmult_engine::fused
+                    ? "fused"
+                    : engine == kronmult_engine::stacked ? "stacked gemm"
+                                                         : "batched gemm")
+            << '\n';
 
-  // This 1GB doesn't include coefficient matrices, element table,
-  // or time advance workspace - only the primary memory consumers (kronmult
-  // intermediate and result workspaces).
-  //
-  // FIXME eventually going to be settable from the cmake
-  static int const default_workspace_MB = 1000;
+  // only the fused kernels can sum their products in place. gemv leaves the
+  // order of a row's sum to the blas, so reproducible runs use the tree
+  bool const reproducible = opts.using_reproducible();
+  reduction_engine const reduction = [&] {
+    if (opts.get_reduction() == reduction_engine::in_place &&
+        engine != kronmult_engine::fused)
+    {
+      return reduction_engine::column_sum;
+    }
+    if (opts.get_reduction() == reduction_engine::gemv && reproducible)
+    {
+      return reduction_engine::tree;
+    }
+    return opts.get_reduction();
+  }();
+  std::cout << "reduction engine: "
+            << (reduction == reduction_engine::in_place
+                    ? "in place"
+                    : reduction == reduction_engine::tree
+                          ? "tree"
+                          : reduction == reduction_engine::column_sum
+                                ? "column sum"
+                                : "gemv")
+            << '\n';
+
+  // chunk only the connected element pairs, less those whose products all
+  // have a zero coefficient block
+  std::cout << "  generating: element connectivity..." << '\n';
+  int const max_level_sum = opts.using_full_grid()
+                                ? opts.get_level() * pde->num_dims
+                                : opts.get_level();
+  list_set const connectivity = make_connectivity(
+      table, pde->num_dims, max_level_sum, opts.get_level());
+
+  prec const drop_tol = opts.get_drop_tolerance();
+  block_structure<prec> const blocks(*pde, drop_tol);
+  list_set const pruned = blocks.prune(table, connectivity);
+
+  auto const count_pairs = [](list_set const &lists) {
+    int64_t num_pairs = 0;
+    for (fk::vector<int> const &connected : lists)
+    {
+      num_pairs += connected.size();
+    }
+    return num_pairs;
+  };
+  int64_t const num_connected = count_pairs(connectivity);
+  std::cout << "connected element pairs: " << num_connected << " of "
+            << static_cast<int64_t>(table.size()) * table.size() << '\n';
+  std::cout << "element pairs pruned for zero blocks: "
+            << num_connected - count_pairs(pruned) << '\n';
+
+  // the workspaces the chunks are applied in - one per worker, or a double
+  // buffer when pipelined - split the budget. there are a few chunks per
+  // worker, to balance the load, or per stage, to fill the pipeline
+  static int const chunks_per_worker = 4;
+  static int const pipeline_stages   = 3;
+  int const num_workers    = available_workers(opts.get_num_threads());
+  int const num_workspaces = opts.using_pipeline() ? 2 : num_workers;
+  int const min_chunks =
+      opts.using_pipeline()
+          ? chunks_per_worker * pipeline_stages
+          : num_workers > 1 ? chunks_per_worker * num_workers : 1;
+  chunk_schedule const schedule = opts.using_pipeline()
+                                     ? chunk_schedule::pipelined
+                                     : chunk_schedule::stealing;
+
+  // the budget covers only the primary memory consumers - the kronmult
+  // intermediate and result workspaces - not the coefficient matrices,
+  // element table or time advance workspace
+  memory_hierarchy const memory = read_memory_hierarchy();
+  int const workspace_MB = workspace_budget_MB(memory, opts.get_workspace_MB());
+  std::cout << "workspace budget (MB): " << workspace_MB << '\n';
+
+  host_workspace<prec> host_space(*pde, table, opts.get_time_scheme());
+  host_space.x = initial_condition;
+
+  // -- chunks are balanced by the predicted cost of their pairs' products,
+  // taking no more pairs than a workspace's share of the budget holds. that
+  // share depends on the workers and the machine's memory, so the chunks of
+  // reproducible runs - and the order their products are summed in - are
+  // balanced by cost alone
+  cost_model const costs = blocks.pair_costs(table, pruned, engine);
+  auto const assign = [&](int const count) {
+    int64_t const max_pairs =
+        reproducible
+            ? 0
+            : std::max<int64_t>(
+                  (count_pairs(pruned) + count - 1) / count,
+                  static_cast<int64_t>(workspace_MB / num_workspaces /
+                                       get_element_size_MB(*pde, engine)));
+    return assign_elements(pruned, costs, count, max_pairs);
+  };
+
+  // -- fewer chunks than the budget allows would each take more pairs than a
+  // workspace's share of it holds. a given count that low is raised, unless
+  // the run is reproducible and needs the very chunks it was given
+  int const fewest_chunks =
+      opts.get_num_chunks() > 0
+          ? get_num_chunks(pruned, *pde, 1,
+                           std::max(1, workspace_MB / num_workspaces), engine)
+          : 0;
+  if (opts.get_num_chunks() < fewest_chunks)
+  {
+    if (reproducible)
+    {
+      std::cerr << opts.get_num_chunks()
+                << " chunks overrun the workspace budget, which needs at least "
+                << fewest_chunks << "; raise -k or -m" << '\n';
+      return 1;
+    }
+    std::cout << "  " << opts.get_num_chunks()
+              << " chunks overrun the workspace budget; using " << fewest_chunks
+              << '\n';
+  }
 
-  // FIXME stand-in
-  static int const ranks = 1;
+  // -- plan the chunks: sized to the caches, or the fastest of those sizes
+  // when autotuning, unless given. the caches and timings differ from
+  // machine to machine and run to run, so reproducible runs are given theirs
+  int const num_chunks = [&] {
+    if (opts.get_num_chunks() > 0)
+    {
+      int const count = std::max(opts.get_num_chunks(), fewest_chunks);
+      return static_cast<int>(
+          std::min<int64_t>(count, count_pairs(pruned)));
+    }
+    std::vector<int> const candidates =
+        propose_chunk_counts(pruned, *pde, engine, memory, workspace_MB,
+                             num_workspaces, min_chunks);
+    if (!opts.using_autotune() || candidates.size() == 1)
+    {
+      return candidates[0];
+    }
 
-  host_workspace<prec> host_space(*pde, table);
-  std::vector<element_chunk> const chunks = assign_elements(
-      table, get_num_chunks(table, *pde, ranks, default_workspace_MB));
-  rank_workspace<prec> rank_space(*pde, chunks);
+    std::cout << "  autotuning: chunk count..." << '\n';
+    std::vector<element_chunk> chunks;
+    std::unique_ptr<rank_workspace<prec>> rank_space;
+    std::unique_ptr<batch_plan<prec>> plan;
+    std::unique_ptr<chunk_executor<prec>> executor;
+    // the chunks may be fewer than asked for, so track the count they were
+    // assigned for
+    int assigned = 0;
+    auto const apply = [&](int const count) {
+      if (assigned != count)
+      {
+        assigned = count;
+        executor.reset();
+        plan.reset();
+        rank_space.reset();
+        chunks = assign(count);
+        rank_space = std::make_unique<rank_workspace<prec>>(
+            *pde, chunks, engine, reduction, &host_space);
+        plan = std::make_unique<batch_plan<prec>>(*pde, table, *rank_space,
+                                                  chunks, drop_tol);
+        executor = std::make_unique<chunk_executor<prec>>(
+            *pde, chunks, *rank_space, num_workers, schedule);
+      }
+      executor->apply(*pde, chunks, *plan, host_space, *rank_space);
+    };
+    std::vector<double> seconds;
+    int const fastest = fastest_chunk_count(candidates, apply, 3, &seconds);
+    for (size_t i = 0; i < candidates.size(); ++i)
+    {
+      std::cout << "    " << candidates[i] << " chunks: " << seconds[i]
+                << " s per apply" << '\n';
+    }
+    return fastest;
+  }();
+  std::cout << "chunk plan: " << num_chunks << " chunks (reuse with -k "
+            << num_chunks << ")" << '\n';
+  std::vector<element_chunk> const chunks = assign(num_chunks);
+  std::vector<double> const predicted = chunk_costs(chunks, pruned, costs);
+  std::cout << "predicted chunk imbalance (largest over mean cost): "
+            << load_imbalance(predicted) << '\n';
+  // the workspace is in host memory, so the chunks read x and write fx in
+  // place rather than staging copies
+  rank_workspace<prec> rank_space(*pde, chunks, engine, reduction,
+                                  &host_space);
 
   std::cout << "allocating workspace..." << '\n';
 
@@ -180,25 +389,89 @@ int main(int argc, char **argv)
   std::cout << "reduction vector size (MB): " << get_MB(unit_vect.size())
             << '\n';
 
-  std::cout << "explicit time loop workspace size (host) (MB): "
+  std::cout << "time loop workspace size (host) (MB): "
             << host_space.size_MB() << '\n';
 
-  host_space.x = initial_condition;
+  // -- build the batch lists for every chunk once, replayed each stage
+  std::cout << "building batch plan..." << '\n';
+  batch_plan<prec> plan(*pde, table, rank_space, chunks, drop_tol);
+  std::cout << "batch plan size (MB): " << plan.size_MB() << '\n';
+  std::cout << "products dropped for zero blocks: " << plan.num_dropped()
+            << '\n';
+
+  // -- apply the chunks across worker threads, each with its own workspace
+  chunk_executor<prec> executor(*pde, chunks, rank_space, num_workers,
+                                schedule);
+  std::cout << "chunk workers: " << executor.num_workers()
+            << (schedule == chunk_schedule::pipelined ? " (pipelined)" : "")
+            << (reproducible ? " (reproducible)" : "") << '\n';
+  std::cout << "worker workspace size (MB): " << executor.size_MB() << '\n';
 
-  // -- time loop
+  // -- time loop. adaptive steps start from the cfl step and run to the end
+  // time, the last landing on it
   std::cout << "--- begin time loop ---" << '\n';
-  prec const dt = pde->get_dt() * opts.get_cfl();
-  for (int i = 0; i < opts.get_time_steps(); ++i)
+  prec const dt       = pde->get_dt() * opts.get_cfl();
+  bool const adaptive = opts.get_time_scheme() == time_scheme::bs23;
+  prec const end_time = opts.get_end_time() > 0.0 ? opts.get_end_time()
+                                                  : dt * opts.get_time_steps();
+  step_control control;
+  control.tolerance = opts.get_tolerance();
+  control.next_dt   = dt;
+  krylov_control solver;
+  solver.tolerance = opts.get_tolerance();
+  prec time        = 0.0;
+  for (int i = 0; adaptive ? time < end_time : i < opts.get_time_steps(); ++i)
   {
-    prec const time = i * dt;
-
-    explicit_time_advance(*pde, table, initial_sources, host_space, rank_space,
-                          chunks, time, dt);
+    executor.reset_chunk_seconds();
+    if (adaptive)
+    {
+      prec const remaining = end_time - time;
+      prec const taken     = adaptive_time_advance(
+          *pde, table, initial_sources, host_space, rank_space, chunks, plan,
+          time, std::min<prec>(control.next_dt, remaining), control, &executor);
+      if (control.failed)
+      {
+        std::cerr << "no step from time " << time
+                  << " meets the tolerance; giving up" << '\n';
+        return 1;
+      }
+      time = taken == remaining ? end_time : time + taken;
+      std::cout << "step: " << taken << ", time: " << time
+                << ", steps rejected so far: " << control.num_rejected << '\n';
+    }
+    else if (opts.using_implicit())
+    {
+      implicit_time_advance(*pde, table, initial_sources, host_space,
+                            rank_space, chunks, plan, i * dt, dt, solver,
+                            &executor);
+      time = (i + 1) * dt;
+      std::cout << "solver iterations: " << solver.iterations
+                << (solver.converged ? "" : " (not converged)") << '\n';
+    }
+    else if (opts.get_time_scheme() == time_scheme::exponential)
+    {
+      exponential_time_advance(*pde, table, initial_sources, host_space,
+                               rank_space, chunks, plan, i * dt, dt, solver,
+                               &executor);
+      time = (i + 1) * dt;
+      std::cout << "krylov iterations: " << solver.iterations
+                << ", substeps: " << solver.substeps
+                << (solver.converged ? "" : " (not converged)") << '\n';
+    }
+    else
+    {
+      explicit_time_advance(*pde, table, initial_sources, host_space,
+                            rank_space, chunks, plan, i * dt, dt, &executor);
+      time = (i + 1) * dt;
+    }
+    std::cout << "chunk imbalance (largest over mean): predicted "
+              << load_imbalance(predicted) << ", measured "
+              << load_imbalance(executor.get_chunk_seconds()) << '\n';
 
     // print root mean squared error from analytic solution
     if (pde->has_analytic_soln)
     {
-      prec const time_multiplier = pde->exact_time((i + 1) * dt);
+      prec const time_multiplier = pde->exact_time(time);
 
       fk::vector<prec> const analytic_solution_t =
           analytic_solution * time_multiplier;
@@ -225,6 +498,19 @@ int main(int argc, char **argv)
     std::cout << "timestep: " << i << " complete" << '\n';
   }
 
+  if (adaptive)
+  {
+    std::cout << "right-hand side evaluations: " << control.num_evaluations
+              << ", steps rejected: " << control.num_rejected << '\n';
+  }
+  if (opts.using_implicit())
+  {
+    std::cout << "solver iterations: " << solver.total_iterations << '\n';
+  }
+  if (opts.get_time_scheme() == time_scheme::exponential)
+  {
+    std::cout << "krylov iterations: " << solver.total_iterations << '\n';
+  }
   std::cout << "--- simulation complete ---" << '\n';
   return 0;
 }
@@ -399,6 +399,14 @@ public:
   set_coefficients(fk::matrix<P> const coeffs, int const term, int const dim)
   {
     terms_[term][dim].set_coefficients(dimensions_[dim], coeffs);
+    ++coefficients_generation_;
+  }
+
+  // bumped each time any coefficient matrix is set, so that structures built
+  // from the coefficients can tell when they were regenerated, even in place
+  int64_t get_coefficients_generation() const
+  {
+    return coefficients_generation_;
   }
 
   P get_dt() { return dt_; };
@@ -407,4 +415,5 @@ private:
   std::vector<dimension<P>> dimensions_;
   term_set<P> terms_;
   P dt_;
+  int64_t coefficients_generation_ = 0;
 };
@@ -0,0 +1,150 @@
+#include "planner.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <unistd.h>
+
+// the share of a cache a chunk's workspace is planned to take, leaving room
+// for the coefficients and the input and output vectors it reads and writes
+static double constexpr cache_fraction = 0.5;
+
+memory_hierarchy read_memory_hierarchy()
+{
+  // sysconf reports 0 or -1 for what it doesn't know
+  auto const known = [](long const value) -> int64_t {
+    return value > 0 ? value : 0;
+  };
+
+  memory_hierarchy memory;
+#ifdef _SC_LEVEL2_CACHE_SIZE
+  memory.l2_bytes = known(sysconf(_SC_LEVEL2_CACHE_SIZE));
+#endif
+#ifdef _SC_LEVEL3_CACHE_SIZE
+  memory.l3_bytes = known(sysconf(_SC_LEVEL3_CACHE_SIZE));
+#endif
+#ifdef _SC_PHYS_PAGES
+  memory.memory_bytes =
+      known(sysconf(_SC_PHYS_PAGES)) * known(sysconf(_SC_PAGESIZE));
+#endif
+  return memory;
+}
+
+int workspace_budget_MB(memory_hierarchy const &memory,
+                        int const requested_MB)
+{
+  assert(requested_MB > 0);
+  if (memory.memory_bytes == 0)
+  {
+    return requested_MB;
+  }
+  int64_t const half_memory_MB = memory.memory_bytes / 2 / 1000000;
+  return static_cast<int>(
+      std::max<int64_t>(1, std::min<int64_t>(requested_MB, half_memory_MB)));
+}
+
+template<typename P>
+std::vector<int>
+propose_chunk_counts(list_set const &connectivity, PDE<P> const &pde,
+                     kronmult_engine const engine,
+                     memory_hierarchy const &memory, int const workspace_MB,
+                     int const num_workspaces, int const min_chunks)
+{
+  assert(workspace_MB > 0);
+  assert(num_workspaces > 0);
+  assert(min_chunks > 0);
+
+  int64_t num_pairs = 0;
+  for (fk::vector<int> const &connected : connectivity)
+  {
+    num_pairs += connected.size();
+  }
+  assert(num_pairs > 0);
+
+  // the fewest chunks allowed
+  int const fewest = std::max(
+      get_num_chunks(connectivity, pde, 1,
+                     std::max(1, workspace_MB / num_workspaces), engine),
+      min_chunks);
+  auto const clamp = [fewest, num_pairs](double const num_chunks) {
+    return static_cast<int>(std::min<double>(
+        std::max<double>(num_chunks, fewest), static_cast<double>(num_pairs)));
+  };
+
+  double const problem_MB =
+      get_element_size_MB(pde, engine) * static_cast<double>(num_pairs);
+  auto const fit_in = [&](int64_t const cache_bytes) {
+    double const chunk_MB = cache_fraction * cache_bytes * 1e-6;
+    return clamp(std::ceil(problem_MB / chunk_MB));
+  };
+
+  std::vector<int> counts;
+  auto const propose = [&counts](int const num_chunks) {
+    if (std::find(counts.begin(), counts.end(), num_chunks) == counts.end())
+    {
+      counts.push_back(num_chunks);
+    }
+  };
+  if (memory.l3_bytes > 0)
+  {
+    propose(fit_in(memory.l3_bytes / num_workspaces));
+  }
+  if (memory.l2_bytes > 0)
+  {
+    propose(fit_in(memory.l2_bytes));
+  }
+  propose(clamp(fewest));
+  return counts;
+}
+
+int fastest_chunk_count(std::vector<int> const &candidates,
+                        std::function<void(int)> const &apply,
+                        int const num_trials,
+                        std::vector<double> *const seconds)
+{
+  assert(candidates.size() > 0);
+  assert(num_trials > 0);
+
+  if (seconds)
+  {
+    seconds->clear();
+  }
+  int fastest         = candidates[0];
+  double fastest_time = std::numeric_limits<double>::max();
+  for (int const num_chunks : candidates)
+  {
+    apply(num_chunks);
+
+    double best = std::numeric_limits<double>::max();
+    for (int i = 0; i < num_trials; ++i)
+    {
+      auto const start = std::chrono::steady_clock::now();
+      apply(num_chunks);
+      std::chrono::duration<double> const elapsed =
+          std::chrono::steady_clock::now() - start;
+      best = std::min(best, elapsed.count());
+    }
+    if (seconds)
+    {
+      seconds->push_back(best);
+    }
+    // ties go to the earlier, preferred candidate
+    if (best < fastest_time)
+    {
+      fastest_time = best;
+      fastest      = num_chunks;
+    }
+  }
+  return fastest;
+}
+
+template std::vector<int>
+propose_chunk_counts(list_set const &connectivity, PDE<float> const &pde,
+                     kronmult_engine const engine,
+                     memory_hierarchy const &memory, int const workspace_MB,
+                     int const num_workspaces, int const min_chunks);
+template std::vector<int>
+propose_chunk_counts(list_set const &connectivity, PDE<double> const &pde,
+                     kronmult_engine const engine,
+                     memory_hierarchy const &memory, int const workspace_MB,
+                     int const num_workspaces, int const min_chunks);
@@ -0,0 +1,57 @@
+#pragma once
+#include "chunk.hpp"
+#include "connectivity.hpp"
+#include "pde.hpp"
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// the cache and memory sizes chunks are planned against; 0 when unknown
+struct memory_hierarchy
+{
+  int64_t l2_bytes     = 0;
+  int64_t l3_bytes     = 0;
+  int64_t memory_bytes = 0;
+};
+
+// read this machine's cache and physical memory sizes
+memory_hierarchy read_memory_hierarchy();
+
+// the workspace budget: the requested one, limited to half of physical memory
+// when that is known
+int workspace_budget_MB(memory_hierarchy const &memory,
+                        int const requested_MB);
+
+// numbers of chunks to split the connected element pairs into, best first.
+// the first keeps each chunk's workspace within a share of the L3 cache -
+// which the num_workspaces workspaces chunks are applied in split - and the
+// next within the L2 cache; the last is the fewest chunks whose workspaces
+// fit in workspace_MB between them. there are never fewer than min_chunks,
+// nor more chunks than element pairs
+template<typename P>
+std::vector<int>
+propose_chunk_counts(list_set const &connectivity, PDE<P> const &pde,
+                     kronmult_engine const engine,
+                     memory_hierarchy const &memory, int const workspace_MB,
+                     int const num_workspaces = 1, int const min_chunks = 1);
+
+// time apply for each candidate number of chunks and return the fastest.
+// apply(num_chunks) applies the system matrix once, split into that many
+// chunks; the first call for each candidate is a warm-up, left untimed, so
+// it can also build the chunks. if given, seconds receives each candidate's
+// best time per apply
+int fastest_chunk_count(std::vector<int> const &candidates,
+                        std::function<void(int)> const &apply,
+                        int const num_trials = 3,
+                        std::vector<double> *const seconds = nullptr);
+
+extern template std::vector<int>
+propose_chunk_counts(list_set const &connectivity, PDE<float> const &pde,
+                     kronmult_engine const engine,
+                     memory_hierarchy const &memory, int const workspace_MB,
+                     int const num_workspaces, int const min_chunks);
+extern template std::vector<int>
+propose_chunk_counts(list_set const &connectivity, PDE<double> const &pde,
+                     kronmult_engine const engine,
+                     memory_hierarchy const &memory, int const workspace_MB,
+                     int const num_workspaces, int const min_chunks);
@@ -0,0 +1,119 @@
+#include "planner.hpp"
+#include "tests_general.hpp"
+#include <chrono>
+#include <thread>
+
+TEST_CASE("memory hierarchy", "[planner]")
+{
+  SECTION("read from this machine")
+  {
+    memory_hierarchy const memory = read_memory_hierarchy();
+    REQUIRE(memory.l2_bytes >= 0);
+    REQUIRE(memory.l3_bytes >= 0);
+    REQUIRE(memory.memory_bytes >= 0);
+    if (memory.l2_bytes > 0 && memory.memory_bytes > 0)
+    {
+      REQUIRE(memory.l2_bytes < memory.memory_bytes);
+    }
+  }
+
+  SECTION("workspace budget")
+  {
+    memory_hierarchy unknown;
+    REQUIRE(workspace_budget_MB(unknown, 1000) == 1000);
+
+    memory_hierarchy memory;
+    memory.memory_bytes = 4000000000;
+    REQUIRE(workspace_budget_MB(memory, 1000) == 1000);
+    REQUIRE(workspace_budget_MB(memory, 10000) == 2000);
+  }
+}
+
+TEMPLATE_TEST_CASE("propose chunk counts", "[planner]", float, double)
+{
+  int const level  = 4;
+  int const degree = 3;
+  auto const pde = make_PDE<TestType>(PDE_opts::continuity_3, level, degree);
+  options const o = make_options(
+      {"-l", std::to_string(level), "-d", std::to_string(degree)});
+  element_table const table(o, pde->num_dims);
+  list_set const connectivity =
+      make_connectivity(table, pde->num_dims, level, level);
+  int64_t num_pairs = 0;
+  for (fk::vector<int> const &connected : connectivity)
+  {
+    num_pairs += connected.size();
+  }
+
+  kronmult_engine const engine = kronmult_engine::stacked;
+  int const workspace_MB       = 1000;
+
+  memory_hierarchy memory;
+  memory.l2_bytes = 100000;
+  memory.l3_bytes = 2000000;
+
+  SECTION("fit in the caches, then the budget")
+  {
+    std::vector<int> const counts = propose_chunk_counts(
+        connectivity, *pde, engine, memory, workspace_MB);
+    REQUIRE(counts.size() == 3);
+    // a smaller cache takes smaller chunks
+    REQUIRE(counts[0] < counts[1]);
+    REQUIRE(counts[2] ==
+            get_num_chunks(connectivity, *pde, 1, workspace_MB, engine));
+    REQUIRE(counts[2] <= counts[0]);
+
+    // a chunk's workspace is about the share of the cache planned
+    double const problem_MB =
+        get_element_size_MB(*pde, engine) * static_cast<double>(num_pairs);
+    REQUIRE(problem_MB / counts[1] <= 0.5 * memory.l2_bytes * 1e-6);
+    REQUIRE(problem_MB / (counts[1] - 1) > 0.5 * memory.l2_bytes * 1e-6);
+  }
+
+  SECTION("workspaces share the L3 cache")
+  {
+    std::vector<int> const one = propose_chunk_counts(
+        connectivity, *pde, engine, memory, workspace_MB);
+    std::vector<int> const four = propose_chunk_counts(
+        connectivity, *pde, engine, memory, workspace_MB, 4);
+    REQUIRE(four[0] > one[0]);
+    REQUIRE(four[1] == one[1]);
+  }
+
+  SECTION("unknown caches, and limits")
+  {
+    memory_hierarchy const unknown;
+    std::vector<int> const counts = propose_chunk_counts(
+        connectivity, *pde, engine, unknown, workspace_MB, 1, 5);
+    REQUIRE(counts == std::vector<int>{std::max(
+                          5, get_num_chunks(connectivity, *pde, 1,
+                                            workspace_MB, engine))});
+
+    memory_hierarchy tiny;
+    tiny.l2_bytes = 1;
+    std::vector<int> const finest = propose_chunk_counts(
+        connectivity, *pde, engine, tiny, workspace_MB);
+    REQUIRE(finest[0] == num_pairs);
+  }
+}
+
+TEST_CASE("fastest chunk count", "[planner]")
+{
+  std::vector<int> const candidates = {2, 8, 4};
+  std::vector<int> calls;
+  auto const apply = [&calls](int const num_chunks) {
+    calls.push_back(num_chunks);
+    std::this_thread::sleep_for(
+        std::chrono::milliseconds(num_chunks == 8 ? 1 : 20));
+  };
+
+  std::vector<double> seconds;
+  int const num_trials = 2;
+  REQUIRE(fastest_chunk_count(candidates, apply, num_trials, &seconds) == 8);
+  REQUIRE(seconds.size() == candidates.size());
+  REQUIRE(seconds[1] < seconds[0]);
+  REQUIRE(seconds[1] < seconds[2]);
+
+  // a warm-up, then the trials, for each candidate in turn
+  REQUIRE(calls == std::vector<int>{2, 2, 2, 8, 8, 8, 4, 4, 4});
+}
@@ -10,25 +10,56 @@ options::options(int argc, char **argv)
   // Parsing...
   auto cli =
       clara::detail::Help(show_help) |
+      clara::detail::Opt(use_autotune)["-a"]["--autotune"](
+          "Time the planned chunk counts and use the fastest") |
+      clara::detail::Opt(use_pipeline)["-b"]["--pipeline"](
+          "Pipeline the chunks through double-buffered workspaces") |
       clara::detail::Opt(cfl, "cfl")["-c"]["--cfl"](
-          "the Courant-Friedrichs-Lewy (CFL) condition") |
+          "the Courant-Friedrichs-Lewy (CFL) condition; 0 takes the time "
+          "scheme's default") |
       clara::detail::Opt(degree, "degree")["-d"]["--degree"](
           "Terms in legendre basis polynomials") |
+      clara::detail::Opt(selected_reduction, "reduction")["-e"]["--reduction"](
+          "Sum chunk products by gemv, column_sum, tree or in_place") |
       clara::detail::Opt(use_full_grid)["-f"]["--num_steps"](
           "Use full grid (vs. sparse grid)") |
       clara::detail::Opt(use_implicit_stepping)["-i"]["--implicit"](
           "Use implicit time advance (vs. explicit)") |
+      clara::detail::Opt(num_chunks, "chunks")["-k"]["--chunks"](
+          "Number of chunks to split the problem into, at least as many as the "
+          "-m budget needs; 0 plans them") |
       clara::detail::Opt(level, "level")["-l"]["--level"](
           "Hierarchical levels (resolution)") |
+      clara::detail::Opt(workspace_MB, "workspace_MB")["-m"]["--memory"](
+          "Budget for the chunks' workspaces, in MB") |
       clara::detail::Opt(num_time_steps, "time steps")["-n"]["--num_steps"](
           "Number of iterations") |
+      clara::detail::Opt(selected_ordering, "ordering")["-o"]["--ordering"](
+          "Element ordering: permutation, levels or morton") |
       clara::detail::Opt(selected_pde, "selected_pde")["-p"]["--pde"](
           "PDE to solve; see options.hpp for list") |
+      clara::detail::Opt(tolerance, "tolerance")["-q"]["--tolerance"](
+          "Error tolerance per adaptive or exponential step, or implicit "
+          "solve residual") |
+      clara::detail::Opt(num_threads, "threads")["-r"]["--threads"](
+          "Threads to apply the chunks across, and the most any loop uses; "
+          "0 uses all available") |
       clara::detail::Opt(do_poisson)["-s"]["--solve_poisson"](
           "Do poisson solve for electric field") |
+      clara::detail::Opt(drop_tol, "drop_tol")["-t"]["--drop_tol"](
+          "Skip coefficient blocks with no entry larger than this") |
+      clara::detail::Opt(selected_scheme, "scheme")["-u"]["--scheme"](
+          "Time advance: rk3, ssp_rk3, ls_rk3, ls_rk4, bs23 (adaptive), ab2, "
+          "ab3 (multistep), backward_euler or crank_nicolson (implicit), or "
+          "exponential") |
       clara::detail::Opt(write_frequency,
                          "write_frequency")["-w"]["--write_freq"](
           "Frequency in steps for writing output") |
+      clara::detail::Opt(use_reproducible)["-x"]["--reproducible"](
+          "Plan the given -k chunks the same on any machine, and sum in an "
+          "order the blas threads don't change") |
+      clara::detail::Opt(end_time, "end_time")["-y"]["--end_time"](
+          "Time adaptive steps run to; 0 runs as far as the fixed steps") |
       clara::detail::Opt(visualization_frequency,
                          "visualization_frequency")["-z"]["--vis_freq"](
           "Frequency in steps for visualizing output");
@@ -52,6 +83,43 @@ options::options(int argc, char **argv)
     std::cerr << "CFL must be non-negative" << std::endl;
     valid = false;
   }
+  if (drop_tol < 0.0)
+  {
+    std::cerr << "Drop tolerance must be non-negative" << std::endl;
+    valid = false;
+  }
+  if (tolerance <= 0.0)
+  {
+    std::cerr << "Tolerance must be positive" << std::endl;
+    valid = false;
+  }
+  if (end_time < 0.0)
+  {
+    std::cerr << "End time must be non-negative" << std::endl;
+    valid = false;
+  }
+  if (num_threads < 0)
+  {
+    std::cerr << "Number of threads must be non-negative" << std::endl;
+    valid = false;
+  }
+  if (workspace_MB < 1)
+  {
+    std::cerr << "Workspace budget must be a natural number" << std::endl;
+    valid = false;
+  }
+  if (num_chunks < 0)
+  {
+    std::cerr << "Number of chunks must be non-negative" << std::endl;
+    valid = false;
+  }
+  if (use_reproducible && num_chunks == 0)
+  {
+    std::cerr << "Reproducible runs need a number of chunks; reuse one from "
+                 "an earlier run's chunk plan"
+              << std::endl;
+    valid = false;
+  }
   if (degree < 1 && degree != -1)
   {
     std::cerr << "Degree must be a natural number" << std::endl;
@@ -80,6 +148,70 @@ options::options(int argc, char **argv)
     pde_choice = pde_mapping.at(selected_pde);
   }
 
+  auto const order = ordering_mapping.find(selected_ordering);
+  if (order == ordering_mapping.end())
+  {
+    std::cerr << "Invalid element ordering; choose permutation, levels or "
+                 "morton"
+              << std::endl;
+    valid = false;
+  }
+  else
+  {
+    ordering = order->second;
+  }
+
+  auto const sum = reduction_mapping.find(selected_reduction);
+  if (sum == reduction_mapping.end())
+  {
+    std::cerr << "Invalid reduction; choose gemv, column_sum, tree or in_place"
+              << std::endl;
+    valid = false;
+  }
+  else
+  {
+    reduction = sum->second;
+  }
+
+  // implicit stepping is by crank-nicolson unless another implicit scheme is
+  // named; naming one steps implicitly
+  if (selected_scheme.empty())
+  {
+    selected_scheme = use_implicit_stepping ? "crank_nicolson" : "rk3";
+  }
+  auto const advance = scheme_mapping.find(selected_scheme);
+  if (advance == scheme_mapping.end())
+  {
+    std::cerr << "Invalid time scheme; choose rk3, ssp_rk3, ls_rk3, ls_rk4, "
+                 "bs23, ab2, ab3, backward_euler, crank_nicolson or "
+                 "exponential"
+              << std::endl;
+    valid = false;
+  }
+  else
+  {
+    scheme = advance->second;
+    bool const implicit_scheme = scheme == time_scheme::backward_euler ||
+                                 scheme == time_scheme::crank_nicolson;
+    if (use_implicit_stepping && !implicit_scheme)
+    {
+      std::cerr << "Implicit stepping needs backward_euler or crank_nicolson"
+                << std::endl;
+      valid = false;
+    }
+    use_implicit_stepping = implicit_scheme;
+  }
+
+  // the multistep schemes are stable over shorter steps than rk3. along the
+  // imaginary axis, where advection's eigenvalues lie, ab3 is stable to 0.72
+  // and rk3 to sqrt(3); ab2 only through the upwind flux's damping
+  if (cfl == 0.0)
+  {
+    cfl = scheme == time_scheme::ab2   ? 0.03
+          : scheme == time_scheme::ab3 ? 0.04
+                                       : 0.1;
+  }
+
   if (visualization_frequency < 0 || write_frequency < 0)
   {
     std::cerr << "Frequencies must be non-negative: " << std::endl;
@@ -98,6 +230,18 @@ int options::get_visualization_frequency() const
 bool options::using_implicit() const { return use_implicit_stepping; }
 bool options::using_full_grid() const { return use_full_grid; }
 double options::get_cfl() const { return cfl; }
+double options::get_drop_tolerance() const { return drop_tol; }
+int options::get_num_threads() const { return num_threads; }
+bool options::using_pipeline() const { return use_pipeline; }
+int options::get_workspace_MB() const { return workspace_MB; }
+int options::get_num_chunks() const { return num_chunks; }
+bool options::using_autotune() const { return use_autotune; }
+bool options::using_reproducible() const { return use_reproducible; }
+element_ordering options::get_element_ordering() const { return ordering; }
+reduction_engine options::get_reduction() const { return reduction; }
+time_scheme options::get_time_scheme() const { return scheme; }
+double options::get_tolerance() const { return tolerance; }
+double options::get_end_time() const { return end_time; }
 PDE_opts options::get_selected_pde() const { return pde_choice; }
 std::string options::get_pde_string() const { return selected_pde; }
 bool options::is_valid() const { return valid; }
@@ -4,6 +4,74 @@
 #include <map>
 #include <string>
 
+// orders the element table can number elements in
+enum class element_ordering
+{
+  permutation, // level tuples in permutation order, then cells
+  levels,      // level tuples by level sum, coarsest first, then cells
+  morton       // z-order over the elements' cell centers
+};
+
+using ordering_map_t = std::map<std::string, element_ordering>;
+static ordering_map_t const ordering_mapping = {
+    {"permutation", element_ordering::permutation},
+    {"levels", element_ordering::levels},
+    {"morton", element_ordering::morton}};
+
+// how reduce_chunk (see chunk.hpp) sums each row's products into the batch
+// output
+enum class reduction_engine
+{
+  gemv,       // a gemv against a vector of ones
+  column_sum, // adding the products to the row one after another
+  tree,       // summing the products pairwise, with rows split across threads
+  in_place    // nothing left to do: the fused kernels add each product to its
+              // row of the batch output as they go, one row's products after
+              // another, so no reduction space is needed. fused engine only
+};
+
+using reduction_map_t = std::map<std::string, reduction_engine>;
+static reduction_map_t const reduction_mapping = {
+    {"gemv", reduction_engine::gemv},
+    {"column_sum", reduction_engine::column_sum},
+    {"tree", reduction_engine::tree},
+    {"in_place", reduction_engine::in_place}};
+
+// schemes for the time advance (see time_advance.hpp), and the
+// solution-length registers each keeps beside x and fx
+enum class time_scheme
+{
+  rk3,            // classic third-order runge-kutta; two registers
+  ssp_rk3,        // shu and osher's strong-stability-preserving third
+                  // order; one
+  ls_rk3,         // williamson's low-storage (2N) third order; one
+  ls_rk4,         // carpenter and kennedy's low-storage (2N), five-stage
+                  // fourth order; one
+  bs23,           // bogacki and shampine's third order, with an embedded
+                  // second order error estimate for adaptive steps; three
+  ab2,            // adams-bashforth second order, one evaluation a step
+                  // after a runge-kutta start; a ring of two derivatives
+  ab3,            // adams-bashforth third order, likewise; a ring of three
+  backward_euler, // implicit first order, solved by restarted gmres; two,
+                  // and the krylov basis
+  crank_nicolson, // implicit second order, likewise
+  exponential     // krylov approximation of the exact step; three, and the
+                  // krylov basis
+};
+
+using scheme_map_t = std::map<std::string, time_scheme>;
+static scheme_map_t const scheme_mapping = {
+    {"rk3", time_scheme::rk3},
+    {"ssp_rk3", time_scheme::ssp_rk3},
+    {"ls_rk3", time_scheme::ls_rk3},
+    {"ls_rk4", time_scheme::ls_rk4},
+    {"bs23", time_scheme::bs23},
+    {"ab2", time_scheme::ab2},
+    {"ab3", time_scheme::ab3},
+    {"backward_euler", time_scheme::backward_euler},
+    {"crank_nicolson", time_scheme::crank_nicolson},
+    {"exponential", time_scheme::exponential}};
+
 class options
 {
 private:
@@ -18,13 +86,52 @@ private:
   bool use_implicit_stepping  = false; // enable implicit(/explicit) stepping
   bool use_full_grid          = false; // enable full(/sparse) grid
   bool do_poisson             = false; // do poisson solve for electric field
-  double cfl = 0.1; // the Courant-Friedrichs-Lewy (CFL) condition
+  // the Courant-Friedrichs-Lewy (CFL) condition; 0 takes the time scheme's
+  // default
+  double cfl = 0.0;
+  // coefficient blocks with no larger entry are treated as zero
+  double drop_tol = 0.0;
+  // threads the chunks are applied across, and that the batched gemms,
+  // reductions and vector updates within them use; 0 uses every available
+  // thread
+  int num_threads = 0;
+  // pipeline the chunks through double-buffered workspaces, rather than
+  // dividing them among the threads
+  bool use_pipeline = false;
+  // budget for the workspaces the chunks are applied in
+  int workspace_MB = 1000;
+  // number of chunks to split the problem into, raised to the fewest whose
+  // workspaces fit the budget; 0 plans them
+  int num_chunks = 0;
+  // time the planned chunk counts and use the fastest
+  bool use_autotune = false;
+  // plan the given number of chunks by cost alone, not the machine's caches,
+  // memory or timings, and sum the rows in an order that doesn't depend on
+  // how the blas is threaded. shared rows are always merged in chunk order,
+  // so with this the sums are the same from run to run and, given the same
+  // blas, from machine to machine
+  bool use_reproducible = false;
+  // error tolerance per adaptive or exponential step, or the implicit solves'
+  // relative residual
+  double tolerance = 1e-6;
+  // time adaptive steps run to; 0 runs to the time of the fixed steps
+  double end_time = 0.0;
 
   // default
-  std::string selected_pde = "continuity_2";
+  std::string selected_pde       = "continuity_2";
+  std::string selected_ordering  = "permutation";
+  std::string selected_reduction = "gemv";
+  // rk3, or crank_nicolson if stepping implicitly
+  std::string selected_scheme    = "";
 
   // pde to construct/evaluate
   PDE_opts pde_choice;
+  // order to number the elements in
+  element_ordering ordering = element_ordering::permutation;
+  // how to sum the chunks' products
+  reduction_engine reduction = reduction_engine::gemv;
+  // how to advance the solution in time
+  time_scheme scheme = time_scheme::rk3;
 
   // is there a better (testable) way to handle invalid command-line input?
   bool valid = true;
@@ -41,6 +148,18 @@ public:
   bool using_implicit() const;
   bool using_full_grid() const;
   double get_cfl() const;
+  double get_drop_tolerance() const;
+  int get_num_threads() const;
+  bool using_pipeline() const;
+  int get_workspace_MB() const;
+  int get_num_chunks() const;
+  bool using_autotune() const;
+  bool using_reproducible() const;
+  element_ordering get_element_ordering() const;
+  reduction_engine get_reduction() const;
+  time_scheme get_time_scheme() const;
+  double get_tolerance() const;
+  double get_end_time() const;
   PDE_opts get_selected_pde() const;
   std::string get_pde_string() const;
   bool do_poisson_solve() const;
@@ -16,12 +16,22 @@ TEST_CASE("options constructor/getters", "[options]")
     int write              = 1;
     int vis                = 1;
     double cfl             = 2.0;
+    double drop_tol        = 1e-12;
+    int threads            = 3;
+    int workspace_MB       = 250;
+    int chunks             = 12;
 
     // set up test inputs directly from golden values
     options o = make_options({"-p", pde_choice, "-l", std::to_string(level),
                               "-d", std::to_string(degree), "-w",
                               std::to_string(write), "-z", std::to_string(vis),
-                              "-f", "-i", "-s", "-c", std::to_string(cfl)});
+                              "-f", "-i", "-s", "-b", "-c",
+                              std::to_string(cfl), "-t", "1e-12", "-r",
+                              std::to_string(threads), "-m",
+                              std::to_string(workspace_MB), "-k",
+                              std::to_string(chunks), "-a", "-o", "morton",
+                              "-e", "tree", "-x", "-u", "backward_euler",
+                              "-q", "1e-4", "-y", "0.5"});
 
     REQUIRE(o.get_degree() == degree);
     REQUIRE(o.get_level() == level);
@@ -30,6 +40,18 @@ TEST_CASE("options constructor/getters", "[options]")
     REQUIRE(o.using_full_grid());
     REQUIRE(o.do_poisson_solve());
     REQUIRE(o.get_cfl() == cfl);
+    REQUIRE(o.get_drop_tolerance() == drop_tol);
+    REQUIRE(o.get_num_threads() == threads);
+    REQUIRE(o.using_pipeline());
+    REQUIRE(o.get_workspace_MB() == workspace_MB);
+    REQUIRE(o.get_num_chunks() == chunks);
+    REQUIRE(o.using_autotune());
+    REQUIRE(o.get_element_ordering() == element_ordering::morton);
+    REQUIRE(o.get_reduction() == reduction_engine::tree);
+    REQUIRE(o.get_time_scheme() == time_scheme::backward_euler);
+    REQUIRE(o.get_tolerance() == 1e-4);
+    REQUIRE(o.get_end_time() == 0.5);
+    REQUIRE(o.using_reproducible());
     REQUIRE(o.get_selected_pde() == pde);
     REQUIRE(o.is_valid());
   }
@@ -45,6 +67,18 @@ TEST_CASE("options constructor/getters", "[options]")
     bool def_full_grid = false;
     bool def_poisson   = false;
     double def_cfl     = 0.1;
+    double def_drop    = 0.0;
+    int def_threads    = 0;
+    bool def_pipeline  = false;
+    int def_workspace  = 1000;
+    int def_chunks     = 0;
+    bool def_autotune  = false;
+    auto def_ordering  = element_ordering::permutation;
+    auto def_reduction = reduction_engine::gemv;
+    bool def_reproduce = false;
+    auto def_scheme    = time_scheme::rk3;
+    double def_tol     = 1e-6;
+    double def_end     = 0.0;
     PDE_opts def_pde   = PDE_opts::continuity_2;
 
     options o = make_options({});
@@ -58,6 +92,18 @@ TEST_CASE("options constructor/getters", "[options]")
     REQUIRE(o.using_full_grid() == def_full_grid);
     REQUIRE(o.do_poisson_solve() == def_poisson);
     REQUIRE(o.get_cfl() == def_cfl);
+    REQUIRE(o.get_drop_tolerance() == def_drop);
+    REQUIRE(o.get_num_threads() == def_threads);
+    REQUIRE(o.using_pipeline() == def_pipeline);
+    REQUIRE(o.get_workspace_MB() == def_workspace);
+    REQUIRE(o.get_num_chunks() == def_chunks);
+    REQUIRE(o.using_autotune() == def_autotune);
+    REQUIRE(o.get_element_ordering() == def_ordering);
+    REQUIRE(o.get_reduction() == def_reduction);
+    REQUIRE(o.get_time_scheme() == def_scheme);
+    REQUIRE(o.get_tolerance() == def_tol);
+    REQUIRE(o.get_end_time() == def_end);
+    REQUIRE(o.using_reproducible() == def_reproduce);
     REQUIRE(o.get_selected_pde() == def_pde);
     REQUIRE(o.is_valid());
   }
@@ -86,6 +132,14 @@ TEST_CASE("options constructor/getters", "[options]")
     REQUIRE(!o.is_valid());
   }
 
+  SECTION("reproducible without chunks")
+  {
+    std::cerr.setstate(std::ios_base::failbit);
+    options o = make_options({"asgard", "-x"});
+    std::cerr.clear();
+    REQUIRE(!o.is_valid());
+  }
+
   SECTION("negative cfl")
   {
     std::cerr.setstate(std::ios_base::failbit);
@@ -93,4 +147,102 @@ TEST_CASE("options constructor/getters", "[options]")
     std::cerr.clear();
     REQUIRE(!o.is_valid());
   }
+
+  SECTION("negative drop tolerance")
+  {
+    std::cerr.setstate(std::ios_base::failbit);
+    options o = make_options({"asgard", "-t=-1e-8"});
+    std::cerr.clear();
+    REQUIRE(!o.is_valid());
+  }
+
+  SECTION("negative thread count")
+  {
+    std::cerr.setstate(std::ios_base::failbit);
+    options o = make_options({"asgard", "-r=-1"});
+    std::cerr.clear();
+    REQUIRE(!o.is_valid());
+  }
+
+  SECTION("zero workspace budget")
+  {
+    std::cerr.setstate(std::ios_base::failbit);
+    options o = make_options({"asgard", "-m=0"});
+    std::cerr.clear();
+    REQUIRE(!o.is_valid());
+  }
+
+  SECTION("negative chunk count")
+  {
+    std::cerr.setstate(std::ios_base::failbit);
+    options o = make_options({"asgard", "-k=-1"});
+    std::cerr.clear();
+    REQUIRE(!o.is_valid());
+  }
+
+  SECTION("invalid element ordering")
+  {
+    std::cerr.setstate(std::ios_base::failbit);
+    options o = make_options({"asgard", "-o", "hilbert"});
+    std::cerr.clear();
+    REQUIRE(!o.is_valid());
+  }
+
+  SECTION("invalid reduction engine")
+  {
+    std::cerr.setstate(std::ios_base::failbit);
+    options o = make_options({"asgard", "-e", "atomic"});
+    std::cerr.clear();
+    REQUIRE(!o.is_valid());
+  }
+
+  SECTION("invalid time scheme")
+  {
+    std::cerr.setstate(std::ios_base::failbit);
+    options o = make_options({"-u", "rk45"});
+    std::cerr.clear();
+    REQUIRE(!o.is_valid());
+  }
+
+  SECTION("implicit schemes")
+  {
+    options const implicit = make_options({"-i"});
+    REQUIRE(implicit.using_implicit());
+    REQUIRE(implicit.get_time_scheme() == time_scheme::crank_nicolson);
+    REQUIRE(implicit.is_valid());
+
+    options const named = make_options({"-u", "backward_euler"});
+    REQUIRE(named.using_implicit());
+    REQUIRE(named.is_valid());
+
+    // the exponential scheme needs no solves
+    options const exponential = make_options({"-u", "exponential"});
+    REQUIRE(!exponential.using_implicit());
+    REQUIRE(exponential.get_time_scheme() == time_scheme::exponential);
+    REQUIRE(exponential.is_valid());
+
+    std::cerr.setstate(std::ios_base::failbit);
+    options const explicit_scheme = make_options({"-i", "-u", "rk3"});
+    std::cerr.clear();
+    REQUIRE(!explicit_scheme.is_valid());
+  }
+
+  SECTION("time scheme cfl defaults")
+  {
+    // the multistep schemes' stability limits are shorter
+    REQUIRE(make_options({"-u", "ab2"}).get_cfl() == 0.03);
+    REQUIRE(make_options({"-u", "ab3"}).get_cfl() == 0.04);
+    REQUIRE(make_options({"-u", "ls_rk4"}).get_cfl() == 0.1);
+    REQUIRE(make_options({"-u", "ab3", "-c", "0.02"}).get_cfl() == 0.02);
+  }
+
+  SECTION("non-positive tolerance, negative end time")
+  {
+    std::cerr.setstate(std::ios_base::failbit);
+    options const zero     = make_options({"-q", "0"});
+    options const negative = make_options({"-y", "-1"});
+    std::cerr.clear();
+    REQUIRE(!zero.is_valid());
+    REQUIRE(!negative.is_valid());
+  }
 }
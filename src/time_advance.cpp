@@ -1,21 +1,63 @@
 #include "time_advance.hpp"
 #include "element_table.hpp"
 #include "fast_math.hpp"
+#include "matlab_utilities.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
 
-// this function executes an explicit time step using the current solution
-// vector x. on exit, the next solution vector is stored in fx.
+// williamson's 2N-storage third-order runge-kutta. each stage evaluates the
+// right-hand side at time + c * dt, then updates the stage increment and the
+// solution in place: dq = a * dq + dt * f, x += b * dq. see
+// j. h. williamson, low-storage runge-kutta schemes, j. comput. phys. 35
+// (1980)
+static std::array<double, 3> constexpr ls_rk3_a = {0.0, -5.0 / 9.0,
+                                                   -153.0 / 128.0};
+static std::array<double, 3> constexpr ls_rk3_b = {1.0 / 3.0, 15.0 / 16.0,
+                                                   8.0 / 15.0};
+static std::array<double, 3> constexpr ls_rk3_c = {0.0, 1.0 / 3.0, 3.0 / 4.0};
+
+// carpenter and kennedy's five-stage, 2N-storage fourth-order runge-kutta,
+// nasa tm-109112 (1994)
+static std::array<double, 5> constexpr ls_rk4_a = {
+    0.0, -567301805773.0 / 1357537059087.0,
+    -2404267990393.0 / 2016746695238.0, -3550918686646.0 / 2091501179385.0,
+    -1275806237668.0 / 842570457699.0};
+static std::array<double, 5> constexpr ls_rk4_b = {
+    1432997174477.0 / 9575080441755.0, 5161836677717.0 / 13612068292357.0,
+    1720146321549.0 / 2090206949498.0, 3134564353537.0 / 4481467310338.0,
+    2277821191437.0 / 14882151754819.0};
+static std::array<double, 5> constexpr ls_rk4_c = {
+    0.0, 1432997174477.0 / 9575080441755.0,
+    2526269341429.0 / 6820363962896.0, 2006345519317.0 / 3224310063776.0,
+    2802321613138.0 / 2924317926251.0};
+
+// adams-bashforth weights on the derivatives at the step's start and the
+// steps before it, newest first
+static std::array<double, 2> constexpr ab2_weights = {3.0 / 2.0, -1.0 / 2.0};
+static std::array<double, 3> constexpr ab3_weights = {23.0 / 12.0, -4.0 / 3.0,
+                                                      5.0 / 12.0};
+
+// bogacki and shampine's 3(2) pair, appl. math. lett. 2 (1989). steps are
+// grown or shrunk toward the error the tolerance allows, by a factor within
+// these limits
+static double constexpr bs23_safety     = 0.9;
+static double constexpr bs23_min_factor = 0.2;
+static double constexpr bs23_max_factor = 5.0;
+
+// exponential substeps are likewise grown or shrunk, as in sidje's expokit,
+// acm trans. math. softw. 24 (1998)
+static double constexpr exponential_safety     = 0.9;
+static double constexpr exponential_min_factor = 0.2;
+static double constexpr exponential_max_factor = 5.0;
+
+// the classic third-order runge-kutta, keeping the starting solution and the
+// first stage's derivative - later, the first two stages' share of the step
 template<typename P>
-void explicit_time_advance(PDE<P> const &pde, element_table const &table,
-                           std::vector<fk::vector<P>> const &unscaled_sources,
-                           host_workspace<P> &host_space,
-                           rank_workspace<P> &rank_space,
-                           std::vector<element_chunk> chunks, P const time,
-                           P const dt)
+static void rk3_step(host_workspace<P> &host_space, rhs_function<P> const &rhs,
+                     P const time, P const dt)
 {
-  assert(time >= 0);
-  assert(dt > 0);
-  assert(static_cast<int>(unscaled_sources.size()) == pde.num_sources);
-
   fm::copy(host_space.x, host_space.x_orig);
   // see
   // https://en.wikipedia.org/wiki/Runge%E2%80%93Kutta_methods#Explicit_Runge%E2%80%93Kutta_methods
@@ -28,109 +70,944 @@ void explicit_time_advance(PDE<P> const &pde, element_table const &table,
   P const c2  = 1.0 / 2.0;
   P const c3  = 1.0;
 
-  apply_explicit(pde, table, chunks, host_space, rank_space);
-  scale_sources(pde, unscaled_sources, host_space.scaled_source, time);
-  fm::axpy(host_space.scaled_source, host_space.fx);
+  rhs(time);
   fm::copy(host_space.fx, host_space.result_1);
   P const fx_scale_1 = a21 * dt;
   fm::axpy(host_space.fx, host_space.x, fx_scale_1);
 
-  apply_explicit(pde, table, chunks, host_space, rank_space);
-  scale_sources(pde, unscaled_sources, host_space.scaled_source,
-                time + c2 * dt);
-  fm::axpy(host_space.scaled_source, host_space.fx);
-  fm::copy(host_space.fx, host_space.result_2);
-  fm::copy(host_space.x_orig, host_space.x);
-  P const fx_scale_2a = a31 * dt;
-  P const fx_scale_2b = a32 * dt;
-  fm::axpy(host_space.result_1, host_space.x, fx_scale_2a);
-  fm::axpy(host_space.result_2, host_space.x, fx_scale_2b);
-
-  apply_explicit(pde, table, chunks, host_space, rank_space);
-  scale_sources(pde, unscaled_sources, host_space.scaled_source,
-                time + c3 * dt);
-  fm::axpy(host_space.scaled_source, host_space.fx);
-  fm::copy(host_space.fx, host_space.result_3);
-
-  P const scale_1 = dt * b1;
-  P const scale_2 = dt * b2;
-  P const scale_3 = dt * b3;
-
-  fm::copy(host_space.x_orig, host_space.x);
-  fm::axpy(host_space.result_1, host_space.x, scale_1);
-  fm::axpy(host_space.result_2, host_space.x, scale_2);
-  fm::axpy(host_space.result_3, host_space.x, scale_3);
+  P const one = 1.0;
+  rhs(time + c2 * dt);
+  fm::lincomb<P>({{one, &host_space.x_orig},
+                  {a31 * dt, &host_space.result_1},
+                  {a32 * dt, &host_space.fx}},
+                 host_space.x);
+  fm::lincomb<P>({{b2 * dt, &host_space.fx}}, host_space.result_1, b1 * dt);
+
+  rhs(time + c3 * dt);
+  fm::lincomb<P>({{one, &host_space.x_orig},
+                  {one, &host_space.result_1},
+                  {b3 * dt, &host_space.fx}},
+                 host_space.x);
+}
+
+// shu and osher's ssp third order: each stage is a forward euler step,
+// blended with the starting solution
+template<typename P>
+static void ssp_rk3_step(host_workspace<P> &host_space,
+                         rhs_function<P> const &rhs, P const time, P const dt)
+{
+  fm::copy(host_space.x, host_space.x_orig);
+
+  rhs(time);
+  fm::axpy(host_space.fx, host_space.x, dt);
+
+  // x = 3/4 x_orig + 1/4 (x + dt f)
+  rhs(time + dt);
+  P const quarter = 0.25;
+  fm::lincomb<P>({{quarter * dt, &host_space.fx},
+                  {1 - quarter, &host_space.x_orig}},
+                 host_space.x, quarter);
+
+  // x = 1/3 x_orig + 2/3 (x + dt f)
+  rhs(time + static_cast<P>(0.5) * dt);
+  P const two_thirds = 2.0 / 3.0;
+  fm::lincomb<P>({{two_thirds * dt, &host_space.fx},
+                  {1 - two_thirds, &host_space.x_orig}},
+                 host_space.x, two_thirds);
+}
+
+// a 2N-storage scheme, with the stage increment kept in increment. if given
+// the derivative at x, the first stage starts from it rather than
+// evaluating the right-hand side
+template<typename P, std::size_t num_stages>
+static void
+low_storage_step(host_workspace<P> &host_space, rhs_function<P> const &rhs,
+                 P const time, P const dt,
+                 std::array<double, num_stages> const &a,
+                 std::array<double, num_stages> const &b,
+                 std::array<double, num_stages> const &c,
+                 fk::vector<P> &increment,
+                 fk::vector<P> const *const derivative = nullptr)
+{
+  for (std::size_t i = 0; i < num_stages; ++i)
+  {
+    fk::vector<P> const *stage_derivative = &host_space.fx;
+    if (i == 0 && derivative)
+    {
+      stage_derivative = derivative;
+    }
+    else
+    {
+      rhs(time + static_cast<P>(c[i]) * dt);
+    }
+    fm::lincomb<P>({{dt, stage_derivative}}, increment, a[i]);
+    fm::axpy(increment, host_space.x, static_cast<P>(b[i]));
+  }
+}
+
+// an adams-bashforth step: one evaluation of the right-hand side, at the
+// step's start, stored in the ring and combined with the last steps'. until
+// the ring is full, the steps are williamson's third order instead, their
+// first stages from the derivative just stored and their stage increments
+// in the slot to be filled next
+template<typename P, std::size_t order>
+static void adams_bashforth_step(host_workspace<P> &host_space,
+                                 rhs_function<P> const &rhs, P const time,
+                                 P const dt,
+                                 std::array<double, order> const &weights)
+{
+  std::vector<fk::vector<P>> &ring = host_space.derivatives;
+  int const size                   = static_cast<int>(order);
+  assert(static_cast<int>(ring.size()) == size);
+
+  int const newest = (host_space.newest_derivative + 1) % size;
+  rhs(time);
+  fm::copy(host_space.fx, ring[newest]);
+  host_space.newest_derivative = newest;
+  host_space.num_derivatives   = std::min(host_space.num_derivatives + 1, size);
+
+  if (host_space.num_derivatives < size)
+  {
+    low_storage_step(host_space, rhs, time, dt, ls_rk3_a, ls_rk3_b, ls_rk3_c,
+                     ring[(newest + 1) % size], &ring[newest]);
+    return;
+  }
+  fm::scaled_vectors<P> combination;
+  for (int i = 0; i < size; ++i)
+  {
+    int const slot = (newest - i + size) % size;
+    combination.emplace_back(weights[i] * dt, &ring[slot]);
+  }
+  fm::lincomb(combination, host_space.x, static_cast<P>(1.0));
+}
+
+// one bogacki-shampine step from x_orig, starting from the derivative there
+// in result_1, which is left as it was. leaves the third-order solution in
+// x, the derivative there in fx and the error estimate, per unit dt, in
+// result_2
+template<typename P>
+static void bs23_attempt(host_workspace<P> &host_space,
+                         rhs_function<P> const &rhs, P const time, P const dt)
+{
+  P const one = 1.0;
+  fm::lincomb<P>({{one, &host_space.x_orig}, {dt / 2, &host_space.result_1}},
+                 host_space.x);
+
+  rhs(time + dt / 2);
+  fm::lincomb<P>({{-5.0 / 72.0, &host_space.result_1},
+                  {1.0 / 12.0, &host_space.fx}},
+                 host_space.result_2);
+  fm::lincomb<P>({{one, &host_space.x_orig}, {dt * 3 / 4, &host_space.fx}},
+                 host_space.x);
+
+  // the solution's share of the first two derivatives, 2/9 k1 + 1/3 k2, is
+  // 4 result_2 + 1/2 k1
+  rhs(time + dt * 3 / 4);
+  fm::lincomb<P>({{one, &host_space.x_orig},
+                  {dt * 4, &host_space.result_2},
+                  {dt / 2, &host_space.result_1},
+                  {dt * 4 / 9, &host_space.fx}},
+                 host_space.x);
+  fm::axpy(host_space.fx, host_space.result_2, static_cast<P>(1.0 / 9.0));
+
+  rhs(time + dt);
+  fm::axpy(host_space.fx, host_space.result_2, static_cast<P>(-1.0 / 8.0));
+}
+
+// the root mean square of the error estimate, relative to the tolerance
+template<typename P>
+static double bs23_error(host_workspace<P> const &host_space, P const dt,
+                         double const tolerance)
+{
+  double sum = 0.0;
+  for (int i = 0; i < host_space.x.size(); ++i)
+  {
+    double const scale =
+        tolerance * (1.0 + std::max(std::abs(host_space.x_orig(i)),
+                                    std::abs(host_space.x(i))));
+    double const error = dt * host_space.result_2(i) / scale;
+    sum += error * error;
+  }
+  return std::sqrt(sum / host_space.x.size());
+}
+
+// a bs23 step, which is error-controlled if given the control. a rejected
+// step starts over from the same derivative at x_orig, with a smaller step.
+// the derivative at the new solution is left in result_1 for the next step
+template<typename P>
+static P bs23_step(host_workspace<P> &host_space, rhs_function<P> const &rhs,
+                   P const time, P dt, step_control *const control)
+{
+  int64_t num_evaluations = 0;
+  if (!host_space.has_derivative || (control && !control->reuse_derivative))
+  {
+    rhs(time);
+    fm::copy(host_space.fx, host_space.result_1);
+    ++num_evaluations;
+  }
+  fm::copy(host_space.x, host_space.x_orig);
+  if (control)
+  {
+    control->failed = false;
+  }
+  int rejections = 0;
+  while (true)
+  {
+    bs23_attempt(host_space, rhs, time, dt);
+    num_evaluations += 3;
+    if (!control)
+    {
+      break;
+    }
+
+    // the error estimate goes as the cube of the step
+    double const error  = bs23_error(host_space, dt, control->tolerance);
+    double const factor = std::isfinite(error)
+                              ? std::clamp(bs23_safety / std::cbrt(error),
+                                           bs23_min_factor, bs23_max_factor)
+                              : bs23_min_factor;
+    if (error <= 1.0)
+    {
+      control->next_dt = dt * factor;
+      break;
+    }
+    ++control->num_rejected;
+    dt *= factor;
 
+    // give up, leaving the solution as it was. result_1 still holds its
+    // derivative
+    if (++rejections >= control->max_rejections || !(time + dt > time))
+    {
+      fm::copy(host_space.x_orig, host_space.x);
+      host_space.has_derivative = true;
+      control->failed           = true;
+      control->num_evaluations += num_evaluations;
+      return 0.0;
+    }
+  }
+
+  fm::copy(host_space.fx, host_space.result_1);
+  host_space.has_derivative = true;
+  if (control)
+  {
+    control->num_evaluations += num_evaluations;
+  }
+  return dt;
+}
+
+template<typename P>
+void explicit_step(host_workspace<P> &host_space, rhs_function<P> const &rhs,
+                   P const time, P const dt)
+{
+  assert(time >= 0);
+  assert(dt > 0);
+
+  switch (host_space.get_scheme())
+  {
+  case time_scheme::rk3:
+    rk3_step(host_space, rhs, time, dt);
+    break;
+  case time_scheme::ssp_rk3:
+    ssp_rk3_step(host_space, rhs, time, dt);
+    break;
+  case time_scheme::ls_rk3:
+    low_storage_step(host_space, rhs, time, dt, ls_rk3_a, ls_rk3_b, ls_rk3_c,
+                     host_space.result_1);
+    break;
+  case time_scheme::ls_rk4:
+    low_storage_step(host_space, rhs, time, dt, ls_rk4_a, ls_rk4_b, ls_rk4_c,
+                     host_space.result_1);
+    break;
+  case time_scheme::bs23:
+    // the third-order solution, whatever its error
+    bs23_step(host_space, rhs, time, dt, nullptr);
+    break;
+  case time_scheme::ab2:
+    adams_bashforth_step(host_space, rhs, time, dt, ab2_weights);
+    break;
+  case time_scheme::ab3:
+    adams_bashforth_step(host_space, rhs, time, dt, ab3_weights);
+    break;
+  case time_scheme::backward_euler:
+  case time_scheme::crank_nicolson:
+  case time_scheme::exponential:
+    // these need the system matrix apart from the sources; see implicit_step
+    // and exponential_step
+    assert(false);
+    break;
+  }
+
+  fm::copy(host_space.x, host_space.fx);
+}
+
+template<typename P>
+P adaptive_step(host_workspace<P> &host_space, rhs_function<P> const &rhs,
+                P const time, P const dt, step_control &control)
+{
+  assert(time >= 0);
+  assert(dt > 0);
+  assert(control.tolerance > 0);
+  assert(host_space.get_scheme() == time_scheme::bs23);
+
+  P const taken = bs23_step(host_space, rhs, time, dt, &control);
   fm::copy(host_space.x, host_space.fx);
+  return taken;
 }
-// scale source vectors for time
+
+// solve (I - scale A) u = b by gmres, restarted every krylov_dimension
+// iterations, with b in x_orig and u in result_1, which holds the initial
+// guess. x and fx are used to apply A. returns the iterations taken
 template<typename P>
-static fk::vector<P> &
-scale_sources(PDE<P> const &pde,
-              std::vector<fk::vector<P>> const &unscaled_sources,
-              fk::vector<P> &scaled_source, P const time)
+static int gmres(host_workspace<P> &host_space, apply_function const &apply,
+                 P const scale, krylov_control &control)
 {
-  // zero out final vect
-  fm::scal(static_cast<P>(0.0), scaled_source);
-  // scale and accumulate all sources
+  std::vector<fk::vector<P>> &basis = host_space.krylov_basis;
+  fk::vector<P> const &b            = host_space.x_orig;
+  fk::vector<P> &u                  = host_space.result_1;
+  int const restart                 = static_cast<int>(basis.size()) - 1;
+  assert(restart > 0);
+
+  // v = (I - scale A) w
+  P const one   = 1.0;
+  auto const op = [&](fk::vector<P> const &w, fk::vector<P> &v) {
+    fm::copy(w, host_space.x);
+    apply();
+    fm::lincomb<P>({{one, &w}, {-scale, &host_space.fx}}, v);
+  };
+  auto const norm = [](fk::vector<P> const &v) { return std::sqrt(v * v); };
+
+  double const target = control.tolerance * norm(b);
+  // the hessenberg matrix, reduced to upper triangular by givens rotations
+  // as it's built, and the residual's coordinates in the basis
+  fk::matrix<double> hessenberg(restart + 1, restart);
+  std::vector<double> cosines(restart);
+  std::vector<double> sines(restart);
+  std::vector<double> residual(restart + 1);
+
+  int iterations    = 0;
+  control.converged = false;
+  for (int cycle = 0; cycle <= control.max_restarts; ++cycle)
+  {
+    op(u, basis[0]);
+    fm::lincomb<P>({{one, &b}}, basis[0], -one);
+    double const residual_norm = norm(basis[0]);
+    if (residual_norm <= target)
+    {
+      control.converged = true;
+      break;
+    }
+    fm::scal(static_cast<P>(1.0 / residual_norm), basis[0]);
+    std::fill(residual.begin(), residual.end(), 0.0);
+    residual[0] = residual_norm;
+
+    // arnoldi, orthogonalizing each new direction by modified gram-schmidt
+    int k = 0;
+    while (k < restart && std::abs(residual[k]) > target)
+    {
+      op(basis[k], basis[k + 1]);
+      for (int i = 0; i <= k; ++i)
+      {
+        hessenberg(i, k) = basis[k + 1] * basis[i];
+        fm::axpy(basis[i], basis[k + 1], static_cast<P>(-hessenberg(i, k)));
+      }
+      hessenberg(k + 1, k) = norm(basis[k + 1]);
+      if (hessenberg(k + 1, k) > 0.0)
+      {
+        fm::scal(static_cast<P>(1.0 / hessenberg(k + 1, k)), basis[k + 1]);
+      }
+
+      // rotate the new column by the earlier rotations, then zero its last
+      // entry with a new one
+      for (int i = 0; i < k; ++i)
+      {
+        double const upper   = hessenberg(i, k);
+        double const lower   = hessenberg(i + 1, k);
+        hessenberg(i, k)     = cosines[i] * upper + sines[i] * lower;
+        hessenberg(i + 1, k) = cosines[i] * lower - sines[i] * upper;
+      }
+      double const radius  = std::hypot(hessenberg(k, k), hessenberg(k + 1, k));
+      cosines[k]           = hessenberg(k, k) / radius;
+      sines[k]             = hessenberg(k + 1, k) / radius;
+      hessenberg(k, k)     = radius;
+      hessenberg(k + 1, k) = 0.0;
+      residual[k + 1]      = -sines[k] * residual[k];
+      residual[k]          = cosines[k] * residual[k];
+      ++k;
+      ++iterations;
+    }
+
+    // u += the basis combination minimizing the residual
+    std::vector<double> coefficients(k);
+    fm::scaled_vectors<P> update;
+    for (int i = k - 1; i >= 0; --i)
+    {
+      double sum = residual[i];
+      for (int j = i + 1; j < k; ++j)
+      {
+        sum -= hessenberg(i, j) * coefficients[j];
+      }
+      coefficients[i] = sum / hessenberg(i, i);
+      update.emplace_back(coefficients[i], &basis[i]);
+    }
+    fm::lincomb(update, u, one);
+    if (std::abs(residual[k]) <= target)
+    {
+      control.converged = true;
+      break;
+    }
+  }
+  return iterations;
+}
+
+template<typename P>
+int implicit_step(host_workspace<P> &host_space, apply_function const &apply,
+                  source_function<P> const &add_sources, P const time,
+                  P const dt, krylov_control &control)
+{
+  assert(time >= 0);
+  assert(dt > 0);
+  assert(control.tolerance > 0);
+  time_scheme const scheme = host_space.get_scheme();
+  assert(scheme == time_scheme::backward_euler ||
+         scheme == time_scheme::crank_nicolson);
+
+  // the right-hand side
+  P const theta = scheme == time_scheme::backward_euler ? 1.0 : 0.5;
+  fm::copy(host_space.x, host_space.x_orig);
+  if (scheme == time_scheme::crank_nicolson)
+  {
+    apply();
+    fm::axpy(host_space.fx, host_space.x_orig, (1 - theta) * dt);
+    add_sources(time, (1 - theta) * dt, host_space.x_orig);
+  }
+  add_sources(time + dt, theta * dt, host_space.x_orig);
+
+  if (control.warm_start)
+  {
+    fm::copy(host_space.x, host_space.result_1);
+  }
+  else
+  {
+    fm::scal(static_cast<P>(0.0), host_space.result_1);
+  }
+  int const iterations = gmres(host_space, apply, theta * dt, control);
+  control.iterations   = iterations;
+  control.total_iterations += iterations;
+
+  fm::copy(host_space.result_1, host_space.x);
+  fm::copy(host_space.result_1, host_space.fx);
+  return iterations;
+}
+
+// the exponential of a small dense matrix, by scaling and squaring its
+// taylor series
+static fk::matrix<double> dense_exponential(fk::matrix<double> const &m)
+{
+  assert(m.nrows() == m.ncols());
+  double norm = 0.0;
+  for (int i = 0; i < m.nrows(); ++i)
+  {
+    double row = 0.0;
+    for (int j = 0; j < m.ncols(); ++j)
+    {
+      row += std::abs(m(i, j));
+    }
+    norm = std::max(norm, row);
+  }
+
+  // halve until the norm is at most 1/2, where 18 terms of the series are
+  // exact to double precision, then square back
+  int const squarings =
+      norm > 0.5 ? static_cast<int>(std::ceil(std::log2(norm / 0.5))) : 0;
+  fk::matrix<double> const scaled = m * std::ldexp(1.0, -squarings);
+  fk::matrix<double> result       = eye<double>(m.nrows());
+  fk::matrix<double> term         = eye<double>(m.nrows());
+  for (int k = 1; k <= 18; ++k)
+  {
+    term   = term * scaled * (1.0 / k);
+    result = result + term;
+  }
+  for (int i = 0; i < squarings; ++i)
+  {
+    result = result * result;
+  }
+  return result;
+}
+
+template<typename P>
+int exponential_step(host_workspace<P> &host_space,
+                     apply_function const &apply,
+                     source_function<P> const &add_sources, P const time,
+                     P const dt, krylov_control &control)
+{
+  assert(time >= 0);
+  assert(dt > 0);
+  assert(control.tolerance > 0);
+  assert(host_space.get_scheme() == time_scheme::exponential);
+
+  std::vector<fk::vector<P>> &basis = host_space.krylov_basis;
+  int const dimension               = static_cast<int>(basis.size()) - 1;
+  assert(dimension > 0);
+
+  // over a substep, the sources s are interpolated by a quadratic in the time
+  // into it, r: s = w0 r^2 / 2 + w1 r + w2. the krylov vectors are augmented
+  // by three entries that evolve as (r^2 / 2, r, 1) do, so that the system
+  // is linear: (v, t) -> (A v + w t, t1, t2, 0)
+  std::array<fk::vector<P> *, 3> const w = {
+      &host_space.result_2, &host_space.result_1, &host_space.x_orig};
+  fk::matrix<double> tails(dimension + 1, 3);
+  fk::matrix<double> hessenberg(dimension + 1, dimension);
+
+  auto const dot = [&](int const i, int const j) {
+    double sum = basis[i] * basis[j];
+    for (int k = 0; k < 3; ++k)
+    {
+      sum += tails(i, k) * tails(j, k);
+    }
+    return sum;
+  };
+  auto const scale = [&](int const i, double const factor) {
+    fm::scal(static_cast<P>(factor), basis[i]);
+    for (int k = 0; k < 3; ++k)
+    {
+      tails(i, k) *= factor;
+    }
+  };
+
+  P const one    = 1.0;
+  int iterations = 0;
+  int builds     = 0;
+  int substeps   = 0;
+  // the time into the step, and the substep to try next
+  P elapsed         = 0.0;
+  double proposed   = control.next_substep > 0.0 ? control.next_substep : dt;
+  control.converged = true;
+  while (elapsed < dt)
+  {
+    // the last basis allowed takes the rest of the step
+    bool const last  = builds == control.max_restarts;
+    P const h        = last ? dt - elapsed
+                            : std::min(static_cast<P>(proposed), dt - elapsed);
+    P const start    = time + elapsed;
+    bool const final = h == dt - elapsed;
+    ++builds;
+
+    // the interpolant through the sources at the substep's ends and middle
+    for (fk::vector<P> *const v : w)
+    {
+      fm::scal(static_cast<P>(0.0), *v);
+    }
+    add_sources(start, 4 / (h * h), *w[0]);
+    add_sources(start + h / 2, -8 / (h * h), *w[0]);
+    add_sources(start + h, 4 / (h * h), *w[0]);
+    add_sources(start, -3 / h, *w[1]);
+    add_sources(start + h / 2, 4 / h, *w[1]);
+    add_sources(start + h, -1 / h, *w[1]);
+    add_sources(start, one, *w[2]);
+    bool const sourced = *w[0] * *w[0] + *w[1] * *w[1] + *w[2] * *w[2] > 0;
+
+    fm::copy(host_space.x, basis[0]);
+    tails(0, 0)       = 0.0;
+    tails(0, 1)       = 0.0;
+    tails(0, 2)       = sourced ? 1.0 : 0.0;
+    double const beta = std::sqrt(dot(0, 0));
+    if (beta == 0.0)
+    {
+      // nothing to advance
+      break;
+    }
+    scale(0, 1.0 / beta);
+
+    // arnoldi, orthogonalizing each new direction by modified gram-schmidt,
+    // until the basis is full or spans an invariant subspace
+    int m          = 0;
+    bool invariant = false;
+    while (m < dimension && !invariant)
+    {
+      fm::copy(basis[m], host_space.x);
+      apply();
+      fm::lincomb<P>({{one, &host_space.fx},
+                      {static_cast<P>(tails(m, 0)), w[0]},
+                      {static_cast<P>(tails(m, 1)), w[1]},
+                      {static_cast<P>(tails(m, 2)), w[2]}},
+                     basis[m + 1]);
+      tails(m + 1, 0) = tails(m, 1);
+      tails(m + 1, 1) = tails(m, 2);
+      tails(m + 1, 2) = 0.0;
+      ++iterations;
+
+      double const applied = std::sqrt(dot(m + 1, m + 1));
+      for (int i = 0; i <= m; ++i)
+      {
+        hessenberg(i, m) = dot(m + 1, i);
+        fm::axpy(basis[i], basis[m + 1], static_cast<P>(-hessenberg(i, m)));
+        for (int k = 0; k < 3; ++k)
+        {
+          tails(m + 1, k) -= hessenberg(i, m) * tails(i, k);
+        }
+      }
+      hessenberg(m + 1, m) = std::sqrt(dot(m + 1, m + 1));
+      // the new direction is lost to rounding
+      invariant = hessenberg(m + 1, m) <=
+                  100 * std::numeric_limits<P>::epsilon() * applied;
+      if (!invariant)
+      {
+        scale(m + 1, 1.0 / hessenberg(m + 1, m));
+      }
+      ++m;
+    }
+
+    // exp of [h H, e1; 0, 0] holds exp(h H) e1 in its first column, and
+    // phi1(h H) e1, for the error estimate, in its last
+    fk::matrix<double> projected(m + 1, m + 1);
+    for (int i = 0; i < m; ++i)
+    {
+      for (int j = 0; j < m; ++j)
+      {
+        projected(i, j) = h * hessenberg(i, j);
+      }
+    }
+    projected(0, m) = 1.0;
+
+    fk::matrix<double> const exponent = dense_exponential(projected);
+
+    // saad's error estimate, zero in an invariant subspace
+    double const residual = invariant ? 0.0 : hessenberg(m, m - 1);
+    double const estimate = beta * residual * h * std::abs(exponent(m - 1, m));
+    double const allowed  = control.tolerance * beta * h / dt;
+
+    // the substep that would just meet the tolerance, within limits
+    double const factor =
+        estimate > 0.0
+            ? std::clamp(exponential_safety *
+                             std::pow(allowed / estimate, 1.0 / m),
+                         exponential_min_factor, exponential_max_factor)
+            : exponential_max_factor;
+    proposed = h * factor;
+
+    if (estimate <= allowed || last)
+    {
+      control.converged = control.converged && estimate <= allowed;
+      fm::scaled_vectors<P> solution;
+      for (int i = 0; i < m; ++i)
+      {
+        solution.emplace_back(beta * exponent(i, 0), &basis[i]);
+      }
+      fm::lincomb(solution, host_space.x);
+      elapsed = final ? dt : elapsed + h;
+      ++substeps;
+    }
+    else
+    {
+      // x was used to apply A
+      fm::lincomb<P>({{static_cast<P>(beta), &basis[0]}}, host_space.x);
+    }
+  }
+
+  control.next_substep = proposed;
+  control.iterations   = iterations;
+  control.total_iterations += iterations;
+  control.substeps = substeps;
+  fm::copy(host_space.x, host_space.fx);
+  return iterations;
+}
+
+// add the sources at time, times scale, to y in one pass
+template<typename P>
+static void add_sources(PDE<P> const &pde,
+                        std::vector<fk::vector<P>> const &unscaled_sources,
+                        fk::vector<P> &y, P const time, P const scale = 1.0)
+{
+  fm::scaled_vectors<P> scaled_sources;
   for (int i = 0; i < pde.num_sources; ++i)
   {
-    fm::axpy(unscaled_sources[i], scaled_source,
-             pde.sources[i].time_func(time));
+    scaled_sources.emplace_back(scale * pde.sources[i].time_func(time),
+                                &unscaled_sources[i]);
   }
-  return scaled_source;
+  fm::lincomb(scaled_sources, y, static_cast<P>(1.0));
 }
 
 // apply the system matrix to the current solution vector using batched
 // gemm (explicit time advance).
 template<typename P>
-static void
-apply_explicit(PDE<P> const &pde, element_table const &elem_table,
-               std::vector<element_chunk> const &chunks,
-               host_workspace<P> &host_space, rank_workspace<P> &rank_space)
+static void apply_explicit(PDE<P> const &pde,
+                           std::vector<element_chunk> const &chunks,
+                           batch_plan<P> const &plan,
+                           host_workspace<P> &host_space,
+                           rank_workspace<P> &rank_space,
+                           chunk_executor<P> *const executor)
 {
+  assert(plan.num_chunks() == static_cast<int>(chunks.size()));
+
+  if (executor)
+  {
+    executor->apply(pde, chunks, plan, host_space, rank_space);
+    return;
+  }
+
   fm::scal(static_cast<P>(0.0), host_space.fx);
-  for (auto const &chunk : chunks)
+  for (int chunk_index = 0; chunk_index < plan.num_chunks(); ++chunk_index)
   {
+    element_chunk const &chunk = chunks[chunk_index];
+
     // copy in inputs
     copy_chunk_inputs(pde, rank_space, host_space, chunk);
 
-    // build batches for this chunk
-    std::vector<batch_operands_set<P>> batches =
-        build_batches(pde, elem_table, rank_space, chunk);
-
-    // do the gemms
-    P const alpha = 1.0;
-    P const beta  = 0.0;
-    for (int i = 0; i < pde.num_dims; ++i)
+    // replay this chunk's prebuilt batches
+    if (plan.is_fused())
+    {
+      batched_kronmult(plan.get_kron_batch(chunk_index),
+                       rank_space.batch_intermediate);
+    }
+    else
     {
-      batch<P> const a = batches[i][0];
-      batch<P> const b = batches[i][1];
-      batch<P> const c = batches[i][2];
+      std::vector<batch_operands_set<P>> const &batches =
+          plan.get_batches(chunk_index);
 
-      batched_gemm(a, b, c, alpha, beta);
+      // do the gemms
+      P const alpha = 1.0;
+      P const beta  = 0.0;
+      for (int i = 0; i < pde.num_dims; ++i)
+      {
+        batch<P> const &a = batches[i][0];
+        batch<P> const &b = batches[i][1];
+        batch<P> const &c = batches[i][2];
+
+        batched_gemm(a, b, c, alpha, beta, workspace_binding<P>(),
+                     &rank_space.gemm_lists);
+      }
     }
 
-    // do the reduction
-    reduce_chunk(pde, rank_space, chunk);
+    // do the reduction; products over zero blocks were dropped, so each
+    // row's outputs are given by the plan's offsets
+    reduce_chunk(pde, rank_space, chunk, plan.get_output_offsets(chunk_index));
 
     // copy outputs back
     copy_chunk_outputs(pde, rank_space, host_space, chunk);
   }
 }
 
+// the right-hand side of the pde's system: the system matrix applied to x,
+// plus the sources. the batch plan is rebuilt first if the coefficients or
+// rank workspace have moved since it was built
+template<typename P>
+static rhs_function<P>
+system_rhs(PDE<P> const &pde, element_table const &table,
+           std::vector<fk::vector<P>> const &unscaled_sources,
+           host_workspace<P> &host_space, rank_workspace<P> &rank_space,
+           std::vector<element_chunk> const &chunks, batch_plan<P> &plan,
+           chunk_executor<P> *const executor)
+{
+  assert(static_cast<int>(unscaled_sources.size()) == pde.num_sources);
+
+  if (plan.is_stale(pde, rank_space))
+  {
+    plan.rebuild(pde, table, rank_space, chunks);
+  }
+
+  return [&pde, &unscaled_sources, &host_space, &rank_space, &chunks, &plan,
+          executor](P const stage_time) {
+    apply_explicit(pde, chunks, plan, host_space, rank_space, executor);
+    add_sources(pde, unscaled_sources, host_space.fx, stage_time);
+  };
+}
+
+// this function executes an explicit time step using the current solution
+// vector x. on exit, the next solution vector is stored in fx.
+template<typename P>
+void explicit_time_advance(PDE<P> const &pde, element_table const &table,
+                           std::vector<fk::vector<P>> const &unscaled_sources,
+                           host_workspace<P> &host_space,
+                           rank_workspace<P> &rank_space,
+                           std::vector<element_chunk> const &chunks,
+                           batch_plan<P> &plan, P const time, P const dt,
+                           chunk_executor<P> *const executor)
+{
+  explicit_step(host_space,
+                system_rhs(pde, table, unscaled_sources, host_space,
+                           rank_space, chunks, plan, executor),
+                time, dt);
+}
+
+template<typename P>
+int implicit_time_advance(PDE<P> const &pde, element_table const &table,
+                          std::vector<fk::vector<P>> const &unscaled_sources,
+                          host_workspace<P> &host_space,
+                          rank_workspace<P> &rank_space,
+                          std::vector<element_chunk> const &chunks,
+                          batch_plan<P> &plan, P const time, P const dt,
+                          krylov_control &control,
+                          chunk_executor<P> *const executor)
+{
+  assert(static_cast<int>(unscaled_sources.size()) == pde.num_sources);
+
+  if (plan.is_stale(pde, rank_space))
+  {
+    plan.rebuild(pde, table, rank_space, chunks);
+  }
+
+  apply_function const apply = [&] {
+    apply_explicit(pde, chunks, plan, host_space, rank_space, executor);
+  };
+  source_function<P> const sources = [&](P const source_time, P const scale,
+                                         fk::vector<P> &y) {
+    add_sources(pde, unscaled_sources, y, source_time, scale);
+  };
+  return implicit_step(host_space, apply, sources, time, dt, control);
+}
+
+template<typename P>
+int exponential_time_advance(PDE<P> const &pde, element_table const &table,
+                             std::vector<fk::vector<P>> const &unscaled_sources,
+                             host_workspace<P> &host_space,
+                             rank_workspace<P> &rank_space,
+                             std::vector<element_chunk> const &chunks,
+                             batch_plan<P> &plan, P const time, P const dt,
+                             krylov_control &control,
+                             chunk_executor<P> *const executor)
+{
+  assert(static_cast<int>(unscaled_sources.size()) == pde.num_sources);
+
+  if (plan.is_stale(pde, rank_space))
+  {
+    plan.rebuild(pde, table, rank_space, chunks);
+  }
+
+  apply_function const apply = [&] {
+    apply_explicit(pde, chunks, plan, host_space, rank_space, executor);
+  };
+  source_function<P> const sources = [&](P const source_time, P const scale,
+                                         fk::vector<P> &y) {
+    add_sources(pde, unscaled_sources, y, source_time, scale);
+  };
+  return exponential_step(host_space, apply, sources, time, dt, control);
+}
+
+template<typename P>
+P adaptive_time_advance(PDE<P> const &pde, element_table const &table,
+                        std::vector<fk::vector<P>> const &unscaled_sources,
+                        host_workspace<P> &host_space,
+                        rank_workspace<P> &rank_space,
+                        std::vector<element_chunk> const &chunks,
+                        batch_plan<P> &plan, P const time, P const dt,
+                        step_control &control,
+                        chunk_executor<P> *const executor)
+{
+  return adaptive_step(host_space,
+                       system_rhs(pde, table, unscaled_sources, host_space,
+                                  rank_space, chunks, plan, executor),
+                       time, dt, control);
+}
+
+template void explicit_step(host_workspace<float> &host_space,
+                            rhs_function<float> const &rhs, float const time,
+                            float const dt);
+template void explicit_step(host_workspace<double> &host_space,
+                            rhs_function<double> const &rhs,
+                            double const time, double const dt);
+
+template int implicit_step(host_workspace<float> &host_space,
+                           apply_function const &apply,
+                           source_function<float> const &add_sources,
+                           float const time, float const dt,
+                           krylov_control &control);
+template int implicit_step(host_workspace<double> &host_space,
+                           apply_function const &apply,
+                           source_function<double> const &add_sources,
+                           double const time, double const dt,
+                           krylov_control &control);
+
+template int
+implicit_time_advance(PDE<float> const &pde, element_table const &table,
+                      std::vector<fk::vector<float>> const &unscaled_sources,
+                      host_workspace<float> &host_space,
+                      rank_workspace<float> &rank_space,
+                      std::vector<element_chunk> const &chunks,
+                      batch_plan<float> &plan, float const time,
+                      float const dt, krylov_control &control,
+                      chunk_executor<float> *const executor);
+
+template int
+implicit_time_advance(PDE<double> const &pde, element_table const &table,
+                      std::vector<fk::vector<double>> const &unscaled_sources,
+                      host_workspace<double> &host_space,
+                      rank_workspace<double> &rank_space,
+                      std::vector<element_chunk> const &chunks,
+                      batch_plan<double> &plan, double const time,
+                      double const dt, krylov_control &control,
+                      chunk_executor<double> *const executor);
+
+template int exponential_step(host_workspace<float> &host_space,
+                              apply_function const &apply,
+                              source_function<float> const &add_sources,
+                              float const time, float const dt,
+                              krylov_control &control);
+template int exponential_step(host_workspace<double> &host_space,
+                              apply_function const &apply,
+                              source_function<double> const &add_sources,
+                              double const time, double const dt,
+                              krylov_control &control);
+
+template int
+exponential_time_advance(PDE<float> const &pde, element_table const &table,
+                         std::vector<fk::vector<float>> const &unscaled_sources,
+                         host_workspace<float> &host_space,
+                         rank_workspace<float> &rank_space,
+                         std::vector<element_chunk> const &chunks,
+                         batch_plan<float> &plan, float const time,
+                         float const dt, krylov_control &control,
+                         chunk_executor<float> *const executor);
+
+template int exponential_time_advance(
+    PDE<double> const &pde, element_table const &table,
+    std::vector<fk::vector<double>> const &unscaled_sources,
+    host_workspace<double> &host_space, rank_workspace<double> &rank_space,
+    std::vector<element_chunk> const &chunks, batch_plan<double> &plan,
+    double const time, double const dt, krylov_control &control,
+    chunk_executor<double> *const executor);
+
+template float adaptive_step(host_workspace<float> &host_space,
+                             rhs_function<float> const &rhs, float const time,
+                             float const dt, step_control &control);
+template double adaptive_step(host_workspace<double> &host_space,
+                              rhs_function<double> const &rhs,
+                              double const time, double const dt,
+                              step_control &control);
+
+template float
+adaptive_time_advance(PDE<float> const &pde, element_table const &table,
+                      std::vector<fk::vector<float>> const &unscaled_sources,
+                      host_workspace<float> &host_space,
+                      rank_workspace<float> &rank_space,
+                      std::vector<element_chunk> const &chunks,
+                      batch_plan<float> &plan, float const time,
+                      float const dt, step_control &control,
+                      chunk_executor<float> *const executor);
+
+template double
+adaptive_time_advance(PDE<double> const &pde, element_table const &table,
+                      std::vector<fk::vector<double>> const &unscaled_sources,
+                      host_workspace<double> &host_space,
+                      rank_workspace<double> &rank_space,
+                      std::vector<element_chunk> const &chunks,
+                      batch_plan<double> &plan, double const time,
+                      double const dt, step_control &control,
+                      chunk_executor<double> *const executor);
+
 template void
 explicit_time_advance(PDE<float> const &pde, element_table const &table,
                       std::vector<fk::vector<float>> const &unscaled_sources,
                       host_workspace<float> &host_space,
                       rank_workspace<float> &rank_space,
-                      std::vector<element_chunk> chunks, float const time,
-                      float const dt);
+                      std::vector<element_chunk> const &chunks,
+                      batch_plan<float> &plan, float const time,
+                      float const dt, chunk_executor<float> *const executor);
 
 template void
 explicit_time_advance(PDE<double> const &pde, element_table const &table,
                       std::vector<fk::vector<double>> const &unscaled_sources,
                       host_workspace<double> &host_space,
                       rank_workspace<double> &rank_space,
-                      std::vector<element_chunk> chunks, double const time,
-                      double const dt);
+                      std::vector<element_chunk> const &chunks,
+                      batch_plan<double> &plan, double const time,
+                      double const dt, chunk_executor<double> *const executor);
@@ -1,31 +1,273 @@
 #pragma once
 #include "batch.hpp"
 #include "chunk.hpp"
+#include "executor.hpp"
 #include "program_options.hpp"
 #include "tensors.hpp"
+#include <functional>
+
+// evaluates the right-hand side at the given time: sets host_space.fx to the
+// time derivative of the solution in host_space.x, leaving x as it was
+template<typename P>
+using rhs_function = std::function<void(P const)>;
+
+// advance the solution in host_space.x from time by dt with the scheme the
+// host workspace was built for. on exit, the next solution is in both x and
+// fx; the workspace's other registers are scratch.
+template<typename P>
+void explicit_step(host_workspace<P> &host_space, rhs_function<P> const &rhs,
+                   P const time, P const dt);
+
+// error control for adaptive steps
+struct step_control
+{
+  // a step is accepted when the root mean square of its error estimate,
+  // relative to tolerance * (1 + |x|) element by element, is at most one
+  double tolerance = 1e-6;
+  // first same as last: start each step from the derivative the last one
+  // ended with, saving an evaluation of the right-hand side
+  bool reuse_derivative = true;
+  // attempts rejected per step before giving up, as when the right-hand side
+  // isn't finite. a step also gives up once it's too short to advance time
+  int max_rejections = 50;
+  // the step to try next, updated by each step
+  double next_dt = 0.0;
+  // whether the last step gave up, and the evaluations of the right-hand side
+  // and steps rejected so far
+  bool failed             = false;
+  int64_t num_evaluations = 0;
+  int64_t num_rejected    = 0;
+};
+
+// take an error-controlled step of at most dt from time, with the bs23 scheme
+// the host workspace must have been built for: the step is shrunk until its
+// error estimate is within tolerance. returns the step taken, and sets
+// control.next_dt to the step to try next. as for explicit_step, on exit the
+// next solution is in both x and fx. a step that gives up sets control.failed,
+// leaves the solution as it was and returns zero.
+template<typename P>
+P adaptive_step(host_workspace<P> &host_space, rhs_function<P> const &rhs,
+                P const time, P const dt, step_control &control);
+
+// applies the system matrix without the sources: sets host_space.fx to the
+// product with host_space.x, leaving x as it was
+using apply_function = std::function<void()>;
+
+// adds the sources at the given time, times scale, to a vector
+template<typename P>
+using source_function =
+    std::function<void(P const time, P const scale, fk::vector<P> &y)>;
+
+// the implicit solves, by restarted gmres, and the exponential steps
+struct krylov_control
+{
+  // a solve is done when its residual is at most tolerance times the norm of
+  // its right-hand side. an exponential step's substeps are accepted when
+  // their error estimates are at most tolerance times the norm of the
+  // solution, in proportion to the share of the step they take
+  double tolerance = 1e-6;
+  // krylov bases built per step, beyond the first, before giving up: the
+  // last exponential substep allowed takes the rest of the step
+  int max_restarts = 50;
+  // start from the last step's solution, rather than from zero
+  bool warm_start = true;
+  // the last step's iterations and whether it converged, and the iterations
+  // of all the steps so far. each iteration applies the system matrix once
+  int iterations           = 0;
+  bool converged           = true;
+  int64_t total_iterations = 0;
+  // the substeps the last exponential step took, and the substep to try
+  // first in the next
+  int substeps        = 0;
+  double next_substep = 0.0;
+};
+
+// take an implicit step from time by dt with the host workspace's scheme,
+// backward euler or crank-nicolson, solving for the next solution x' in
+// (I - theta dt A) x' = b matrix-free: each gmres iteration applies A once.
+// theta is 1 or 1/2; b holds x, the sources at time + dt and, for
+// crank-nicolson, the explicit half step. returns the iterations taken. as
+// for explicit_step, on exit the next solution is in both x and fx.
+template<typename P>
+int implicit_step(host_workspace<P> &host_space, apply_function const &apply,
+                  source_function<P> const &add_sources, P const time,
+                  P const dt, krylov_control &control);
+
+// take an exponential step from time by dt, approximating the exact solution
+// of x' = A x + s(t) by krylov projection: x' = exp(h A) x plus the
+// phi-function terms of the sources, which enter through their quadratic
+// interpolant over each substep h. the step is split into substeps until
+// each one's error estimate is within tolerance; each arnoldi iteration
+// applies A once. returns the iterations taken. as for explicit_step, on
+// exit the next solution is in both x and fx.
+template<typename P>
+int exponential_step(host_workspace<P> &host_space,
+                     apply_function const &apply,
+                     source_function<P> const &add_sources, P const time,
+                     P const dt, krylov_control &control);
 
 // this function executes a time step using the current solution
 // vector x. on exit, the next solution vector is stored in fx.
+//
+// the batch plan is rebuilt here if the coefficients or rank workspace have
+// moved since it was built. if given an executor, the chunks are applied
+// across its workers; otherwise one after another, in rank_space. the step
+// is taken with the host workspace's scheme.
 template<typename P>
 void explicit_time_advance(PDE<P> const &pde, element_table const &table,
                            std::vector<fk::vector<P>> const &unscaled_sources,
                            host_workspace<P> &host_space,
                            rank_workspace<P> &rank_space,
-                           std::vector<element_chunk> chunks, P const time,
-                           P const dt);
+                           std::vector<element_chunk> const &chunks,
+                           batch_plan<P> &plan, P const time, P const dt,
+                           chunk_executor<P> *const executor = nullptr);
+
+// as explicit_time_advance, but taking an implicit step; returns the
+// iterations the solve took
+template<typename P>
+int implicit_time_advance(PDE<P> const &pde, element_table const &table,
+                          std::vector<fk::vector<P>> const &unscaled_sources,
+                          host_workspace<P> &host_space,
+                          rank_workspace<P> &rank_space,
+                          std::vector<element_chunk> const &chunks,
+                          batch_plan<P> &plan, P const time, P const dt,
+                          krylov_control &control,
+                          chunk_executor<P> *const executor = nullptr);
+
+// as explicit_time_advance, but taking an exponential step; returns the
+// iterations it took
+template<typename P>
+int exponential_time_advance(PDE<P> const &pde, element_table const &table,
+                             std::vector<fk::vector<P>> const &unscaled_sources,
+                             host_workspace<P> &host_space,
+                             rank_workspace<P> &rank_space,
+                             std::vector<element_chunk> const &chunks,
+                             batch_plan<P> &plan, P const time, P const dt,
+                             krylov_control &control,
+                             chunk_executor<P> *const executor = nullptr);
+
+// as explicit_time_advance, but taking an adaptive step of at most dt;
+// returns the step taken
+template<typename P>
+P adaptive_time_advance(PDE<P> const &pde, element_table const &table,
+                        std::vector<fk::vector<P>> const &unscaled_sources,
+                        host_workspace<P> &host_space,
+                        rank_workspace<P> &rank_space,
+                        std::vector<element_chunk> const &chunks,
+                        batch_plan<P> &plan, P const time, P const dt,
+                        step_control &control,
+                        chunk_executor<P> *const executor = nullptr);
+
+extern template void explicit_step(host_workspace<float> &host_space,
+                                   rhs_function<float> const &rhs,
+                                   float const time, float const dt);
+extern template void explicit_step(host_workspace<double> &host_space,
+                                   rhs_function<double> const &rhs,
+                                   double const time, double const dt);
+
+extern template int implicit_step(host_workspace<float> &host_space,
+                                  apply_function const &apply,
+                                  source_function<float> const &add_sources,
+                                  float const time, float const dt,
+                                  krylov_control &control);
+extern template int implicit_step(host_workspace<double> &host_space,
+                                  apply_function const &apply,
+                                  source_function<double> const &add_sources,
+                                  double const time, double const dt,
+                                  krylov_control &control);
+
+extern template int
+implicit_time_advance(PDE<float> const &pde, element_table const &table,
+                      std::vector<fk::vector<float>> const &unscaled_sources,
+                      host_workspace<float> &host_space,
+                      rank_workspace<float> &rank_space,
+                      std::vector<element_chunk> const &chunks,
+                      batch_plan<float> &plan, float const time,
+                      float const dt, krylov_control &control,
+                      chunk_executor<float> *const executor);
+
+extern template int
+implicit_time_advance(PDE<double> const &pde, element_table const &table,
+                      std::vector<fk::vector<double>> const &unscaled_sources,
+                      host_workspace<double> &host_space,
+                      rank_workspace<double> &rank_space,
+                      std::vector<element_chunk> const &chunks,
+                      batch_plan<double> &plan, double const time,
+                      double const dt, krylov_control &control,
+                      chunk_executor<double> *const executor);
+
+extern template int exponential_step(host_workspace<float> &host_space,
+                                     apply_function const &apply,
+                                     source_function<float> const &add_sources,
+                                     float const time, float const dt,
+                                     krylov_control &control);
+extern template int
+exponential_step(host_workspace<double> &host_space,
+                 apply_function const &apply,
+                 source_function<double> const &add_sources,
+                 double const time, double const dt, krylov_control &control);
+
+extern template int
+exponential_time_advance(PDE<float> const &pde, element_table const &table,
+                         std::vector<fk::vector<float>> const &unscaled_sources,
+                         host_workspace<float> &host_space,
+                         rank_workspace<float> &rank_space,
+                         std::vector<element_chunk> const &chunks,
+                         batch_plan<float> &plan, float const time,
+                         float const dt, krylov_control &control,
+                         chunk_executor<float> *const executor);
+
+extern template int exponential_time_advance(
+    PDE<double> const &pde, element_table const &table,
+    std::vector<fk::vector<double>> const &unscaled_sources,
+    host_workspace<double> &host_space, rank_workspace<double> &rank_space,
+    std::vector<element_chunk> const &chunks, batch_plan<double> &plan,
+    double const time, double const dt, krylov_control &control,
+    chunk_executor<double> *const executor);
+
+extern template float adaptive_step(host_workspace<float> &host_space,
+                                    rhs_function<float> const &rhs,
+                                    float const time, float const dt,
+                                    step_control &control);
+extern template double adaptive_step(host_workspace<double> &host_space,
+                                     rhs_function<double> const &rhs,
+                                     double const time, double const dt,
+                                     step_control &control);
+
+extern template float
+adaptive_time_advance(PDE<float> const &pde, element_table const &table,
+                      std::vector<fk::vector<float>> const &unscaled_sources,
+                      host_workspace<float> &host_space,
+                      rank_workspace<float> &rank_space,
+                      std::vector<element_chunk> const &chunks,
+                      batch_plan<float> &plan, float const time,
+                      float const dt, step_control &control,
+                      chunk_executor<float> *const executor);
+
+extern template double
+adaptive_time_advance(PDE<double> const &pde, element_table const &table,
+                      std::vector<fk::vector<double>> const &unscaled_sources,
+                      host_workspace<double> &host_space,
+                      rank_workspace<double> &rank_space,
+                      std::vector<element_chunk> const &chunks,
+                      batch_plan<double> &plan, double const time,
+                      double const dt, step_control &control,
+                      chunk_executor<double> *const executor);
 
 extern template void
 explicit_time_advance(PDE<float> const &pde, element_table const &table,
                       std::vector<fk::vector<float>> const &unscaled_sources,
                       host_workspace<float> &host_space,
                       rank_workspace<float> &rank_space,
-                      std::vector<element_chunk> chunks, float const time,
-                      float const dt);
+                      std::vector<element_chunk> const &chunks,
+                      batch_plan<float> &plan, float const time,
+                      float const dt, chunk_executor<float> *const executor);
 
 extern template void
 explicit_time_advance(PDE<double> const &pde, element_table const &table,
                       std::vector<fk::vector<double>> const &unscaled_sources,
                       host_workspace<double> &host_space,
                       rank_workspace<double> &rank_space,
-                      std::vector<element_chunk> chunks, double const time,
-                      double const dt);
+                      std::vector<element_chunk> const &chunks,
+                      batch_plan<double> &plan, double const time,
+                      double const dt, chunk_executor<double> *const executor);
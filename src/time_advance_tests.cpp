@@ -5,6 +5,7 @@
 #include "tests_general.hpp"
 #include "time_advance.hpp"
 #include "transformations.hpp"
+#include <limits>
 #include <numeric>
 #include <random>
 
@@ -92,6 +93,7 @@ TEMPLATE_TEST_CASE("time advance - continuity 1", "[time_advance]", float,
     std::vector<element_chunk> const chunks =
         assign_elements(table, get_num_chunks(table, *pde));
     rank_workspace<TestType> rank_space(*pde, chunks);
+    batch_plan<TestType> plan(*pde, table, rank_space, chunks);
     host_space.x = initial_condition;
 
     // -- time loop
@@ -101,7 +103,7 @@ TEMPLATE_TEST_CASE("time advance - continuity 1", "[time_advance]", float,
     {
       TestType const time = i * dt;
       explicit_time_advance(*pde, table, initial_sources, host_space,
-                            rank_space, chunks, time, dt);
+                            rank_space, chunks, plan, time, dt);
 
       std::string const file_path =
           "../testing/generated-inputs/time_advance/continuity1_sg_l2_d2_t" +
@@ -172,6 +174,7 @@ TEMPLATE_TEST_CASE("time advance - continuity 1", "[time_advance]", float,
     std::vector<element_chunk> const chunks =
         assign_elements(table, get_num_chunks(table, *pde));
     rank_workspace<TestType> rank_space(*pde, chunks);
+    batch_plan<TestType> plan(*pde, table, rank_space, chunks);
     host_space.x = initial_condition;
 
     // -- time loop
@@ -181,7 +184,7 @@ TEMPLATE_TEST_CASE("time advance - continuity 1", "[time_advance]", float,
     {
       TestType const time = i * dt;
       explicit_time_advance(*pde, table, initial_sources, host_space,
-                            rank_space, chunks, time, dt);
+                            rank_space, chunks, plan, time, dt);
 
       std::string const file_path =
           "../testing/generated-inputs/time_advance/continuity1_fg_l2_d2_t" +
@@ -251,6 +254,7 @@ TEMPLATE_TEST_CASE("time advance - continuity 1", "[time_advance]", float,
     std::vector<element_chunk> const chunks =
         assign_elements(table, get_num_chunks(table, *pde));
     rank_workspace<TestType> rank_space(*pde, chunks);
+    batch_plan<TestType> plan(*pde, table, rank_space, chunks);
     host_space.x = initial_condition;
 
     // -- time loop
@@ -260,7 +264,7 @@ TEMPLATE_TEST_CASE("time advance - continuity 1", "[time_advance]", float,
     {
       TestType const time = i * dt;
       explicit_time_advance(*pde, table, initial_sources, host_space,
-                            rank_space, chunks, time, dt);
+                            rank_space, chunks, plan, time, dt);
 
       std::string const file_path =
           "../testing/generated-inputs/time_advance/continuity1_sg_l4_d3_t" +
@@ -357,6 +361,7 @@ TEMPLATE_TEST_CASE("time advance - continuity 2", "[time_advance]", float,
     std::vector<element_chunk> const chunks =
         assign_elements(table, get_num_chunks(table, *pde));
     rank_workspace<TestType> rank_space(*pde, chunks);
+    batch_plan<TestType> plan(*pde, table, rank_space, chunks);
     host_space.x = initial_condition;
 
     // -- time loop
@@ -366,7 +371,7 @@ TEMPLATE_TEST_CASE("time advance - continuity 2", "[time_advance]", float,
     {
       TestType const time = i * dt;
       explicit_time_advance(*pde, table, initial_sources, host_space,
-                            rank_space, chunks, time, dt);
+                            rank_space, chunks, plan, time, dt);
 
       std::string const file_path =
           "../testing/generated-inputs/time_advance/continuity2_sg_l2_d2_t" +
@@ -437,6 +442,7 @@ TEMPLATE_TEST_CASE("time advance - continuity 2", "[time_advance]", float,
     std::vector<element_chunk> const chunks =
         assign_elements(table, get_num_chunks(table, *pde));
     rank_workspace<TestType> rank_space(*pde, chunks);
+    batch_plan<TestType> plan(*pde, table, rank_space, chunks);
     host_space.x = initial_condition;
 
     // -- time loop
@@ -446,7 +452,7 @@ TEMPLATE_TEST_CASE("time advance - continuity 2", "[time_advance]", float,
     {
       TestType const time = i * dt;
       explicit_time_advance(*pde, table, initial_sources, host_space,
-                            rank_space, chunks, time, dt);
+                            rank_space, chunks, plan, time, dt);
 
       std::string const file_path =
           "../testing/generated-inputs/time_advance/continuity2_fg_l2_d2_t" +
@@ -516,6 +522,7 @@ TEMPLATE_TEST_CASE("time advance - continuity 2", "[time_advance]", float,
     std::vector<element_chunk> const chunks =
         assign_elements(table, get_num_chunks(table, *pde));
     rank_workspace<TestType> rank_space(*pde, chunks);
+    batch_plan<TestType> plan(*pde, table, rank_space, chunks);
     host_space.x = initial_condition;
 
     // -- time loop
@@ -525,7 +532,7 @@ TEMPLATE_TEST_CASE("time advance - continuity 2", "[time_advance]", float,
     {
       TestType const time = i * dt;
       explicit_time_advance(*pde, table, initial_sources, host_space,
-                            rank_space, chunks, time, dt);
+                            rank_space, chunks, plan, time, dt);
 
       std::string const file_path =
           "../testing/generated-inputs/time_advance/continuity2_sg_l4_d3_t" +
@@ -621,6 +628,7 @@ TEMPLATE_TEST_CASE("time advance - continuity 3", "[time_advance]", float,
     std::vector<element_chunk> const chunks =
         assign_elements(table, get_num_chunks(table, *pde));
     rank_workspace<TestType> rank_space(*pde, chunks);
+    batch_plan<TestType> plan(*pde, table, rank_space, chunks);
     host_space.x = initial_condition;
 
     // -- time loop
@@ -630,7 +638,7 @@ TEMPLATE_TEST_CASE("time advance - continuity 3", "[time_advance]", float,
     {
       TestType const time = i * dt;
       explicit_time_advance(*pde, table, initial_sources, host_space,
-                            rank_space, chunks, time, dt);
+                            rank_space, chunks, plan, time, dt);
 
       std::string const file_path =
           "../testing/generated-inputs/time_advance/continuity3_sg_l2_d2_t" +
@@ -701,6 +709,7 @@ TEMPLATE_TEST_CASE("time advance - continuity 3", "[time_advance]", float,
     std::vector<element_chunk> const chunks =
         assign_elements(table, get_num_chunks(table, *pde));
     rank_workspace<TestType> rank_space(*pde, chunks);
+    batch_plan<TestType> plan(*pde, table, rank_space, chunks);
     host_space.x = initial_condition;
 
     // -- time loop
@@ -710,7 +719,7 @@ TEMPLATE_TEST_CASE("time advance - continuity 3", "[time_advance]", float,
     {
       TestType const time = i * dt;
       explicit_time_advance(*pde, table, initial_sources, host_space,
-                            rank_space, chunks, time, dt);
+                            rank_space, chunks, plan, time, dt);
 
       std::string const file_path =
           "../testing/generated-inputs/time_advance/continuity3_sg_l4_d3_t" +
@@ -805,6 +814,7 @@ TEMPLATE_TEST_CASE("time advance - continuity 6", "[time_advance]", float,
     std::vector<element_chunk> const chunks =
         assign_elements(table, get_num_chunks(table, *pde));
     rank_workspace<TestType> rank_space(*pde, chunks);
+    batch_plan<TestType> plan(*pde, table, rank_space, chunks);
     host_space.x = initial_condition;
 
     // -- time loop
@@ -814,7 +824,7 @@ TEMPLATE_TEST_CASE("time advance - continuity 6", "[time_advance]", float,
     {
       TestType const time = i * dt;
       explicit_time_advance(*pde, table, initial_sources, host_space,
-                            rank_space, chunks, time, dt);
+                            rank_space, chunks, plan, time, dt);
 
       std::string const file_path =
           "../testing/generated-inputs/time_advance/continuity6_sg_l2_d2_t" +
@@ -885,6 +895,7 @@ TEMPLATE_TEST_CASE("time advance - continuity 6", "[time_advance]", float,
     std::vector<element_chunk> const chunks =
         assign_elements(table, get_num_chunks(table, *pde));
     rank_workspace<TestType> rank_space(*pde, chunks);
+    batch_plan<TestType> plan(*pde, table, rank_space, chunks);
     host_space.x = initial_condition;
 
     // -- time loop
@@ -894,7 +905,7 @@ TEMPLATE_TEST_CASE("time advance - continuity 6", "[time_advance]", float,
     {
       TestType const time = i * dt;
       explicit_time_advance(*pde, table, initial_sources, host_space,
-                            rank_space, chunks, time, dt);
+                            rank_space, chunks, plan, time, dt);
 
       std::string const file_path =
           "../testing/generated-inputs/time_advance/continuity6_sg_l2_d3_t" +
@@ -906,3 +917,588 @@ TEMPLATE_TEST_CASE("time advance - continuity 6", "[time_advance]", float,
     }
   }
 }
+
+TEMPLATE_TEST_CASE("explicit step schemes", "[time_advance]", float, double)
+{
+  int const degree = 2;
+  int const level  = 2;
+  auto const pde = make_PDE<TestType>(PDE_opts::continuity_1, level, degree);
+  options const o = make_options(
+      {"-l", std::to_string(level), "-d", std::to_string(degree)});
+  element_table const table(o, pde->num_dims);
+
+  // u' = -u + t, from u(0) = 1 to u(1) = 2 / e
+  TestType const end_time = 1.0;
+  TestType const exact    = 2.0 / std::exp(1.0);
+
+  // the largest error in advancing to the end time in num_steps steps
+  auto const error = [&](time_scheme const scheme, int const num_steps) {
+    host_workspace<TestType> host_space(*pde, table, scheme);
+    std::fill(host_space.x.begin(), host_space.x.end(), 1.0);
+    rhs_function<TestType> const rhs = [&host_space](TestType const time) {
+      for (int i = 0; i < host_space.x.size(); ++i)
+      {
+        host_space.fx(i) = time - host_space.x(i);
+      }
+    };
+    TestType const dt = end_time / num_steps;
+    for (int i = 0; i < num_steps; ++i)
+    {
+      explicit_step(host_space, rhs, i * dt, dt);
+      REQUIRE(host_space.fx == host_space.x);
+    }
+    TestType largest = 0.0;
+    for (TestType const value : host_space.fx)
+    {
+      largest = std::max(largest, std::abs(value - exact));
+    }
+    return largest;
+  };
+
+  // halving the step cuts the error by 2^order
+  auto const test_order = [&](time_scheme const scheme, int const order,
+                              int const num_steps = 8) {
+    TestType const coarse = error(scheme, num_steps);
+    TestType const fine   = error(scheme, 2 * num_steps);
+    REQUIRE(coarse < 1e-3);
+    if constexpr (std::is_same<TestType, double>::value)
+    {
+      REQUIRE(std::log2(coarse / fine) == Approx(order).margin(0.2));
+    }
+  };
+
+  SECTION("classic third order") { test_order(time_scheme::rk3, 3); }
+  SECTION("ssp third order") { test_order(time_scheme::ssp_rk3, 3); }
+  SECTION("low-storage third order") { test_order(time_scheme::ls_rk3, 3); }
+  SECTION("low-storage fourth order") { test_order(time_scheme::ls_rk4, 4); }
+  SECTION("bogacki-shampine, fixed steps")
+  {
+    test_order(time_scheme::bs23, 3);
+  }
+  SECTION("adams-bashforth second order")
+  {
+    test_order(time_scheme::ab2, 2, 32);
+  }
+  SECTION("adams-bashforth third order") { test_order(time_scheme::ab3, 3); }
+
+  SECTION("adams-bashforth evaluations")
+  {
+    // after the runge-kutta start, one evaluation per step; the start's
+    // first stages reuse the derivatives stored for the ring
+    for (auto const &[scheme, start] :
+         {std::make_pair(time_scheme::ab2, 1),
+          std::make_pair(time_scheme::ab3, 2)})
+    {
+      host_workspace<TestType> host_space(*pde, table, scheme);
+      std::fill(host_space.x.begin(), host_space.x.end(), 1.0);
+      int num_evaluations              = 0;
+      rhs_function<TestType> const rhs = [&](TestType const time) {
+        ++num_evaluations;
+        for (int i = 0; i < host_space.x.size(); ++i)
+        {
+          host_space.fx(i) = time - host_space.x(i);
+        }
+      };
+      int const num_steps = 10;
+      TestType const dt   = end_time / num_steps;
+      for (int i = 0; i < num_steps; ++i)
+      {
+        explicit_step(host_space, rhs, i * dt, dt);
+      }
+      REQUIRE(num_evaluations == num_steps + 2 * start);
+      REQUIRE(host_space.num_derivatives == start + 1);
+    }
+  }
+
+  SECTION("bogacki-shampine, adaptive steps")
+  {
+    // the number of steps, the evaluations of the right-hand side and the
+    // largest error in running to the end time
+    auto const run = [&](double const tolerance, bool const reuse) {
+      host_workspace<TestType> host_space(*pde, table, time_scheme::bs23);
+      std::fill(host_space.x.begin(), host_space.x.end(), 1.0);
+      int64_t num_evaluations           = 0;
+      rhs_function<TestType> const rhs = [&](TestType const time) {
+        ++num_evaluations;
+        for (int i = 0; i < host_space.x.size(); ++i)
+        {
+          host_space.fx(i) = time - host_space.x(i);
+        }
+      };
+
+      step_control control;
+      control.tolerance        = tolerance;
+      control.reuse_derivative = reuse;
+      control.next_dt          = 0.5;
+      int num_steps            = 0;
+      TestType time            = 0.0;
+      while (time < end_time)
+      {
+        TestType const remaining = end_time - time;
+        TestType const taken     = adaptive_step(
+            host_space, rhs, time,
+            std::min<TestType>(control.next_dt, remaining), control);
+        REQUIRE(taken > 0);
+        REQUIRE(host_space.fx == host_space.x);
+        time = taken == remaining ? end_time : time + taken;
+        ++num_steps;
+      }
+      REQUIRE(control.num_evaluations == num_evaluations);
+      // the first step tried is too long
+      REQUIRE(control.num_rejected > 0);
+
+      // three evaluations per attempt, a rejected one's retry starting from
+      // the same derivative, and one more to start - or, not reusing the
+      // last derivative, one more per step
+      int64_t const num_attempts = num_steps + control.num_rejected;
+      REQUIRE(num_evaluations ==
+              3 * num_attempts + (reuse ? 1 : num_steps));
+
+      TestType largest = 0.0;
+      for (TestType const value : host_space.fx)
+      {
+        largest = std::max(largest, std::abs(value - exact));
+      }
+      return std::make_tuple(num_steps, num_evaluations, largest);
+    };
+
+    auto const [loose_steps, loose_evaluations, loose_error] = run(1e-3, true);
+    auto const [tight_steps, tight_evaluations, tight_error] = run(1e-5, true);
+    REQUIRE(loose_error < 1e-2);
+    REQUIRE(tight_error < 1e-4);
+    REQUIRE(tight_error < loose_error);
+    REQUIRE(tight_steps > loose_steps);
+
+    // without reuse, the same steps cost an evaluation more each
+    auto const [steps, evaluations, error] = run(1e-5, false);
+    REQUIRE(steps == tight_steps);
+    REQUIRE(evaluations == tight_evaluations + tight_steps - 1);
+    REQUIRE(error == tight_error);
+  }
+
+  SECTION("bogacki-shampine, giving up")
+  {
+    host_workspace<TestType> host_space(*pde, table, time_scheme::bs23);
+    std::fill(host_space.x.begin(), host_space.x.end(), 1.0);
+    fk::vector<TestType> const start(host_space.x);
+    // finite at the start, so the step's derivative is, but not past it
+    rhs_function<TestType> const rhs = [&host_space](TestType const time) {
+      TestType const value =
+          time > 0 ? std::numeric_limits<TestType>::quiet_NaN() : 1.0;
+      std::fill(host_space.fx.begin(), host_space.fx.end(), value);
+    };
+
+    step_control control;
+    control.max_rejections = 4;
+    REQUIRE(adaptive_step(host_space, rhs, TestType{0.0}, TestType{0.5},
+                          control) == 0);
+    REQUIRE(control.failed);
+    REQUIRE(control.num_rejected == 4);
+    REQUIRE(control.num_evaluations == 1 + 3 * 4);
+    REQUIRE(host_space.x == start);
+    REQUIRE(host_space.fx == start);
+  }
+
+  SECTION("registers kept by each scheme")
+  {
+    host_workspace<TestType> const rk3(*pde, table);
+    REQUIRE(rk3.get_scheme() == time_scheme::rk3);
+    int64_t const vector_size = rk3.x.size();
+    auto const size_MB        = [vector_size](int const num_vectors) {
+      return static_cast<double>(vector_size) * num_vectors *
+             sizeof(TestType) * 1e-6;
+    };
+    REQUIRE(rk3.size_MB() == Approx(size_MB(4)));
+    for (time_scheme const scheme :
+         {time_scheme::ssp_rk3, time_scheme::ls_rk3, time_scheme::ls_rk4})
+    {
+      host_workspace<TestType> const host_space(*pde, table, scheme);
+      REQUIRE(host_space.size_MB() == Approx(size_MB(3)));
+    }
+    host_workspace<TestType> const bs23(*pde, table, time_scheme::bs23);
+    REQUIRE(bs23.size_MB() == Approx(size_MB(5)));
+    host_workspace<TestType> const ab2(*pde, table, time_scheme::ab2);
+    REQUIRE(ab2.size_MB() == Approx(size_MB(4)));
+    host_workspace<TestType> const ab3(*pde, table, time_scheme::ab3);
+    REQUIRE(ab3.size_MB() == Approx(size_MB(5)));
+  }
+}
+
+TEMPLATE_TEST_CASE("implicit step schemes", "[time_advance]", float, double)
+{
+  int const degree = 2;
+  int const level  = 2;
+  auto const pde = make_PDE<TestType>(PDE_opts::continuity_1, level, degree);
+  options const o = make_options(
+      {"-l", std::to_string(level), "-d", std::to_string(degree)});
+  element_table const table(o, pde->num_dims);
+
+  double const tolerance =
+      std::is_same<TestType, double>::value ? 1e-10 : 1e-5;
+
+  SECTION("order of accuracy")
+  {
+    // u' = -u + t, from u(0) = 1 to u(1) = 2 / e
+    TestType const end_time = 1.0;
+    TestType const exact    = 2.0 / std::exp(1.0);
+
+    auto const error = [&](time_scheme const scheme, int const num_steps) {
+      host_workspace<TestType> host_space(*pde, table, scheme);
+      std::fill(host_space.x.begin(), host_space.x.end(), 1.0);
+      apply_function const apply = [&host_space] {
+        fm::copy(host_space.x, host_space.fx);
+        fm::scal(static_cast<TestType>(-1.0), host_space.fx);
+      };
+      source_function<TestType> const sources =
+          [](TestType const time, TestType const scale,
+             fk::vector<TestType> &y) {
+            std::transform(y.begin(), y.end(), y.begin(),
+                           [=](TestType const y_i) {
+                             return y_i + scale * time;
+                           });
+          };
+
+      krylov_control control;
+      control.tolerance = tolerance;
+      TestType const dt = end_time / num_steps;
+      for (int i = 0; i < num_steps; ++i)
+      {
+        // the system is a multiple of the identity
+        REQUIRE(implicit_step(host_space, apply, sources, i * dt, dt,
+                              control) == 1);
+        REQUIRE(control.converged);
+        REQUIRE(host_space.fx == host_space.x);
+      }
+      REQUIRE(control.total_iterations == num_steps);
+      TestType largest = 0.0;
+      for (TestType const value : host_space.fx)
+      {
+        largest = std::max(largest, std::abs(value - exact));
+      }
+      return largest;
+    };
+
+    for (auto const &[scheme, order] :
+         {std::make_pair(time_scheme::backward_euler, 1),
+          std::make_pair(time_scheme::crank_nicolson, 2)})
+    {
+      TestType const coarse = error(scheme, 16);
+      TestType const fine   = error(scheme, 32);
+      REQUIRE(coarse < 0.1);
+      if constexpr (std::is_same<TestType, double>::value)
+      {
+        REQUIRE(std::log2(coarse / fine) == Approx(order).margin(0.1));
+      }
+    }
+  }
+
+  // periodic upwind advection, at ten times the explicit stability limit
+  int const size       = 64;
+  TestType const speed = 100.0;
+  auto const advect    = [&](fk::vector<TestType> const &x,
+                          fk::vector<TestType> &fx) {
+    for (int i = 0; i < size; ++i)
+    {
+      fx(i) = -speed * (x(i) - x((i + size - 1) % size));
+    }
+  };
+  source_function<TestType> const no_sources =
+      [](TestType const, TestType const, fk::vector<TestType> &) {};
+  TestType const dt = 0.1;
+
+  // a workspace for the advection, and the norm of x - dt A x - b
+  auto const make_workspace = [&](int const krylov_dimension) {
+    host_workspace<TestType> host_space(*pde, table,
+                                        time_scheme::backward_euler,
+                                        krylov_dimension);
+    for (fk::vector<TestType> *const v :
+         {&host_space.x, &host_space.fx, &host_space.x_orig,
+          &host_space.result_1})
+    {
+      v->resize(size);
+    }
+    for (fk::vector<TestType> &v : host_space.krylov_basis)
+    {
+      v.resize(size);
+    }
+    return host_space;
+  };
+  auto const residual = [&](fk::vector<TestType> const &x,
+                            fk::vector<TestType> const &b) {
+    fk::vector<TestType> ax(size);
+    advect(x, ax);
+    TestType sum = 0.0;
+    for (int i = 0; i < size; ++i)
+    {
+      TestType const r = x(i) - dt * ax(i) - b(i);
+      sum += r * r;
+    }
+    return std::sqrt(sum);
+  };
+
+  SECTION("nonsymmetric, stiff, restarted")
+  {
+    for (int const krylov_dimension : {size, 8})
+    {
+      host_workspace<TestType> host_space = make_workspace(krylov_dimension);
+      apply_function const apply = [&] { advect(host_space.x, host_space.fx); };
+      for (int i = 0; i < size; ++i)
+      {
+        host_space.x(i) = i < size / 2 ? 1.0 : 0.0;
+      }
+
+      krylov_control control;
+      control.tolerance = tolerance;
+      for (int step = 0; step < 3; ++step)
+      {
+        fk::vector<TestType> const b(host_space.x);
+        int const iterations =
+            implicit_step(host_space, apply, no_sources, step * dt, dt,
+                          control);
+        REQUIRE(control.converged);
+        REQUIRE(iterations > 1);
+        REQUIRE(residual(host_space.x, b) <=
+                10 * tolerance * std::sqrt(b * b));
+        // backward euler damps the advection, so the solution stays bounded
+        for (TestType const value : host_space.x)
+        {
+          REQUIRE(value >= -tolerance);
+          REQUIRE(value <= 1 + tolerance);
+        }
+      }
+    }
+  }
+
+  SECTION("warm starts")
+  {
+    // a steady state solves the system as it stands
+    host_workspace<TestType> host_space = make_workspace(16);
+    apply_function const apply = [&] { advect(host_space.x, host_space.fx); };
+    std::fill(host_space.x.begin(), host_space.x.end(), 2.0);
+
+    krylov_control control;
+    control.tolerance = tolerance;
+    REQUIRE(implicit_step(host_space, apply, no_sources, TestType{0.0}, dt,
+                          control) == 0);
+    control.warm_start = false;
+    REQUIRE(implicit_step(host_space, apply, no_sources, dt, dt, control) > 0);
+    REQUIRE(control.converged);
+    fk::vector<TestType> const b(std::vector<TestType>(size, 2.0));
+    REQUIRE(residual(host_space.x, b) <= 10 * tolerance * std::sqrt(b * b));
+  }
+
+  SECTION("workspace")
+  {
+    int const krylov_dimension = 10;
+    host_workspace<TestType> const host_space(
+        *pde, table, time_scheme::crank_nicolson, krylov_dimension);
+    int64_t const vector_size = host_space.x.size();
+    REQUIRE(host_space.krylov_basis.size() == krylov_dimension + 1);
+    REQUIRE(host_space.size_MB() ==
+            Approx(static_cast<double>(vector_size) *
+                   (4 + krylov_dimension + 1) * sizeof(TestType) * 1e-6));
+  }
+}
+
+TEMPLATE_TEST_CASE("exponential steps", "[time_advance]", float, double)
+{
+  int const degree = 2;
+  int const level  = 2;
+  auto const pde = make_PDE<TestType>(PDE_opts::continuity_1, level, degree);
+  options const o = make_options(
+      {"-l", std::to_string(level), "-d", std::to_string(degree)});
+  element_table const table(o, pde->num_dims);
+
+  double const tolerance =
+      std::is_same<TestType, double>::value ? 1e-10 : 1e-5;
+  auto const largest_difference = [](fk::vector<TestType> const &x,
+                                     auto const &exact) {
+    double largest = 0.0;
+    for (int i = 0; i < x.size(); ++i)
+    {
+      largest = std::max(largest, std::abs(x(i) - exact(i)));
+    }
+    return largest;
+  };
+
+  // u' = -u + s(t), from u(0) = 1
+  auto const decay = [&](host_workspace<TestType> &host_space,
+                         source_function<TestType> const &sources,
+                         TestType const end_time, int const num_steps,
+                         krylov_control &control) {
+    std::fill(host_space.x.begin(), host_space.x.end(), 1.0);
+    apply_function const apply = [&host_space] {
+      fm::copy(host_space.x, host_space.fx);
+      fm::scal(static_cast<TestType>(-1.0), host_space.fx);
+    };
+    TestType const dt = end_time / num_steps;
+    for (int i = 0; i < num_steps; ++i)
+    {
+      exponential_step(host_space, apply, sources, i * dt, dt, control);
+      REQUIRE(control.converged);
+      REQUIRE(host_space.fx == host_space.x);
+    }
+  };
+
+  SECTION("exact for sources quadratic in time")
+  {
+    // s = t^2, so u = t^2 - 2 t + 2 - e^-t
+    source_function<TestType> const sources =
+        [](TestType const time, TestType const scale,
+           fk::vector<TestType> &y) {
+          std::transform(y.begin(), y.end(), y.begin(),
+                         [=](TestType const y_i) {
+                           return y_i + scale * time * time;
+                         });
+        };
+    host_workspace<TestType> host_space(*pde, table,
+                                        time_scheme::exponential);
+    krylov_control control;
+    control.tolerance       = tolerance;
+    TestType const end_time = 3.0;
+    decay(host_space, sources, end_time, 1, control);
+
+    // the augmented system is spanned in four iterations, in one substep
+    REQUIRE(control.iterations == 4);
+    REQUIRE(control.substeps == 1);
+    REQUIRE(control.total_iterations == 4);
+    double const exact = end_time * end_time - 2 * end_time + 2 -
+                         std::exp(-static_cast<double>(end_time));
+    REQUIRE(largest_difference(host_space.x, [=](int) { return exact; }) <=
+            10 * tolerance * exact);
+  }
+
+  SECTION("order in the sources' interpolation")
+  {
+    // s = cos t, so u = (cos t + sin t + e^-t) / 2
+    source_function<TestType> const sources =
+        [](TestType const time, TestType const scale,
+           fk::vector<TestType> &y) {
+          std::transform(y.begin(), y.end(), y.begin(),
+                         [=](TestType const y_i) {
+                           return y_i + scale * std::cos(time);
+                         });
+        };
+    TestType const end_time = 4.0;
+    double const exact =
+        (std::cos(4.0) + std::sin(4.0) + std::exp(-4.0)) / 2;
+    auto const error = [&](int const num_steps) {
+      host_workspace<TestType> host_space(*pde, table,
+                                          time_scheme::exponential);
+      krylov_control control;
+      control.tolerance = tolerance;
+      decay(host_space, sources, end_time, num_steps, control);
+      return largest_difference(host_space.x, [=](int) { return exact; });
+    };
+
+    double const coarse = error(4);
+    double const fine   = error(8);
+    REQUIRE(coarse < 0.01);
+    if constexpr (std::is_same<TestType, double>::value)
+    {
+      REQUIRE(std::log2(coarse / fine) > 2.8);
+    }
+  }
+
+  // periodic upwind advection, at many times the explicit stability limit;
+  // exp(dt A) is a poisson-weighted sum of shifts, so the exact step is known
+  int const size       = 64;
+  TestType const speed = 100.0;
+  TestType const dt    = 0.2;
+  auto const make_workspace = [&](int const krylov_dimension) {
+    host_workspace<TestType> host_space(*pde, table, time_scheme::exponential,
+                                        krylov_dimension);
+    for (fk::vector<TestType> *const v :
+         {&host_space.x, &host_space.fx, &host_space.x_orig,
+          &host_space.result_1, &host_space.result_2})
+    {
+      v->resize(size);
+    }
+    for (fk::vector<TestType> &v : host_space.krylov_basis)
+    {
+      v.resize(size);
+    }
+    for (int i = 0; i < size; ++i)
+    {
+      host_space.x(i) = std::sin(2.0 * M_PI * i / size) + (i < size / 2);
+    }
+    return host_space;
+  };
+  auto const advected = [&](fk::vector<TestType> const &x) {
+    double const rate = speed * dt;
+    std::vector<double> exact(size, 0.0);
+    for (int k = 0; k < 10 * rate; ++k)
+    {
+      double const weight =
+          std::exp(-rate + k * std::log(rate) - std::lgamma(k + 1.0));
+      for (int i = 0; i < size; ++i)
+      {
+        exact[i] += weight * x((i - k % size + size) % size);
+      }
+    }
+    return exact;
+  };
+  source_function<TestType> const no_sources =
+      [](TestType const, TestType const, fk::vector<TestType> &) {};
+
+  SECTION("stiff, in substeps")
+  {
+    for (int const krylov_dimension : {30, 12})
+    {
+      host_workspace<TestType> host_space = make_workspace(krylov_dimension);
+      apply_function const apply = [&] {
+        for (int i = 0; i < size; ++i)
+        {
+          host_space.fx(i) =
+              -speed * (host_space.x(i) - host_space.x((i + size - 1) % size));
+        }
+      };
+      std::vector<double> const exact = advected(host_space.x);
+
+      krylov_control control;
+      control.tolerance = tolerance;
+      exponential_step(host_space, apply, no_sources, TestType{0.0}, dt,
+                       control);
+      REQUIRE(control.converged);
+      REQUIRE(control.substeps > 1);
+      REQUIRE(largest_difference(host_space.x, [&](int const i) {
+                return exact[i];
+              }) <= 100 * tolerance * std::sqrt(size));
+
+      // the next step starts from the substep this one ended with
+      REQUIRE(control.next_substep < dt);
+      REQUIRE(control.next_substep > 0.0);
+    }
+  }
+
+  SECTION("giving up")
+  {
+    host_workspace<TestType> host_space = make_workspace(4);
+    apply_function const apply          = [&] {
+      for (int i = 0; i < size; ++i)
+      {
+        host_space.fx(i) =
+            -speed * (host_space.x(i) - host_space.x((i + size - 1) % size));
+      }
+    };
+    krylov_control control;
+    control.tolerance    = tolerance;
+    control.max_restarts = 0;
+    REQUIRE(exponential_step(host_space, apply, no_sources, TestType{0.0}, dt,
+                             control) == 4);
+    REQUIRE(!control.converged);
+    REQUIRE(control.substeps == 1);
+  }
+
+  SECTION("workspace")
+  {
+    int const krylov_dimension = 10;
+    host_workspace<TestType> const host_space(
+        *pde, table, time_scheme::exponential, krylov_dimension);
+    int64_t const vector_size = host_space.x.size();
+    REQUIRE(host_space.krylov_basis.size() == krylov_dimension + 1);
+    REQUIRE(host_space.size_MB() ==
+            Approx(static_cast<double>(vector_size) *
+                   (5 + krylov_dimension + 1) * sizeof(TestType) * 1e-6));
+  }
+}